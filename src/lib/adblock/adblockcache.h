@@ -0,0 +1,110 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef ADBLOCKCACHE_H
+#define ADBLOCKCACHE_H
+
+#include <QHash>
+#include <QCache>
+#include <QMutex>
+#include <QAtomicInt>
+
+// Bounded LRU cache that can be used from multiple threads at once.
+// Entries are split into shards by key hash, so threads rarely wait for the same lock.
+// Copy of cache is empty, cached values are only valid for one matcher.
+template <typename Key, typename T>
+class AdBlockCache
+{
+public:
+    explicit AdBlockCache(int maxEntries)
+        : m_maxEntries(maxEntries)
+    {
+        init();
+    }
+
+    AdBlockCache(const AdBlockCache &other)
+        : m_maxEntries(other.m_maxEntries)
+    {
+        init();
+    }
+
+    bool find(const Key &key, T &value) const
+    {
+        Shard &shard = m_shards[shardIndex(key)];
+        QMutexLocker locker(&shard.mutex);
+
+        // QCache::object() also moves the entry to front
+        const T* object = shard.cache.object(key);
+
+        if (!object) {
+            m_misses.fetchAndAddRelaxed(1);
+            return false;
+        }
+
+        value = *object;
+        m_hits.fetchAndAddRelaxed(1);
+        return true;
+    }
+
+    void insert(const Key &key, const T &value) const
+    {
+        Shard &shard = m_shards[shardIndex(key)];
+        QMutexLocker locker(&shard.mutex);
+
+        shard.cache.insert(key, new T(value));
+    }
+
+    int hits() const { return m_hits.load(); }
+    int misses() const { return m_misses.load(); }
+
+    double hitRate() const
+    {
+        const int total = hits() + misses();
+        return total ? double(hits()) / total : 0;
+    }
+
+private:
+    AdBlockCache &operator=(const AdBlockCache &other);
+
+    enum { ShardCount = 16 };
+
+    struct Shard {
+        QMutex mutex;
+        QCache<Key, T> cache;
+    };
+
+    void init()
+    {
+        for (int i = 0; i < ShardCount; ++i) {
+            m_shards[i].cache.setMaxCost(qMax(1, m_maxEntries / ShardCount));
+        }
+    }
+
+    static int shardIndex(const Key &key)
+    {
+        // Low bits of qHash are also used for buckets, so mix in the high bits
+        const uint hash = qHash(key);
+        return (hash ^ (hash >> 16)) % ShardCount;
+    }
+
+    int m_maxEntries;
+    mutable Shard m_shards[ShardCount];
+    mutable QAtomicInt m_hits;
+    mutable QAtomicInt m_misses;
+};
+
+#endif // ADBLOCKCACHE_H
@@ -18,20 +18,29 @@
 #include "adblockdialog.h"
 #include "adblockmanager.h"
 #include "adblocksubscription.h"
-#include "adblocktreewidget.h"
+#include "adblocktreeview.h"
 #include "adblockaddsubscriptiondialog.h"
+#include "adblockprofiler.h"
 #include "mainapplication.h"
 #include "qztools.h"
 
+#include <QDir>
+#include <QFile>
 #include <QMenu>
 #include <QTimer>
+#include <QDialog>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QVBoxLayout>
 #include <QMessageBox>
 #include <QInputDialog>
+#include <QPushButton>
+#include <QDialogButtonBox>
 
 AdBlockDialog::AdBlockDialog(QWidget* parent)
     : QWidget(parent)
     , m_manager(AdBlockManager::instance())
-    , m_currentTreeWidget(0)
+    , m_currentTreeView(0)
     , m_currentSubscription(0)
     , m_loaded(false)
 {
@@ -53,6 +62,12 @@ AdBlockDialog::AdBlockDialog(QWidget* parent)
     m_actionRemoveSubscription = menu->addAction(tr("Remove Subscription"), this, SLOT(removeSubscription()));
     menu->addAction(tr("Update Subscriptions"), m_manager, SLOT(updateAllSubscriptions()));
     menu->addSeparator();
+    QAction* profileAction = menu->addAction(tr("Profile Rules"));
+    profileAction->setCheckable(true);
+    profileAction->setChecked(AdBlockProfiler::isEnabled());
+    connect(profileAction, SIGNAL(toggled(bool)), this, SLOT(enableProfiling(bool)));
+    menu->addAction(tr("Rule Statistics..."), this, SLOT(showStatistics()));
+    menu->addSeparator();
     menu->addAction(tr("Learn about writing rules..."), this, SLOT(learnAboutRules()));
 
     buttonOptions->setMenu(menu);
@@ -76,10 +91,10 @@ void AdBlockDialog::showRule(const AdBlockRule* rule) const
     }
 
     for (int i = 0; i < tabWidget->count(); ++i) {
-        AdBlockTreeWidget* treeWidget = qobject_cast<AdBlockTreeWidget*>(tabWidget->widget(i));
+        AdBlockTreeView* treeView = qobject_cast<AdBlockTreeView*>(tabWidget->widget(i));
 
-        if (subscription == treeWidget->subscription()) {
-            treeWidget->showRule(rule);
+        if (subscription == treeView->subscription()) {
+            treeView->showRule(rule);
             tabWidget->setCurrentIndex(i);
             break;
         }
@@ -88,12 +103,12 @@ void AdBlockDialog::showRule(const AdBlockRule* rule) const
 
 void AdBlockDialog::addRule()
 {
-    m_currentTreeWidget->addRule();
+    m_currentTreeView->addRule();
 }
 
 void AdBlockDialog::removeRule()
 {
-    m_currentTreeWidget->removeRule();
+    m_currentTreeView->removeRule();
 }
 
 void AdBlockDialog::addSubscription()
@@ -107,7 +122,7 @@ void AdBlockDialog::addSubscription()
     QString url = dialog.url();
 
     if (AdBlockSubscription* subscription = m_manager->addSubscription(title, url)) {
-        AdBlockTreeWidget* tree = new AdBlockTreeWidget(subscription, tabWidget);
+        AdBlockTreeView* tree = new AdBlockTreeView(subscription, tabWidget);
         int index = tabWidget->insertTab(tabWidget->count() - 1, tree, subscription->title());
 
         tabWidget->setCurrentIndex(index);
@@ -117,22 +132,22 @@ void AdBlockDialog::addSubscription()
 void AdBlockDialog::removeSubscription()
 {
     if (m_manager->removeSubscription(m_currentSubscription)) {
-        delete m_currentTreeWidget;
+        delete m_currentTreeView;
     }
 }
 
 void AdBlockDialog::currentChanged(int index)
 {
     if (index != -1) {
-        m_currentTreeWidget = qobject_cast<AdBlockTreeWidget*>(tabWidget->widget(index));
-        m_currentSubscription = m_currentTreeWidget->subscription();
+        m_currentTreeView = qobject_cast<AdBlockTreeView*>(tabWidget->widget(index));
+        m_currentSubscription = m_currentTreeView->subscription();
     }
 }
 
 void AdBlockDialog::filterString(const QString &string)
 {
-    if (m_currentTreeWidget && adblockCheckBox->isChecked()) {
-        m_currentTreeWidget->filterString(string);
+    if (m_currentTreeView && adblockCheckBox->isChecked()) {
+        m_currentTreeView->filterString(string);
     }
 }
 
@@ -155,6 +170,90 @@ void AdBlockDialog::aboutToShowMenu()
     m_actionRemoveSubscription->setEnabled(subscriptionRemovable);
 }
 
+void AdBlockDialog::enableProfiling(bool enable)
+{
+    AdBlockProfiler::setEnabled(enable);
+}
+
+void AdBlockDialog::showStatistics()
+{
+    QDialog* dialog = new QDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->setWindowTitle(tr("AdBlock Rule Statistics"));
+    dialog->resize(800, 500);
+
+    QTreeWidget* tree = new QTreeWidget(dialog);
+    tree->setRootIsDecorated(false);
+    tree->setHeaderLabels(QStringList() << tr("Rule") << tr("Subscription") << tr("Evaluations")
+                          << tr("Hits") << tr("Average [µs]") << tr("Total [ms]"));
+    tree->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    tree->header()->setStretchLastSection(false);
+
+    const QHash<const AdBlockRule*, AdBlockProfiler::RuleStatistics> statistics = AdBlockProfiler::statistics();
+
+    // Statistics of rules that are no longer in subscriptions are not shown
+    foreach (AdBlockSubscription* subscription, m_manager->subscriptions()) {
+        foreach (const AdBlockRule* rule, subscription->allRules()) {
+            if (!statistics.contains(rule)) {
+                continue;
+            }
+
+            const AdBlockProfiler::RuleStatistics stats = statistics.value(rule);
+
+            QTreeWidgetItem* item = new QTreeWidgetItem(tree);
+            item->setText(0, rule->filter());
+            item->setText(1, subscription->title());
+            item->setData(2, Qt::DisplayRole, stats.evaluations);
+            item->setData(3, Qt::DisplayRole, stats.hits);
+            item->setData(4, Qt::DisplayRole, stats.averageNsecs() / 1000.0);
+            item->setData(5, Qt::DisplayRole, stats.totalNsecs() / 1000000.0);
+
+            if (rule->isSlow()) {
+                item->setToolTip(0, tr("Slow rule, it is matched with regular expression"));
+                item->setForeground(0, QColor(Qt::darkRed));
+            }
+        }
+    }
+
+    tree->setSortingEnabled(true);
+    tree->sortByColumn(5, Qt::DescendingOrder);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, dialog);
+    QPushButton* exportButton = buttonBox->addButton(tr("Export..."), QDialogButtonBox::ActionRole);
+    QPushButton* resetButton = buttonBox->addButton(QDialogButtonBox::Reset);
+
+    connect(buttonBox, SIGNAL(rejected()), dialog, SLOT(close()));
+    connect(exportButton, SIGNAL(clicked()), this, SLOT(exportStatistics()));
+    connect(resetButton, &QPushButton::clicked, tree, [tree]() {
+        AdBlockProfiler::reset();
+        tree->clear();
+    });
+
+    QVBoxLayout* layout = new QVBoxLayout(dialog);
+    layout->addWidget(tree);
+    layout->addWidget(buttonBox);
+
+    dialog->show();
+}
+
+void AdBlockDialog::exportStatistics()
+{
+    const QString fileName = QzTools::getSaveFileName(QSL("AdBlockStatistics"), this, tr("Export Rule Statistics"),
+                             QDir::homePath() + QSL("/adblock-statistics.json"), QSL("JSON (*.json)"));
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        QMessageBox::critical(this, tr("Error!"), tr("Cannot write to file!"));
+        return;
+    }
+
+    file.write(AdBlockProfiler::toJson(m_manager->subscriptions()));
+}
+
 void AdBlockDialog::learnAboutRules()
 {
     mApp->addNewTab(QUrl("http://adblockplus.org/en/filters"));
@@ -163,8 +262,8 @@ void AdBlockDialog::learnAboutRules()
 void AdBlockDialog::loadSubscriptions()
 {
     for (int i = 0; i < tabWidget->count(); ++i) {
-        AdBlockTreeWidget* treeWidget = qobject_cast<AdBlockTreeWidget*>(tabWidget->widget(i));
-        treeWidget->refresh();
+        AdBlockTreeView* treeView = qobject_cast<AdBlockTreeView*>(tabWidget->widget(i));
+        treeView->refresh();
     }
 }
 
@@ -175,7 +274,7 @@ void AdBlockDialog::load()
     }
 
     foreach (AdBlockSubscription* subscription, m_manager->subscriptions()) {
-        AdBlockTreeWidget* tree = new AdBlockTreeWidget(subscription, tabWidget);
+        AdBlockTreeView* tree = new AdBlockTreeView(subscription, tabWidget);
         tabWidget->addTab(tree, subscription->title());
     }
 
@@ -24,7 +24,7 @@
 #include "ui_adblockdialog.h"
 
 class AdBlockSubscription;
-class AdBlockTreeWidget;
+class AdBlockTreeView;
 class AdBlockManager;
 class AdBlockRule;
 
@@ -51,12 +51,16 @@ private slots:
     void aboutToShowMenu();
     void learnAboutRules();
 
+    void enableProfiling(bool enable);
+    void showStatistics();
+    void exportStatistics();
+
     void loadSubscriptions();
     void load();
 
 private:
     AdBlockManager* m_manager;
-    AdBlockTreeWidget* m_currentTreeWidget;
+    AdBlockTreeView* m_currentTreeView;
     AdBlockSubscription* m_currentSubscription;
 
     QAction* m_actionAddRule;
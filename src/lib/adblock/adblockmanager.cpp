@@ -20,6 +20,7 @@
 #include "adblockmatcher.h"
 #include "adblocksubscription.h"
 #include "adblockurlinterceptor.h"
+#include "adblockrequestcontext.h"
 #include "datapaths.h"
 #include "mainapplication.h"
 #include "webpage.h"
@@ -27,6 +28,7 @@
 #include "browserwindow.h"
 #include "settings.h"
 #include "networkmanager.h"
+#include "scripts.h"
 
 #include <QDateTime>
 #include <QTextStream>
@@ -35,28 +37,66 @@
 #include <QMessageBox>
 #include <QUrlQuery>
 #include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QWebEngineProfile>
+#include <QWebEngineScriptCollection>
 
-//#define ADBLOCK_DEBUG
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtConcurrent/QtConcurrentMap>
 
-#ifdef ADBLOCK_DEBUG
-#include <QElapsedTimer>
-#endif
+//#define ADBLOCK_DEBUG
 
 Q_GLOBAL_STATIC(AdBlockManager, qz_adblock_manager)
 
+// Name of the element hiding script and id of the style element it creates
+static const QString elementHidingName = QStringLiteral("_qupzilla_adblock_elementhiding");
+
+static QStringList excludedSchemes()
+{
+    return QStringList() << QSL("file") << QSL("qrc") << QSL("qupzilla") << QSL("data") << QSL("abp");
+}
+
+static AdBlockMatcher* createMatcher(const QVector<AdBlockRule*> &rules)
+{
+    AdBlockMatcher* matcher = new AdBlockMatcher;
+    matcher->update(rules);
+    return matcher;
+}
+
 AdBlockManager::AdBlockManager(QObject* parent)
     : QObject(parent)
     , m_loaded(false)
     , m_enabled(true)
-    , m_matcher(new AdBlockMatcher(this))
+    , m_loadWatcher(new QFutureWatcher<SubscriptionRules>(this))
+    , m_matcherWatcher(new QFutureWatcher<AdBlockMatcher*>(this))
+    , m_matcherUpdatePending(false)
+    , m_domainRulesCache(100)
     , m_interceptor(new AdBlockUrlInterceptor(this))
 {
+    connect(m_loadWatcher, SIGNAL(finished()), this, SLOT(subscriptionsLoaded()));
+    connect(m_matcherWatcher, SIGNAL(finished()), this, SLOT(matcherUpdated()));
+
     load();
 }
 
 AdBlockManager::~AdBlockManager()
 {
+    if (!m_loadingSubscriptions.isEmpty()) {
+        m_loadWatcher->waitForFinished();
+
+        foreach (const SubscriptionRules &result, m_loadWatcher->future().results()) {
+            qDeleteAll(result.second);
+        }
+    }
+
+    if (m_matcherWatcher->isRunning()) {
+        m_matcherWatcher->waitForFinished();
+        delete m_matcherWatcher->result();
+    }
+
     qDeleteAll(m_subscriptions);
+    qDeleteAll(m_retiredRules);
 }
 
 AdBlockManager* AdBlockManager::instance()
@@ -81,12 +121,10 @@ void AdBlockManager::setEnabled(bool enabled)
     load();
     mApp->reloadUserStyleSheet();
 
-    QMutexLocker locker(&m_mutex);
-
     if (m_enabled) {
-        m_matcher->update();
+        updateMatcher();
     } else {
-        m_matcher->clear();
+        setMatcher(0);
     }
 }
 
@@ -97,26 +135,33 @@ QList<AdBlockSubscription*> AdBlockManager::subscriptions() const
 
 bool AdBlockManager::block(QWebEngineUrlRequestInfo &request)
 {
-    QMutexLocker locker(&m_mutex);
-
     if (!isEnabled()) {
         return false;
     }
 
+    // Keep reference to current matcher, it may be replaced by another thread while matching
+    std::shared_ptr<AdBlockMatcher> matcher = this->matcher();
+
+    if (!matcher && m_matcherLoading.loadAcquire()) {
+        matcher = waitForMatcher();
+    }
+
+    if (!matcher) {
+        return false;
+    }
+
 #ifdef ADBLOCK_DEBUG
     QElapsedTimer timer;
     timer.start();
 #endif
-    const QString urlString = request.requestUrl().toEncoded().toLower();
-    const QString urlDomain = request.requestUrl().host().toLower();
-    const QString urlScheme = request.requestUrl().scheme().toLower();
+    const AdBlockRequestContext context(request);
 
-    if (!canRunOnScheme(urlScheme) || !canBeBlocked(request.firstPartyUrl())) {
+    if (!canRunOnScheme(context.scheme()) || matcher->adBlockDisabledForUrl(context.firstPartyUrl())) {
         return false;
     }
 
     bool res = false;
-    const AdBlockRule* blockedRule = m_matcher->match(request, urlDomain, urlString);
+    const AdBlockRule* blockedRule = matcher->cachedMatch(context);
 
     if (blockedRule) {
         res = true;
@@ -125,7 +170,10 @@ bool AdBlockManager::block(QWebEngineUrlRequestInfo &request)
             QUrl url(QSL("qupzilla:adblock"));
             QUrlQuery query;
             query.addQueryItem(QSL("rule"), blockedRule->filter());
-            query.addQueryItem(QSL("subscription"), blockedRule->subscription()->title());
+            // Subscription of rule may have been just removed
+            if (blockedRule->subscription()) {
+                query.addQueryItem(QSL("subscription"), blockedRule->subscription()->title());
+            }
             url.setQuery(query);
             request.redirect(url);
         }
@@ -140,24 +188,39 @@ bool AdBlockManager::block(QWebEngineUrlRequestInfo &request)
 
 #ifdef ADBLOCK_DEBUG
     qDebug() << timer.elapsed() << request.requestUrl();
+    qDebug() << "Cache:" << matcher->cacheStatistics();
 #endif
 
     return res;
 }
 
-QStringList AdBlockManager::disabledRules() const
+QSet<QString> AdBlockManager::disabledRules() const
 {
     return m_disabledRules;
 }
 
 void AdBlockManager::addDisabledRule(const QString &filter)
 {
-    m_disabledRules.append(filter);
+    m_disabledRules.insert(filter);
 }
 
 void AdBlockManager::removeDisabledRule(const QString &filter)
 {
-    m_disabledRules.removeOne(filter);
+    m_disabledRules.remove(filter);
+}
+
+void AdBlockManager::retireRules(const QVector<AdBlockRule*> &rules)
+{
+    if (rules.isEmpty()) {
+        return;
+    }
+
+    m_retiredRules += rules;
+
+    // Matcher that is being built may reference the retired rules, it must not be used
+    if (m_matcherWatcher->isRunning()) {
+        m_matcherUpdatePending = true;
+    }
 }
 
 bool AdBlockManager::addSubscriptionFromUrl(const QUrl &url)
@@ -195,6 +258,8 @@ AdBlockSubscription* AdBlockManager::addSubscription(const QString &title, const
         return 0;
     }
 
+    finishLoading();
+
     QString fileName = QzTools::filterCharsFromFilename(title.toLower()) + ".txt";
     QString filePath = QzTools::ensureUniqueFilename(DataPaths::currentProfilePath() + "/adblock/" + fileName);
 
@@ -217,23 +282,28 @@ AdBlockSubscription* AdBlockManager::addSubscription(const QString &title, const
     m_subscriptions.insert(m_subscriptions.count() - 1, subscription);
     connect(subscription, SIGNAL(subscriptionUpdated()), mApp, SLOT(reloadUserStyleSheet()));
     connect(subscription, SIGNAL(subscriptionChanged()), this, SLOT(updateMatcher()));
+    connect(subscription, SIGNAL(ruleAdded(const AdBlockRule*)), this, SLOT(ruleAdded(const AdBlockRule*)));
+    connect(subscription, SIGNAL(ruleRemoved(const AdBlockRule*)), this, SLOT(ruleRemoved(const AdBlockRule*)));
+    connect(subscription, SIGNAL(ruleChanged(const AdBlockRule*)), this, SLOT(ruleChanged(const AdBlockRule*)));
 
     return subscription;
 }
 
 bool AdBlockManager::removeSubscription(AdBlockSubscription* subscription)
 {
-    QMutexLocker locker(&m_mutex);
+    finishLoading();
 
     if (!m_subscriptions.contains(subscription) || !subscription->canBeRemoved()) {
         return false;
     }
 
     QFile(subscription->filePath()).remove();
+    QFile(subscription->cacheFilePath()).remove();
     m_subscriptions.removeOne(subscription);
 
-    m_matcher->update();
+    // Rules of subscription are retired in its destructor
     delete subscription;
+    updateMatcher();
 
     return true;
 }
@@ -253,21 +323,14 @@ AdBlockCustomList* AdBlockManager::customList() const
 
 void AdBlockManager::load()
 {
-    QMutexLocker locker(&m_mutex);
-
-    if (m_loaded) {
+    if (m_loaded || !m_loadingSubscriptions.isEmpty()) {
         return;
     }
 
-#ifdef ADBLOCK_DEBUG
-    QElapsedTimer timer;
-    timer.start();
-#endif
-
     Settings settings;
     settings.beginGroup("AdBlock");
     m_enabled = settings.value("enabled", m_enabled).toBool();
-    m_disabledRules = settings.value("disabledRules", QStringList()).toStringList();
+    m_disabledRules = settings.value("disabledRules", QStringList()).toStringList().toSet();
     QDateTime lastUpdate = settings.value("lastUpdate", QDateTime()).toDateTime();
     settings.endGroup();
 
@@ -322,33 +385,108 @@ void AdBlockManager::load()
     AdBlockCustomList* customList = new AdBlockCustomList(this);
     m_subscriptions.append(customList);
 
-    // Load all subscriptions
     foreach (AdBlockSubscription* subscription, m_subscriptions) {
-        subscription->loadSubscription(m_disabledRules);
-
         connect(subscription, SIGNAL(subscriptionUpdated()), mApp, SLOT(reloadUserStyleSheet()));
         connect(subscription, SIGNAL(subscriptionChanged()), this, SLOT(updateMatcher()));
+        connect(subscription, SIGNAL(ruleAdded(const AdBlockRule*)), this, SLOT(ruleAdded(const AdBlockRule*)));
+        connect(subscription, SIGNAL(ruleRemoved(const AdBlockRule*)), this, SLOT(ruleRemoved(const AdBlockRule*)));
+        connect(subscription, SIGNAL(ruleChanged(const AdBlockRule*)), this, SLOT(ruleChanged(const AdBlockRule*)));
     }
 
     if (lastUpdate.addDays(5) < QDateTime::currentDateTime()) {
         QTimer::singleShot(1000 * 60, this, SLOT(updateAllSubscriptions()));
     }
 
-#ifdef ADBLOCK_DEBUG
-    qDebug() << "AdBlock loaded in" << timer.elapsed();
-#endif
+    // Read all subscriptions in parallel on worker threads, matcher is built once all are read
+    m_loadingSubscriptions = m_subscriptions;
+    m_matcherLoading.storeRelease(1);
+    m_loadWatcher->setFuture(QtConcurrent::mapped(m_loadingSubscriptions, &AdBlockManager::readSubscriptionRules));
 
-    m_matcher->update();
+    mApp->networkManager()->installUrlInterceptor(m_interceptor);
+}
+
+void AdBlockManager::subscriptionsLoaded()
+{
+    if (m_loaded || m_loadingSubscriptions.isEmpty()) {
+        return;
+    }
+
+    const QList<SubscriptionRules> results = m_loadWatcher->future().results();
+
+    for (int i = 0; i < m_loadingSubscriptions.count(); ++i) {
+        const SubscriptionRules &result = results.at(i);
+        m_loadingSubscriptions.at(i)->setRules(result.second, result.first, m_disabledRules);
+    }
+
+    m_loadingSubscriptions.clear();
     m_loaded = true;
 
-    mApp->networkManager()->installUrlInterceptor(m_interceptor);
+    updateMatcher();
+}
+
+void AdBlockManager::finishLoading()
+{
+    // Subscriptions must not be changed while they are being read on worker threads
+    m_loadWatcher->waitForFinished();
+    subscriptionsLoaded();
+}
+
+AdBlockManager::SubscriptionRules AdBlockManager::readSubscriptionRules(AdBlockSubscription* subscription)
+{
+    SubscriptionRules result;
+    result.first = subscription->readRules(result.second);
+    return result;
 }
 
 void AdBlockManager::updateMatcher()
 {
-    QMutexLocker locker(&m_mutex);
+    if (!m_enabled) {
+        return;
+    }
+
+    // Only one build at a time, new one will be started when current finishes
+    if (m_matcherWatcher->isRunning()) {
+        m_matcherUpdatePending = true;
+        return;
+    }
+
+    m_matcherUpdatePending = false;
+    m_matcherWatcher->setFuture(QtConcurrent::run(createMatcher, allRules()));
+}
+
+void AdBlockManager::matcherUpdated()
+{
+    AdBlockMatcher* matcher = m_matcherWatcher->result();
+
+    if (!m_enabled) {
+        delete matcher;
+        setMatcher(0);
+        return;
+    }
+
+    // Rules were changed while building, matcher may be outdated or reference retired rules
+    if (m_matcherUpdatePending) {
+        delete matcher;
+        updateMatcher();
+        return;
+    }
+
+    setMatcher(matcher);
+}
+
+void AdBlockManager::ruleAdded(const AdBlockRule* rule)
+{
+    applyRuleChange(rule, RuleAdded);
+}
 
-    m_matcher->update();
+void AdBlockManager::ruleRemoved(const AdBlockRule* rule)
+{
+    applyRuleChange(rule, RuleRemoved);
+}
+
+void AdBlockManager::ruleChanged(const AdBlockRule* rule)
+{
+    applyRuleChange(rule, RuleChanged);
 }
 
 void AdBlockManager::updateAllSubscriptions()
@@ -376,7 +514,7 @@ void AdBlockManager::save()
     Settings settings;
     settings.beginGroup("AdBlock");
     settings.setValue("enabled", m_enabled);
-    settings.setValue("disabledRules", m_disabledRules);
+    settings.setValue("disabledRules", QStringList(m_disabledRules.toList()));
     settings.endGroup();
 }
 
@@ -387,30 +525,194 @@ bool AdBlockManager::isEnabled() const
 
 bool AdBlockManager::canRunOnScheme(const QString &scheme) const
 {
+    // Called for every request, excludedSchemes() is only used for the element hiding script
     return !(scheme == QLatin1String("file") || scheme == QLatin1String("qrc")
              || scheme == QLatin1String("qupzilla") || scheme == QLatin1String("data")
              || scheme == QLatin1String("abp"));
 }
 
-bool AdBlockManager::canBeBlocked(const QUrl &url) const
+bool AdBlockManager::elementHidingEnabledForUrl(const QUrl &url) const
 {
-    return !m_matcher->adBlockDisabledForUrl(url);
+    const std::shared_ptr<AdBlockMatcher> matcher = this->matcher();
+
+    // Both document and elemhide exceptions disable element hiding
+    return isEnabled() && matcher && canRunOnScheme(url.scheme()) && !matcher->elemHideDisabledForUrl(url);
 }
 
-QString AdBlockManager::elementHidingRules(const QUrl &url) const
+bool AdBlockManager::elementHidingExceptionForUrl(const QUrl &url) const
 {
-    if (!isEnabled() || !canRunOnScheme(url.scheme()) || !canBeBlocked(url))
-        return QString();
+    const std::shared_ptr<AdBlockMatcher> matcher = this->matcher();
 
-    return m_matcher->elementHidingRules();
+    return isEnabled() && matcher && canRunOnScheme(url.scheme()) && matcher->elemHideDisabledForUrl(url);
+}
+
+QString AdBlockManager::elementHidingStyleId() const
+{
+    return elementHidingName;
 }
 
 QString AdBlockManager::elementHidingRulesForDomain(const QUrl &url) const
 {
-    if (!isEnabled() || !canRunOnScheme(url.scheme()) || !canBeBlocked(url))
+    const std::shared_ptr<AdBlockMatcher> matcher = this->matcher();
+
+    if (!isEnabled() || !matcher || !canRunOnScheme(url.scheme()) || matcher->elemHideDisabledForUrl(url))
         return QString();
 
-    return m_matcher->elementHidingRulesForDomain(url.host());
+    // Cache is cleared when matcher changes
+    const QString host = url.host();
+
+    if (QString* rules = m_domainRulesCache.object(host)) {
+        return *rules;
+    }
+
+    const QString rules = matcher->elementHidingRulesForDomain(host);
+    m_domainRulesCache.insert(host, new QString(rules));
+
+    return rules;
+}
+
+QVector<AdBlockRule*> AdBlockManager::allRules() const
+{
+    QVector<AdBlockRule*> rules;
+
+    foreach (AdBlockSubscription* subscription, m_subscriptions) {
+        rules += subscription->allRules();
+    }
+
+    return rules;
+}
+
+std::shared_ptr<AdBlockMatcher> AdBlockManager::matcher() const
+{
+    return std::atomic_load(&m_matcher);
+}
+
+std::shared_ptr<AdBlockMatcher> AdBlockManager::waitForMatcher() const
+{
+    // Requests made while subscriptions are loaded wait for the first matcher, so restored
+    // pages are not loaded unfiltered. But never wait longer than 2 seconds, then the request
+    // is let through.
+    const int maxWait = 2000;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&m_matcherMutex);
+    std::shared_ptr<AdBlockMatcher> matcher = this->matcher();
+
+    while (!matcher && m_matcherLoading.loadAcquire() && timer.elapsed() < maxWait) {
+        m_matcherCondition.wait(&m_matcherMutex, maxWait - timer.elapsed());
+        matcher = this->matcher();
+    }
+
+    return matcher;
+}
+
+void AdBlockManager::setMatcher(AdBlockMatcher* matcher)
+{
+    const std::shared_ptr<AdBlockMatcher> oldMatcher = std::atomic_exchange(&m_matcher, std::shared_ptr<AdBlockMatcher>(matcher));
+
+    if (m_matcherLoading.loadAcquire()) {
+        QMutexLocker locker(&m_matcherMutex);
+        m_matcherLoading.storeRelease(0);
+        m_matcherCondition.wakeAll();
+    }
+
+    m_domainRulesCache.clear();
+
+    // Script is only replaced when global rules were changed
+    if (!matcher || !oldMatcher || matcher->elementHidingRules() != oldMatcher->elementHidingRules()) {
+        updateElementHidingScript(matcher);
+    }
+
+    // Matcher that is being built may still use retired rules
+    if (m_matcherWatcher->isRunning()) {
+        return;
+    }
+
+    // Old matcher may still be in use by network threads and new matcher may share
+    // network rules with it, so retired rules are deleted only after the last
+    // reference to both matchers is released
+    QVector<std::shared_ptr<AdBlockRule> > retiredRules;
+    retiredRules.reserve(m_retiredRules.count());
+
+    foreach (AdBlockRule* rule, m_retiredRules) {
+        retiredRules.append(std::shared_ptr<AdBlockRule>(rule));
+    }
+
+    if (oldMatcher) {
+        oldMatcher->adoptRules(retiredRules);
+    }
+    if (matcher) {
+        matcher->adoptRules(retiredRules);
+    }
+
+    m_retiredRules.clear();
+}
+
+void AdBlockManager::applyRuleChange(const AdBlockRule* rule, RuleChange change)
+{
+    // Matcher will be built with all rules once subscriptions are loaded
+    if (!m_enabled || !m_loaded) {
+        return;
+    }
+
+    // Matcher that is being built may or may not include the change
+    if (m_matcherWatcher->isRunning()) {
+        m_matcherUpdatePending = true;
+        return;
+    }
+
+    const std::shared_ptr<AdBlockMatcher> current = matcher();
+    if (!current) {
+        updateMatcher();
+        return;
+    }
+
+    // Current matcher can't be changed while network threads are using it,
+    // so the change is applied to its clone
+    AdBlockMatcher* matcher = current->clone();
+
+    switch (change) {
+    case RuleAdded:
+        matcher->addRule(rule);
+        break;
+
+    case RuleRemoved:
+        matcher->removeRule(rule);
+        break;
+
+    case RuleChanged:
+        matcher->updateRule(rule);
+        break;
+    }
+
+    setMatcher(matcher);
+}
+
+void AdBlockManager::updateElementHidingScript(AdBlockMatcher* matcher)
+{
+    QWebEngineScriptCollection* scripts = mApp->webProfile()->scripts();
+
+    const QWebEngineScript oldScript = scripts->findScript(elementHidingName);
+    if (!oldScript.isNull()) {
+        scripts->remove(oldScript);
+    }
+
+    if (!matcher || matcher->elementHidingRules().isEmpty()) {
+        return;
+    }
+
+    // Global rules are injected to every document as soon as it is created, so ads are
+    // not shown before they are hidden. Pages with exceptions have their own script
+    // that stops the injection, see WebPage::updateElementHidingException()
+    QWebEngineScript script;
+    script.setName(elementHidingName);
+    script.setInjectionPoint(QWebEngineScript::DocumentCreation);
+    script.setWorldId(WebPage::SafeJsWorld);
+    script.setRunsOnSubFrames(false);
+    script.setSourceCode(Scripts::setCssOnCreation(matcher->elementHidingRules(), elementHidingName, excludedSchemes()));
+    scripts->insert(script);
 }
 
 AdBlockSubscription* AdBlockManager::subscriptionByName(const QString &name) const
@@ -426,6 +728,8 @@ AdBlockSubscription* AdBlockManager::subscriptionByName(const QString &name) con
 
 AdBlockDialog* AdBlockManager::showDialog()
 {
+    finishLoading();
+
     if (!m_adBlockDialog) {
         m_adBlockDialog = new AdBlockDialog;
     }
@@ -19,15 +19,25 @@
 #define ADBLOCKMANAGER_H
 
 #include <QObject>
+#include <QSet>
+#include <QCache>
+#include <QPair>
+#include <QMutex>
+#include <QVector>
+#include <QAtomicInt>
 #include <QStringList>
 #include <QPointer>
-#include <QMutex>
+#include <QWaitCondition>
+
+#include <memory>
 
 #include "qzcommon.h"
 
 class QUrl;
 class QWebEngineUrlRequestInfo;
 
+template <typename T> class QFutureWatcher;
+
 class AdBlockRule;
 class AdBlockDialog;
 class AdBlockMatcher;
@@ -49,7 +59,13 @@ public:
     bool isEnabled() const;
     bool canRunOnScheme(const QString &scheme) const;
 
-    QString elementHidingRules(const QUrl &url) const;
+    // Global element hiding rules are injected into all pages with a script,
+    // it must be removed from pages where element hiding is not enabled
+    bool elementHidingEnabledForUrl(const QUrl &url) const;
+    // Whether document or elemhide exception applies to url, matcher is not waited for
+    bool elementHidingExceptionForUrl(const QUrl &url) const;
+    QString elementHidingStyleId() const;
+
     QString elementHidingRulesForDomain(const QUrl &url) const;
 
     AdBlockSubscription* subscriptionByName(const QString &name) const;
@@ -57,10 +73,14 @@ public:
 
     bool block(QWebEngineUrlRequestInfo &request);
 
-    QStringList disabledRules() const;
+    QSet<QString> disabledRules() const;
     void addDisabledRule(const QString &filter);
     void removeDisabledRule(const QString &filter);
 
+    // Rules removed from subscriptions may still be used by current matcher,
+    // they will be deleted once no matcher can reference them
+    void retireRules(const QVector<AdBlockRule*> &rules);
+
     bool addSubscriptionFromUrl(const QUrl &url);
 
     AdBlockSubscription* addSubscription(const QString &title, const QString &url);
@@ -68,6 +88,9 @@ public:
 
     AdBlockCustomList* customList() const;
 
+    // Waits until subscriptions read on worker threads are set, must be called before changing rules
+    void finishLoading();
+
     static AdBlockManager* instance();
 
 signals:
@@ -82,19 +105,60 @@ public slots:
 
     AdBlockDialog* showDialog();
 
+private slots:
+    void subscriptionsLoaded();
+    void matcherUpdated();
+
+    void ruleAdded(const AdBlockRule* rule);
+    void ruleRemoved(const AdBlockRule* rule);
+    void ruleChanged(const AdBlockRule* rule);
+
 private:
-    inline bool canBeBlocked(const QUrl &url) const;
+    // Result of AdBlockSubscription::readRules()
+    typedef QPair<bool, QVector<AdBlockRule*> > SubscriptionRules;
+
+    enum RuleChange {
+        RuleAdded,
+        RuleRemoved,
+        RuleChanged
+    };
+
+    static SubscriptionRules readSubscriptionRules(AdBlockSubscription* subscription);
+
+    QVector<AdBlockRule*> allRules() const;
+
+    std::shared_ptr<AdBlockMatcher> matcher() const;
+    std::shared_ptr<AdBlockMatcher> waitForMatcher() const;
+    void setMatcher(AdBlockMatcher* matcher);
+    void applyRuleChange(const AdBlockRule* rule, RuleChange change);
+    void updateElementHidingScript(AdBlockMatcher* matcher);
 
     bool m_loaded;
     bool m_enabled;
 
     QList<AdBlockSubscription*> m_subscriptions;
-    AdBlockMatcher* m_matcher;
-    QStringList m_disabledRules;
+    QSet<QString> m_disabledRules;
+
+    QList<AdBlockSubscription*> m_loadingSubscriptions;
+    QFutureWatcher<SubscriptionRules>* m_loadWatcher;
+
+    // Current matcher is only accessed with std::atomic_load/store, so network
+    // threads never wait for matcher updates
+    std::shared_ptr<AdBlockMatcher> m_matcher;
+    QFutureWatcher<AdBlockMatcher*>* m_matcherWatcher;
+    QVector<AdBlockRule*> m_retiredRules;
+    bool m_matcherUpdatePending;
+
+    // Element hiding rules for recently visited hosts
+    mutable QCache<QString, QString> m_domainRulesCache;
+
+    // Set while the first matcher is not ready yet
+    QAtomicInt m_matcherLoading;
+    mutable QMutex m_matcherMutex;
+    mutable QWaitCondition m_matcherCondition;
 
     AdBlockUrlInterceptor *m_interceptor;
     QPointer<AdBlockDialog> m_adBlockDialog;
-    QMutex m_mutex;
 };
 
 #endif // ADBLOCKMANAGER_H
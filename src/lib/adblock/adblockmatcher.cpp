@@ -16,13 +16,17 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 * ============================================================ */
 #include "adblockmatcher.h"
-#include "adblockmanager.h"
 #include "adblockrule.h"
-#include "adblocksubscription.h"
+#include "adblockrequestcontext.h"
 
-AdBlockMatcher::AdBlockMatcher(AdBlockManager* manager)
-    : QObject(manager)
-    , m_manager(manager)
+#include <algorithm>
+
+AdBlockMatcher::AdBlockMatcher()
+    : m_documentIndex(&AdBlockRule::urlMatch)
+    , m_elemhideIndex(&AdBlockRule::urlMatch)
+    , m_networkRules(new NetworkRules)
+    , m_decisionCache(4096)
+    , m_verdictCache(256)
 {
 }
 
@@ -31,56 +35,76 @@ AdBlockMatcher::~AdBlockMatcher()
     clear();
 }
 
-const AdBlockRule* AdBlockMatcher::match(const QWebEngineUrlRequestInfo &request, const QString &urlDomain, const QString &urlString) const
+const AdBlockRule* AdBlockMatcher::match(const AdBlockRequestContext &context) const
 {
+    const NetworkRules* network = m_networkRules.get();
+
     // Exception rules
-    if (m_networkExceptionTree.find(request, urlDomain, urlString))
+    if (network->exceptionTree.find(context))
         return 0;
 
-    int count = m_networkExceptionRules.count();
-    for (int i = 0; i < count; ++i) {
-        const AdBlockRule* rule = m_networkExceptionRules.at(i);
-        if (rule->networkMatch(request, urlDomain, urlString))
-            return 0;
-    }
+    if (network->exceptionIndex.find(context))
+        return 0;
+
+    if (findRule(m_addedExceptionRules, context))
+        return 0;
 
     // Block rules
-    if (const AdBlockRule* rule = m_networkBlockTree.find(request, urlDomain, urlString))
+    if (const AdBlockRule* rule = network->blockTree.find(context))
         return rule;
 
-    count = m_networkBlockRules.count();
-    for (int i = 0; i < count; ++i) {
-        const AdBlockRule* rule = m_networkBlockRules.at(i);
-        if (rule->networkMatch(request, urlDomain, urlString))
-            return rule;
-    }
+    if (const AdBlockRule* rule = network->blockIndex.find(context))
+        return rule;
 
-    return 0;
+    return findRule(m_addedBlockRules, context);
 }
 
-bool AdBlockMatcher::adBlockDisabledForUrl(const QUrl &url) const
+const AdBlockRule* AdBlockMatcher::cachedMatch(const AdBlockRequestContext &context) const
 {
-    int count = m_documentRules.count();
+    const RequestKey key = {context.urlString(), context.firstPartyDomain(), context.resourceType()};
+    const AdBlockRule* rule;
+
+    if (m_decisionCache.find(key, rule))
+        return rule;
 
-    for (int i = 0; i < count; ++i)
-        if (m_documentRules.at(i)->urlMatch(url))
-            return true;
+    rule = match(context);
+    m_decisionCache.insert(key, rule);
+    return rule;
+}
 
-    return false;
+bool AdBlockMatcher::adBlockDisabledForUrl(const QUrl &url) const
+{
+    return verdict(url).adBlockDisabled;
 }
 
 bool AdBlockMatcher::elemHideDisabledForUrl(const QUrl &url) const
 {
-    if (adBlockDisabledForUrl(url))
-        return true;
+    return verdict(url).elemHideDisabled;
+}
+
+AdBlockMatcher::Verdict AdBlockMatcher::verdict(const QUrl &url) const
+{
+    // Every request of page checks its first-party url, so verdicts are cached
+    Verdict verdict;
+
+    if (m_verdictCache.find(url, verdict))
+        return verdict;
 
-    int count = m_elemhideRules.count();
+    // Encoded url is computed only once for both indexes
+    const AdBlockRequestContext context(url, url, QWebEngineUrlRequestInfo::ResourceTypeMainFrame);
 
-    for (int i = 0; i < count; ++i)
-        if (m_elemhideRules.at(i)->urlMatch(url))
-            return true;
+    verdict.adBlockDisabled = m_documentIndex.find(context);
+    verdict.elemHideDisabled = verdict.adBlockDisabled || m_elemhideIndex.find(context);
 
-    return false;
+    m_verdictCache.insert(url, verdict);
+    return verdict;
+}
+
+QString AdBlockMatcher::cacheStatistics() const
+{
+    return QSL("decisions: %1 hits, %2 misses (%3%), first-party verdicts: %4 hits, %5 misses (%6%)")
+            .arg(m_decisionCache.hits()).arg(m_decisionCache.misses()).arg(m_decisionCache.hitRate() * 100, 0, 'f', 1)
+            .arg(m_verdictCache.hits()).arg(m_verdictCache.misses()).arg(m_verdictCache.hitRate() * 100, 0, 'f', 1);
 }
 
 QString AdBlockMatcher::elementHidingRules() const
@@ -90,73 +114,164 @@ QString AdBlockMatcher::elementHidingRules() const
 
 QString AdBlockMatcher::elementHidingRulesForDomain(const QString &domain) const
 {
-    QString rules;
-    int addedRulesCount = 0;
-    int count = m_domainRestrictedCssRules.count();
+    // Only rules indexed by domain or its parent domains can be enabled on domain
+    QVector<int> indexes;
+    QVector<int> excluded;
 
-    for (int i = 0; i < count; ++i) {
-        const AdBlockRule* rule = m_domainRestrictedCssRules.at(i);
-        if (!rule->matchDomain(domain))
+    int pos = 0;
+
+    while (pos >= 0) {
+        const QString suffix = pos ? domain.mid(pos) : domain;
+
+        indexes += m_cssDomainIndex.value(suffix);
+        excluded += m_cssExcludedDomainIndex.value(suffix);
+
+        pos = domain.indexOf(QL1C('.'), pos);
+        if (pos >= 0) {
+            ++pos;
+        }
+    }
+
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+    QVector<const AdBlockRule*> rules;
+    rules.reserve(indexes.count());
+
+    foreach (int index, indexes) {
+        const AdBlockRule* rule = m_domainRestrictedCssRules.at(index);
+        // Rule may be also disabled on some subdomain
+        if (rule->matchDomain(domain)) {
+            rules.append(rule);
+        }
+    }
+
+    // Rules enabled on all but some domains are almost always the same
+    if (excluded.isEmpty()) {
+        return createCss(rules, QL1S("{display:none !important;}\n")) + m_cssExcludingRules;
+    }
+
+    foreach (int index, m_cssExcludingIndexes) {
+        if (!excluded.contains(index)) {
+            rules.append(m_domainRestrictedCssRules.at(index));
+        }
+    }
+
+    return createCss(rules, QL1S("{display:none !important;}\n"));
+}
+
+void AdBlockMatcher::update(const QVector<AdBlockRule*> &rules)
+{
+    clear();
+
+    std::shared_ptr<NetworkRules> network(new NetworkRules);
+
+    foreach (const AdBlockRule* rule, rules) {
+        // Don't add internally disabled rules to cache
+        if (rule->isInternalDisabled())
             continue;
 
-        if (Q_UNLIKELY(addedRulesCount == 1000)) {
-            rules.append(rule->cssSelector());
-            rules.append(QL1S("{display:none !important;}\n"));
-            addedRulesCount = 0;
+        if (rule->isCssRule()) {
+            m_cssRules.append(rule);
+        }
+        else if (rule->isDocument()) {
+            m_documentIndex.add(rule);
+        }
+        else if (rule->isElemhide()) {
+            m_elemhideIndex.add(rule);
+        }
+        else if (rule->isException()) {
+            if (!network->exceptionTree.add(rule))
+                network->exceptionIndex.add(rule);
         }
         else {
-            rules.append(rule->cssSelector() + QLatin1Char(','));
-            addedRulesCount++;
+            if (!network->blockTree.add(rule))
+                network->blockIndex.add(rule);
         }
     }
 
-    if (addedRulesCount != 0) {
-        rules = rules.left(rules.size() - 1);
-        rules.append(QL1S("{display:none !important;}\n"));
+    network->blockTree.build();
+    network->exceptionTree.build();
+
+    m_networkRules = network;
+
+    updateCss();
+}
+
+AdBlockMatcher* AdBlockMatcher::clone() const
+{
+    return new AdBlockMatcher(*this);
+}
+
+void AdBlockMatcher::addRule(const AdBlockRule* rule)
+{
+    if (rule->isInternalDisabled())
+        return;
+
+    if (rule->isCssRule()) {
+        m_cssRules.append(rule);
+        updateCss();
+    }
+    else if (rule->isDocument()) {
+        m_documentIndex.add(rule);
     }
+    else if (rule->isElemhide()) {
+        m_elemhideIndex.add(rule);
+    }
+    else if (rule->isException()) {
+        m_addedExceptionRules.append(rule);
+    }
+    else {
+        m_addedBlockRules.append(rule);
+    }
+}
 
-    return rules;
+void AdBlockMatcher::removeRule(const AdBlockRule* rule)
+{
+    if (rule->isCssRule()) {
+        if (m_cssRules.removeOne(rule))
+            updateCss();
+    }
+    else if (rule->isDocument() || rule->isElemhide()) {
+        return;
+    }
+    else if (rule->isException()) {
+        m_addedExceptionRules.removeOne(rule);
+    }
+    else {
+        m_addedBlockRules.removeOne(rule);
+    }
 }
 
-void AdBlockMatcher::update()
+void AdBlockMatcher::updateRule(const AdBlockRule* rule)
 {
-    clear();
+    // Enabled state of other rules is checked on match
+    if (rule->isCssRule() && !rule->isInternalDisabled()) {
+        updateCss();
+    }
+}
+
+void AdBlockMatcher::updateCss()
+{
+    m_createdCssRules.clear();
+    m_domainRestrictedCssRules.clear();
+    m_cssDomainIndex.clear();
+    m_cssExcludedDomainIndex.clear();
+    m_cssExcludingIndexes.clear();
 
     QHash<QString, const AdBlockRule*> cssRulesHash;
     QVector<const AdBlockRule*> exceptionCssRules;
 
-    foreach (AdBlockSubscription* subscription, m_manager->subscriptions()) {
-        foreach (const AdBlockRule* rule, subscription->allRules()) {
-            // Don't add internally disabled rules to cache
-            if (rule->isInternalDisabled())
-                continue;
-
-            if (rule->isCssRule()) {
-                // We will add only enabled css rules to cache, because there is no enabled/disabled
-                // check on match. They are directly embedded to pages.
-                if (!rule->isEnabled())
-                    continue;
-
-                if (rule->isException())
-                    exceptionCssRules.append(rule);
-                else
-                    cssRulesHash.insert(rule->cssSelector(), rule);
-            }
-            else if (rule->isDocument()) {
-                m_documentRules.append(rule);
-            }
-            else if (rule->isElemhide()) {
-                m_elemhideRules.append(rule);
-            }
-            else if (rule->isException()) {
-                if (!m_networkExceptionTree.add(rule))
-                    m_networkExceptionRules.append(rule);
-            }
-            else {
-                if (!m_networkBlockTree.add(rule))
-                    m_networkBlockRules.append(rule);
-            }
-        }
+    foreach (const AdBlockRule* rule, m_cssRules) {
+        // We will add only enabled css rules to cache, because there is no enabled/disabled
+        // check on match. They are directly embedded to pages.
+        if (!rule->isEnabled())
+            continue;
+
+        if (rule->isException())
+            exceptionCssRules.append(rule);
+        else
+            cssRulesHash.insert(rule->cssSelector(), rule);
     }
 
     foreach (const AdBlockRule* rule, exceptionCssRules) {
@@ -168,16 +283,19 @@ void AdBlockMatcher::update()
 
         AdBlockRule* copiedRule = originalRule->copy();
         copiedRule->m_options |= AdBlockRule::DomainRestrictedOption;
-        copiedRule->m_blockedDomains.append(rule->m_allowedDomains);
+
+        if (rule->m_domains) {
+            if (!copiedRule->m_domains) {
+                copiedRule->m_domains = new AdBlockRule::Domains;
+            }
+            copiedRule->m_domains->blocked.append(rule->m_domains->allowed);
+        }
 
         cssRulesHash[rule->cssSelector()] = copiedRule;
-        m_createdRules.append(copiedRule);
+        m_createdCssRules.append(std::shared_ptr<AdBlockRule>(copiedRule));
     }
 
-    // Apparently, excessive amount of selectors for one CSS rule is not what WebKit likes.
-    // (In my testings, 4931 is the number that makes it crash)
-    // So let's split it by 1000 selectors...
-    int hidingRulesCount = 0;
+    QVector<const AdBlockRule*> elementHidingRules;
 
     QHashIterator<QString, const AdBlockRule*> it(cssRulesHash);
     while (it.hasNext()) {
@@ -187,33 +305,99 @@ void AdBlockMatcher::update()
         if (rule->isDomainRestricted()) {
             m_domainRestrictedCssRules.append(rule);
         }
-        else if (Q_UNLIKELY(hidingRulesCount == 1000)) {
-            m_elementHidingRules.append(rule->cssSelector());
-            m_elementHidingRules.append(QL1S("{display:none !important;} "));
-            hidingRulesCount = 0;
+        else {
+            elementHidingRules.append(rule);
+        }
+    }
+
+    m_elementHidingRules = createCss(elementHidingRules, QL1S("{display:none !important;} "));
+
+    // Index domain restricted rules by domains
+    QVector<const AdBlockRule*> excludingRules;
+
+    for (int i = 0; i < m_domainRestrictedCssRules.count(); ++i) {
+        const AdBlockRule* rule = m_domainRestrictedCssRules.at(i);
+
+        // Rule without domains is not enabled on any domain
+        if (!rule->m_domains) {
+            continue;
+        }
+
+        if (!rule->m_domains->allowed.isEmpty()) {
+            foreach (const QString &domain, rule->m_domains->allowed) {
+                m_cssDomainIndex[domain].append(i);
+            }
         }
         else {
-            m_elementHidingRules.append(rule->cssSelector() + QLatin1Char(','));
-            hidingRulesCount++;
+            foreach (const QString &domain, rule->m_domains->blocked) {
+                m_cssExcludedDomainIndex[domain].append(i);
+            }
+            m_cssExcludingIndexes.append(i);
+            excludingRules.append(rule);
         }
     }
 
-    if (hidingRulesCount != 0) {
-        m_elementHidingRules = m_elementHidingRules.left(m_elementHidingRules.size() - 1);
-        m_elementHidingRules.append(QL1S("{display:none !important;} "));
+    m_cssExcludingRules = createCss(excludingRules, QL1S("{display:none !important;}\n"));
+}
+
+QString AdBlockMatcher::createCss(const QVector<const AdBlockRule*> &rules, const QString &declaration)
+{
+    // Apparently, excessive amount of selectors for one CSS rule is not what WebKit likes.
+    // (In my testings, 4931 is the number that makes it crash)
+    // So let's split it by 1000 selectors...
+    QString css;
+    int addedRulesCount = 0;
+
+    foreach (const AdBlockRule* rule, rules) {
+        if (Q_UNLIKELY(addedRulesCount == 1000)) {
+            css.append(rule->cssSelector());
+            css.append(declaration);
+            addedRulesCount = 0;
+        }
+        else {
+            css.append(rule->cssSelector() + QLatin1Char(','));
+            addedRulesCount++;
+        }
+    }
+
+    if (addedRulesCount != 0) {
+        css = css.left(css.size() - 1);
+        css.append(declaration);
+    }
+
+    return css;
+}
+
+const AdBlockRule* AdBlockMatcher::findRule(const QVector<const AdBlockRule*> &rules, const AdBlockRequestContext &context)
+{
+    foreach (const AdBlockRule* rule, rules) {
+        if (rule->networkMatch(context)) {
+            return rule;
+        }
     }
+
+    return 0;
 }
 
 void AdBlockMatcher::clear()
 {
-    m_networkExceptionTree.clear();
-    m_networkExceptionRules.clear();
-    m_networkBlockTree.clear();
-    m_networkBlockRules.clear();
+    m_networkRules.reset(new NetworkRules);
+    m_addedBlockRules.clear();
+    m_addedExceptionRules.clear();
+    m_cssRules.clear();
     m_domainRestrictedCssRules.clear();
+    m_cssDomainIndex.clear();
+    m_cssExcludedDomainIndex.clear();
+    m_cssExcludingIndexes.clear();
+    m_cssExcludingRules.clear();
     m_elementHidingRules.clear();
-    m_documentRules.clear();
-    m_elemhideRules.clear();
-    qDeleteAll(m_createdRules);
+    m_documentIndex.clear();
+    m_elemhideIndex.clear();
+    m_createdCssRules.clear();
     m_createdRules.clear();
 }
+
+void AdBlockMatcher::adoptRules(const QVector<std::shared_ptr<AdBlockRule> > &rules)
+{
+    m_createdRules += rules;
+}
@@ -19,24 +19,31 @@
 #define ADBLOCKMATCHER_H
 
 #include <QUrl>
-#include <QObject>
+#include <QHash>
+#include <QVector>
+
+#include <memory>
 
 #include "qzcommon.h"
 #include "adblocksearchtree.h"
+#include "adblocktokenindex.h"
+#include "adblockcache.h"
 
-class QWebEngineUrlRequestInfo;
-
-class AdBlockManager;
+class AdBlockRequestContext;
 
-class QUPZILLA_EXPORT AdBlockMatcher : public QObject
+// Matcher is built once from all rules and then shared (read-only) between threads,
+// changes to rules are applied by building a new matcher.
+// Changes of single rules are applied to a clone of current matcher, which shares
+// the network rules with it and only keeps added rules in separate lists.
+class QUPZILLA_EXPORT AdBlockMatcher
 {
-    Q_OBJECT
-
 public:
-    explicit AdBlockMatcher(AdBlockManager* manager);
+    explicit AdBlockMatcher();
     ~AdBlockMatcher();
 
-    const AdBlockRule* match(const QWebEngineUrlRequestInfo &request, const QString &urlDomain, const QString &urlString) const;
+    const AdBlockRule* match(const AdBlockRequestContext &context) const;
+    // Same as match(), but decisions for recent requests are cached
+    const AdBlockRule* cachedMatch(const AdBlockRequestContext &context) const;
 
     bool adBlockDisabledForUrl(const QUrl &url) const;
     bool elemHideDisabledForUrl(const QUrl &url) const;
@@ -44,23 +51,91 @@ public:
     QString elementHidingRules() const;
     QString elementHidingRulesForDomain(const QString &domain) const;
 
-public slots:
-    void update();
+    // Hit rates of decision and first-party verdict caches
+    QString cacheStatistics() const;
+
+    // Rules must be in the order of subscriptions
+    void update(const QVector<AdBlockRule*> &rules);
     void clear();
 
+    // Matcher with the same rules, it must be changed only before it is shared
+    AdBlockMatcher* clone() const;
+
+    void addRule(const AdBlockRule* rule);
+    // Rules can't be removed from shared trees and indexes, removed rule must be disabled
+    void removeRule(const AdBlockRule* rule);
+    // Enabled state of rule was changed
+    void updateRule(const AdBlockRule* rule);
+
+    // Shares ownership of rules, they will be deleted together with last matcher
+    void adoptRules(const QVector<std::shared_ptr<AdBlockRule> > &rules);
+
 private:
-    AdBlockManager* m_manager;
+    struct NetworkRules {
+        AdBlockSearchTree blockTree;
+        AdBlockSearchTree exceptionTree;
+        AdBlockTokenIndex blockIndex;
+        AdBlockTokenIndex exceptionIndex;
+    };
+
+    // Request matching depends only on these, first-party url matters only by its domain
+    struct RequestKey {
+        QString url;
+        QString firstPartyDomain;
+        int resourceType;
+
+        bool operator==(const RequestKey &other) const {
+            return resourceType == other.resourceType && url == other.url && firstPartyDomain == other.firstPartyDomain;
+        }
+
+        friend uint qHash(const RequestKey &key) {
+            return qHash(key.url) ^ qHash(key.firstPartyDomain) ^ uint(key.resourceType);
+        }
+    };
 
-    QVector<AdBlockRule*> m_createdRules;
-    QVector<const AdBlockRule*> m_networkExceptionRules;
-    QVector<const AdBlockRule*> m_networkBlockRules;
+    struct Verdict {
+        bool adBlockDisabled;
+        bool elemHideDisabled;
+    };
+
+    // Caches are not copied, clone starts with empty caches
+    AdBlockMatcher(const AdBlockMatcher &other) = default;
+    AdBlockMatcher &operator=(const AdBlockMatcher &other) = delete;
+
+    Verdict verdict(const QUrl &url) const;
+
+    void updateCss();
+
+    static const AdBlockRule* findRule(const QVector<const AdBlockRule*> &rules, const AdBlockRequestContext &context);
+    static QString createCss(const QVector<const AdBlockRule*> &rules, const QString &declaration);
+
+    QVector<std::shared_ptr<AdBlockRule> > m_createdRules;
+    QVector<std::shared_ptr<AdBlockRule> > m_createdCssRules;
+
+    // All css rules including disabled ones, in the order of subscriptions
+    QVector<const AdBlockRule*> m_cssRules;
     QVector<const AdBlockRule*> m_domainRestrictedCssRules;
-    QVector<const AdBlockRule*> m_documentRules;
-    QVector<const AdBlockRule*> m_elemhideRules;
+
+    // Indexes into m_domainRestrictedCssRules by domains the rules are enabled on.
+    // Rules enabled on all but some domains are indexed by the excluded domains.
+    QHash<QString, QVector<int> > m_cssDomainIndex;
+    QHash<QString, QVector<int> > m_cssExcludedDomainIndex;
+    QVector<int> m_cssExcludingIndexes;
+    QString m_cssExcludingRules;
+
+    // Exceptions are indexed by tokens like network rules, removed rules are
+    // disabled and never match
+    AdBlockTokenIndex m_documentIndex;
+    AdBlockTokenIndex m_elemhideIndex;
 
     QString m_elementHidingRules;
-    AdBlockSearchTree m_networkBlockTree;
-    AdBlockSearchTree m_networkExceptionTree;
+
+    std::shared_ptr<const NetworkRules> m_networkRules;
+    QVector<const AdBlockRule*> m_addedBlockRules;
+    QVector<const AdBlockRule*> m_addedExceptionRules;
+
+    AdBlockCache<RequestKey, const AdBlockRule*> m_decisionCache;
+    AdBlockCache<QUrl, Verdict> m_verdictCache;
 };
 
 #endif // ADBLOCKMATCHER_H
@@ -0,0 +1,233 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "adblockprefilter.h"
+
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ADBLOCK_PREFILTER_X86
+#define ADBLOCK_TARGET_SSE2 __attribute__((target("sse2")))
+#define ADBLOCK_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ADBLOCK_PREFILTER_X86
+#define ADBLOCK_TARGET_SSE2
+#define ADBLOCK_TARGET_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// Fingerprint of literal is made from its first 3 characters
+static const int fingerprintLength = 3;
+static const int bitmapSize = 65536 / 32;
+
+typedef void (*Kernel)(const quint32* bitmap, const ushort* string, int length, uchar* candidates);
+
+// All kernels must compute exactly the same hash, it is also used to fill the bitmap
+static inline quint16 fingerprint(ushort c0, ushort c1, ushort c2)
+{
+    return quint16((c0 << 10) ^ (c1 << 5) ^ c2);
+}
+
+static inline uchar testBit(const quint32* bitmap, quint16 hash)
+{
+    return (bitmap[hash >> 5] >> (hash & 31)) & 1;
+}
+
+// Checks positions from start, candidates before start are already set
+static void scalarKernel(const quint32* bitmap, const ushort* string, int length, uchar* candidates, int start)
+{
+    for (int i = start; i < length - 2; ++i) {
+        candidates[i] = testBit(bitmap, fingerprint(string[i], string[i + 1], string[i + 2]));
+    }
+}
+
+static void scalarKernel(const quint32* bitmap, const ushort* string, int length, uchar* candidates)
+{
+    scalarKernel(bitmap, string, length, candidates, 0);
+}
+
+#ifdef ADBLOCK_PREFILTER_X86
+ADBLOCK_TARGET_SSE2
+static void sse2Kernel(const quint32* bitmap, const ushort* string, int length, uchar* candidates)
+{
+    int i = 0;
+
+    // Hashes of 8 positions at once, characters up to i + 9 are read
+    for (; i + 10 <= length; i += 8) {
+        const __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(string + i));
+        const __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(string + i + 1));
+        const __m128i c2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(string + i + 2));
+
+        const __m128i hash = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi16(c0, 10), _mm_slli_epi16(c1, 5)), c2);
+
+        quint16 hashes[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hashes), hash);
+
+        for (int j = 0; j < 8; ++j) {
+            candidates[i + j] = testBit(bitmap, hashes[j]);
+        }
+    }
+
+    scalarKernel(bitmap, string, length, candidates, i);
+}
+
+ADBLOCK_TARGET_AVX2
+static void avx2Kernel(const quint32* bitmap, const ushort* string, int length, uchar* candidates)
+{
+    int i = 0;
+
+    const __m256i mask = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    // Hashes of 16 positions at once, characters up to i + 17 are read
+    for (; i + 18 <= length; i += 16) {
+        const __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(string + i));
+        const __m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(string + i + 1));
+        const __m256i c2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(string + i + 2));
+
+        const __m256i hash = _mm256_xor_si256(_mm256_xor_si256(_mm256_slli_epi16(c0, 10), _mm256_slli_epi16(c1, 5)), c2);
+
+        // Look up bits of 8 hashes with one gather
+        const __m256i hashLo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(hash));
+        const __m256i hashHi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(hash, 1));
+
+        const __m256i wordsLo = _mm256_i32gather_epi32(reinterpret_cast<const int*>(bitmap), _mm256_srli_epi32(hashLo, 5), 4);
+        const __m256i wordsHi = _mm256_i32gather_epi32(reinterpret_cast<const int*>(bitmap), _mm256_srli_epi32(hashHi, 5), 4);
+
+        const __m256i bitsLo = _mm256_and_si256(_mm256_srlv_epi32(wordsLo, _mm256_and_si256(hashLo, mask)), one);
+        const __m256i bitsHi = _mm256_and_si256(_mm256_srlv_epi32(wordsHi, _mm256_and_si256(hashHi, mask)), one);
+
+        // Pack works within 128-bit lanes, so lanes must be reordered afterwards
+        const __m256i bits16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(bitsLo, bitsHi), 0xD8);
+        const __m128i bits8 = _mm_packus_epi16(_mm256_castsi256_si128(bits16), _mm256_extracti128_si256(bits16, 1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates + i), bits8);
+    }
+
+    scalarKernel(bitmap, string, length, candidates, i);
+}
+
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // OS must save AVX registers
+    __cpuid(info, 1);
+    const bool osxsave = info[2] & (1 << 27);
+    const bool avx = info[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool cpuHasSse2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return info[3] & (1 << 26);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+#endif // ADBLOCK_PREFILTER_X86
+
+struct KernelInfo {
+    Kernel kernel;
+    const char* name;
+};
+
+static KernelInfo selectKernel()
+{
+#ifdef ADBLOCK_PREFILTER_X86
+    if (cpuHasAvx2()) {
+        KernelInfo info = { avx2Kernel, "avx2" };
+        return info;
+    }
+
+    if (cpuHasSse2()) {
+        KernelInfo info = { sse2Kernel, "sse2" };
+        return info;
+    }
+#endif
+
+    KernelInfo info = { scalarKernel, "scalar" };
+    return info;
+}
+
+static const KernelInfo &kernel()
+{
+    static const KernelInfo info = selectKernel();
+    return info;
+}
+
+AdBlockPrefilter::AdBlockPrefilter()
+    : m_acceptAll(false)
+{
+    m_bitmap.fill(0, bitmapSize);
+}
+
+void AdBlockPrefilter::clear()
+{
+    m_bitmap.fill(0, bitmapSize);
+    m_acceptAll = false;
+}
+
+void AdBlockPrefilter::add(const QStringRef &literal)
+{
+    // Short literals could start anywhere
+    if (literal.size() < fingerprintLength) {
+        m_acceptAll = true;
+        return;
+    }
+
+    const quint16 hash = fingerprint(literal.at(0).unicode(), literal.at(1).unicode(), literal.at(2).unicode());
+    m_bitmap[hash >> 5] |= 1u << (hash & 31);
+}
+
+void AdBlockPrefilter::findCandidates(const QChar* string, int length, uchar* candidates) const
+{
+    if (m_acceptAll) {
+        memset(candidates, 1, length);
+        return;
+    }
+
+    // Literals can't start at last positions
+    memset(candidates + qMax(0, length - (fingerprintLength - 1)), 0, qMin(length, fingerprintLength - 1));
+
+    kernel().kernel(m_bitmap.constData(), reinterpret_cast<const ushort*>(string), length, candidates);
+}
+
+const char* AdBlockPrefilter::kernelName()
+{
+    return kernel().name;
+}
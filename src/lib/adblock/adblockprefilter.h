@@ -0,0 +1,49 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef ADBLOCKPREFILTER_H
+#define ADBLOCKPREFILTER_H
+
+#include <QString>
+#include <QVector>
+
+#include "qzcommon.h"
+
+// Fast check where in a string any of many literals may start.
+// Every literal is represented by a hash of its first 3 characters in a 64K bit table,
+// so one pass over string skips most positions without looking at the literals.
+// The pass uses AVX2 or SSE2 kernel when available, selected at runtime by CPU.
+class QUPZILLA_EXPORT AdBlockPrefilter
+{
+public:
+    explicit AdBlockPrefilter();
+
+    void clear();
+    void add(const QStringRef &literal);
+
+    // Sets candidates[i] to non-zero if some literal may start at position i
+    void findCandidates(const QChar* string, int length, uchar* candidates) const;
+
+    // Name of kernel used on this CPU
+    static const char* kernelName();
+
+private:
+    QVector<quint32> m_bitmap;
+    bool m_acceptAll;
+};
+
+#endif // ADBLOCKPREFILTER_H
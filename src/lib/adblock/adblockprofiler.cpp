@@ -0,0 +1,212 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "adblockprofiler.h"
+#include "adblockrule.h"
+#include "adblocksubscription.h"
+
+#include <QMutex>
+#include <QPair>
+#include <QVector>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QThreadStorage>
+
+#include <memory>
+#include <algorithm>
+
+// Timer is more expensive than most rules, so only every 16th evaluation is timed
+static const int sampleInterval = 16;
+
+struct ThreadStatistics
+{
+    ThreadStatistics() : counter(0) { }
+
+    QMutex mutex;
+    QHash<const AdBlockRule*, AdBlockProfiler::RuleStatistics> rules;
+    int counter;
+};
+
+struct ThreadStatisticsRegistry
+{
+    QMutex mutex;
+    // Statistics are kept also after thread finished
+    QVector<std::shared_ptr<ThreadStatistics> > threads;
+};
+
+Q_GLOBAL_STATIC(ThreadStatisticsRegistry, qz_adblock_profiler_registry)
+
+static QThreadStorage<std::shared_ptr<ThreadStatistics> > s_threadStatistics;
+
+static ThreadStatistics* threadStatistics()
+{
+    if (!s_threadStatistics.hasLocalData()) {
+        std::shared_ptr<ThreadStatistics> statistics(new ThreadStatistics);
+
+        ThreadStatisticsRegistry* registry = qz_adblock_profiler_registry();
+        QMutexLocker locker(&registry->mutex);
+        registry->threads.append(statistics);
+
+        s_threadStatistics.setLocalData(statistics);
+    }
+
+    return s_threadStatistics.localData().get();
+}
+
+QAtomicInt AdBlockProfiler::s_enabled;
+QAtomicInt AdBlockProfiler::s_hasStatistics;
+
+qint64 AdBlockProfiler::RuleStatistics::averageNsecs() const
+{
+    return samples ? sampledNsecs / qint64(samples) : 0;
+}
+
+qint64 AdBlockProfiler::RuleStatistics::totalNsecs() const
+{
+    return averageNsecs() * qint64(evaluations);
+}
+
+void AdBlockProfiler::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled ? 1 : 0);
+}
+
+bool AdBlockProfiler::shouldSample()
+{
+    return threadStatistics()->counter++ % sampleInterval == 0;
+}
+
+void AdBlockProfiler::addEvaluation(const AdBlockRule* rule, bool matched, qint64 nsecs)
+{
+    ThreadStatistics* thread = threadStatistics();
+
+    // Only contended while statistics are collected
+    QMutexLocker locker(&thread->mutex);
+    RuleStatistics &statistics = thread->rules[rule];
+
+    ++statistics.evaluations;
+
+    if (matched) {
+        ++statistics.hits;
+    }
+
+    if (nsecs >= 0) {
+        ++statistics.samples;
+        statistics.sampledNsecs += nsecs;
+    }
+
+    // Set while thread is locked, so reset() can't clear it before clearing this evaluation
+    if (!s_hasStatistics.loadAcquire()) {
+        s_hasStatistics.storeRelease(1);
+    }
+}
+
+QHash<const AdBlockRule*, AdBlockProfiler::RuleStatistics> AdBlockProfiler::statistics()
+{
+    QHash<const AdBlockRule*, RuleStatistics> result;
+
+    ThreadStatisticsRegistry* registry = qz_adblock_profiler_registry();
+    QMutexLocker locker(&registry->mutex);
+
+    foreach (const std::shared_ptr<ThreadStatistics> &thread, registry->threads) {
+        QMutexLocker threadLocker(&thread->mutex);
+
+        QHashIterator<const AdBlockRule*, RuleStatistics> it(thread->rules);
+        while (it.hasNext()) {
+            it.next();
+            RuleStatistics &statistics = result[it.key()];
+            statistics.evaluations += it.value().evaluations;
+            statistics.hits += it.value().hits;
+            statistics.samples += it.value().samples;
+            statistics.sampledNsecs += it.value().sampledNsecs;
+        }
+    }
+
+    return result;
+}
+
+QByteArray AdBlockProfiler::toJson(const QList<AdBlockSubscription*> &subscriptions)
+{
+    const QHash<const AdBlockRule*, RuleStatistics> statistics = AdBlockProfiler::statistics();
+
+    typedef QPair<const AdBlockRule*, RuleStatistics> RulePair;
+    QVector<RulePair> rules;
+
+    // Only rules of subscriptions are valid, other rules may have been already deleted
+    foreach (AdBlockSubscription* subscription, subscriptions) {
+        foreach (const AdBlockRule* rule, subscription->allRules()) {
+            if (statistics.contains(rule)) {
+                rules.append(RulePair(rule, statistics.value(rule)));
+            }
+        }
+    }
+
+    std::sort(rules.begin(), rules.end(), [](const RulePair &a, const RulePair &b) {
+        return a.second.totalNsecs() > b.second.totalNsecs();
+    });
+
+    QJsonArray array;
+
+    foreach (const RulePair &pair, rules) {
+        QJsonObject object;
+        object.insert(QSL("filter"), pair.first->filter());
+        object.insert(QSL("subscription"), pair.first->subscription() ? pair.first->subscription()->title() : QString());
+        object.insert(QSL("slow"), pair.first->isSlow());
+        object.insert(QSL("evaluations"), double(pair.second.evaluations));
+        object.insert(QSL("hits"), double(pair.second.hits));
+        object.insert(QSL("samples"), double(pair.second.samples));
+        object.insert(QSL("averageNsecs"), double(pair.second.averageNsecs()));
+        object.insert(QSL("totalNsecs"), double(pair.second.totalNsecs()));
+        array.append(object);
+    }
+
+    QJsonObject root;
+    root.insert(QSL("sampleInterval"), sampleInterval);
+    root.insert(QSL("rules"), array);
+
+    return QJsonDocument(root).toJson();
+}
+
+void AdBlockProfiler::removeRule(const AdBlockRule* rule)
+{
+    // All rules are deleted on every subscription update, don't lock anything when not profiling
+    if (!s_hasStatistics.loadAcquire() || qz_adblock_profiler_registry.isDestroyed()) {
+        return;
+    }
+
+    ThreadStatisticsRegistry* registry = qz_adblock_profiler_registry();
+    QMutexLocker locker(&registry->mutex);
+
+    foreach (const std::shared_ptr<ThreadStatistics> &thread, registry->threads) {
+        QMutexLocker threadLocker(&thread->mutex);
+        thread->rules.remove(rule);
+    }
+}
+
+void AdBlockProfiler::reset()
+{
+    ThreadStatisticsRegistry* registry = qz_adblock_profiler_registry();
+    QMutexLocker locker(&registry->mutex);
+
+    s_hasStatistics.storeRelease(0);
+
+    foreach (const std::shared_ptr<ThreadStatistics> &thread, registry->threads) {
+        QMutexLocker threadLocker(&thread->mutex);
+        thread->rules.clear();
+    }
+}
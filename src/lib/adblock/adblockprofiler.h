@@ -0,0 +1,67 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef ADBLOCKPROFILER_H
+#define ADBLOCKPROFILER_H
+
+#include <QHash>
+#include <QList>
+#include <QAtomicInt>
+
+#include "qzcommon.h"
+
+class AdBlockRule;
+class AdBlockSubscription;
+
+// Counts evaluations and hits of network rules and times some of the evaluations.
+// Each thread has its own counters, they are only merged when statistics are requested.
+class QUPZILLA_EXPORT AdBlockProfiler
+{
+public:
+    struct RuleStatistics {
+        RuleStatistics() : evaluations(0), hits(0), samples(0), sampledNsecs(0) { }
+
+        quint64 evaluations;
+        quint64 hits;
+        quint64 samples;
+        qint64 sampledNsecs;
+
+        qint64 averageNsecs() const;
+        // Estimated time spent evaluating the rule
+        qint64 totalNsecs() const;
+    };
+
+    static bool isEnabled() { return s_enabled.load(); }
+    static void setEnabled(bool enabled);
+
+    // Only used while profiling is enabled
+    static bool shouldSample();
+    static void addEvaluation(const AdBlockRule* rule, bool matched, qint64 nsecs = -1);
+
+    static QHash<const AdBlockRule*, RuleStatistics> statistics();
+    static QByteArray toJson(const QList<AdBlockSubscription*> &subscriptions);
+
+    // Called when rule is deleted, does nothing if no statistics were collected
+    static void removeRule(const AdBlockRule* rule);
+    static void reset();
+
+private:
+    static QAtomicInt s_enabled;
+    static QAtomicInt s_hasStatistics;
+};
+
+#endif // ADBLOCKPROFILER_H
@@ -0,0 +1,122 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "adblockrequestcontext.h"
+
+static QString toSecondLevelDomain(const QUrl &url)
+{
+    const QString topLevelDomain = url.topLevelDomain();
+    const QString urlHost = url.host();
+
+    if (topLevelDomain.isEmpty() || urlHost.isEmpty()) {
+        return QString();
+    }
+
+    QString domain = urlHost.left(urlHost.size() - topLevelDomain.size());
+
+    if (domain.count(QL1C('.')) == 0) {
+        return urlHost;
+    }
+
+    while (domain.count(QL1C('.')) != 0) {
+        domain = domain.mid(domain.indexOf(QL1C('.')) + 1);
+    }
+
+    return domain + topLevelDomain;
+}
+
+AdBlockRequestContext::AdBlockRequestContext(const QWebEngineUrlRequestInfo &request)
+    : m_url(request.requestUrl())
+    , m_firstPartyUrl(request.firstPartyUrl())
+    , m_resourceType(request.resourceType())
+    , m_thirdParty(-1)
+{
+    init();
+}
+
+AdBlockRequestContext::AdBlockRequestContext(const QUrl &url, const QUrl &firstPartyUrl, QWebEngineUrlRequestInfo::ResourceType resourceType)
+    : m_url(url)
+    , m_firstPartyUrl(firstPartyUrl)
+    , m_resourceType(resourceType)
+    , m_thirdParty(-1)
+{
+    init();
+}
+
+QUrl AdBlockRequestContext::url() const
+{
+    return m_url;
+}
+
+QUrl AdBlockRequestContext::firstPartyUrl() const
+{
+    return m_firstPartyUrl;
+}
+
+QWebEngineUrlRequestInfo::ResourceType AdBlockRequestContext::resourceType() const
+{
+    return m_resourceType;
+}
+
+const QString &AdBlockRequestContext::urlString() const
+{
+    return m_urlString;
+}
+
+const QString &AdBlockRequestContext::encodedUrl() const
+{
+    if (m_encodedUrl.isNull()) {
+        m_encodedUrl = QString::fromLatin1(m_url.toEncoded());
+    }
+
+    return m_encodedUrl;
+}
+
+const QString &AdBlockRequestContext::domain() const
+{
+    return m_domain;
+}
+
+const QString &AdBlockRequestContext::scheme() const
+{
+    return m_scheme;
+}
+
+const QString &AdBlockRequestContext::firstPartyDomain() const
+{
+    return m_firstPartyDomain;
+}
+
+bool AdBlockRequestContext::isThirdParty() const
+{
+    if (m_thirdParty == -1) {
+        // Third-party matching should be performed on second-level domains
+        m_thirdParty = toSecondLevelDomain(m_firstPartyUrl) != toSecondLevelDomain(m_url);
+    }
+
+    return m_thirdParty;
+}
+
+void AdBlockRequestContext::init()
+{
+    // Encoded url is ASCII, so it can be lower-cased before converting to string
+    m_urlString = QString::fromLatin1(m_url.toEncoded().toLower());
+
+    m_domain = m_url.host().toLower();
+    m_scheme = m_url.scheme().toLower();
+    m_firstPartyDomain = m_firstPartyUrl.host();
+}
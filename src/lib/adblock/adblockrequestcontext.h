@@ -0,0 +1,67 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef ADBLOCKREQUESTCONTEXT_H
+#define ADBLOCKREQUESTCONTEXT_H
+
+#include <QUrl>
+#include <QString>
+#include <QWebEngineUrlRequestInfo>
+
+#include "qzcommon.h"
+
+// Everything rules need to know about request, normalized only once per request.
+// Rules are only reading from the context, so matching does not allocate.
+class QUPZILLA_EXPORT AdBlockRequestContext
+{
+public:
+    explicit AdBlockRequestContext(const QWebEngineUrlRequestInfo &request);
+    explicit AdBlockRequestContext(const QUrl &url, const QUrl &firstPartyUrl, QWebEngineUrlRequestInfo::ResourceType resourceType);
+
+    QUrl url() const;
+    QUrl firstPartyUrl() const;
+    QWebEngineUrlRequestInfo::ResourceType resourceType() const;
+
+    // Lower-cased encoded url
+    const QString &urlString() const;
+    // Encoded url with original case, needed by $match-case rules. Computed only when needed
+    const QString &encodedUrl() const;
+    // Lower-cased host of url
+    const QString &domain() const;
+    const QString &scheme() const;
+    const QString &firstPartyDomain() const;
+
+    // Third-party check needs public suffix lookup, so it is computed only when needed
+    bool isThirdParty() const;
+
+private:
+    void init();
+
+    QUrl m_url;
+    QUrl m_firstPartyUrl;
+    QWebEngineUrlRequestInfo::ResourceType m_resourceType;
+
+    QString m_urlString;
+    QString m_domain;
+    QString m_scheme;
+    QString m_firstPartyDomain;
+
+    mutable QString m_encodedUrl;
+    mutable int m_thirdParty;
+};
+
+#endif // ADBLOCKREQUESTCONTEXT_H
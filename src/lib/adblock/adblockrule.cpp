@@ -46,44 +46,31 @@
 
 #include "adblockrule.h"
 #include "adblocksubscription.h"
+#include "adblockrequestcontext.h"
+#include "adblockprofiler.h"
 #include "qztools.h"
 #include "qzregexp.h"
 
 #include <QUrl>
 #include <QString>
 #include <QStringList>
+#include <QDataStream>
+#include <QElapsedTimer>
 #include <QWebEnginePage>
 #include <QWebEngineUrlRequestInfo>
 
-static QString toSecondLevelDomain(const QUrl &url)
-{
-    const QString topLevelDomain = url.topLevelDomain();
-    const QString urlHost = url.host();
-
-    if (topLevelDomain.isEmpty() || urlHost.isEmpty()) {
-        return QString();
-    }
-
-    QString domain = urlHost.left(urlHost.size() - topLevelDomain.size());
-
-    if (domain.count(QL1C('.')) == 0) {
-        return urlHost;
-    }
-
-    while (domain.count(QL1C('.')) != 0) {
-        domain = domain.mid(domain.indexOf(QL1C('.')) + 1);
-    }
-
-    return domain + topLevelDomain;
-}
-
 AdBlockRule::AdBlockRule(const QString &filter, AdBlockSubscription* subscription)
     : m_subscription(subscription)
+    , m_matchStart(0)
+    , m_matchLength(0)
+    , m_options(0)
+    , m_exceptions(0)
     , m_type(StringContainsMatchRule)
-    , m_caseSensitivity(Qt::CaseInsensitive)
+    , m_caseSensitive(false)
     , m_isEnabled(true)
     , m_isException(false)
     , m_isInternalDisabled(false)
+    , m_domains(0)
     , m_regExp(0)
 {
     setFilter(filter);
@@ -91,6 +78,10 @@ AdBlockRule::AdBlockRule(const QString &filter, AdBlockSubscription* subscriptio
 
 AdBlockRule::~AdBlockRule()
 {
+    // Another rule may get the same address
+    AdBlockProfiler::removeRule(this);
+
+    delete m_domains;
     delete m_regExp;
 }
 
@@ -102,13 +93,16 @@ AdBlockRule* AdBlockRule::copy() const
     rule->m_options = m_options;
     rule->m_exceptions = m_exceptions;
     rule->m_filter = m_filter;
-    rule->m_matchString = m_matchString;
-    rule->m_caseSensitivity = m_caseSensitivity;
+    rule->m_matchStart = m_matchStart;
+    rule->m_matchLength = m_matchLength;
+    rule->m_caseSensitive = m_caseSensitive;
     rule->m_isEnabled = m_isEnabled;
     rule->m_isException = m_isException;
     rule->m_isInternalDisabled = m_isInternalDisabled;
-    rule->m_allowedDomains = m_allowedDomains;
-    rule->m_blockedDomains = m_blockedDomains;
+
+    if (m_domains) {
+        rule->m_domains = new Domains(*m_domains);
+    }
 
     if (m_regExp) {
         rule->m_regExp = new RegExp;
@@ -147,7 +141,7 @@ bool AdBlockRule::isCssRule() const
 
 QString AdBlockRule::cssSelector() const
 {
-    return m_matchString;
+    return matchString().toString();
 }
 
 bool AdBlockRule::isDocument() const
@@ -195,70 +189,87 @@ bool AdBlockRule::isInternalDisabled() const
     return m_isInternalDisabled;
 }
 
-bool AdBlockRule::urlMatch(const QUrl &url) const
+bool AdBlockRule::urlMatch(const AdBlockRequestContext &context) const
 {
-    if (!hasOption(DocumentOption) && !hasOption(ElementHideOption)) {
+    if (!m_isEnabled || (!hasOption(DocumentOption) && !hasOption(ElementHideOption))) {
         return false;
     }
 
+    // Case-sensitive rules must see the url with its original case
+    return stringMatch(context.domain(), m_caseSensitive ? context.encodedUrl() : context.urlString());
+}
 
-    const QString encodedUrl = url.toEncoded();
-    const QString domain = url.host();
+bool AdBlockRule::networkMatch(const AdBlockRequestContext &context) const
+{
+    if (Q_LIKELY(!AdBlockProfiler::isEnabled())) {
+        return matchRequest(context);
+    }
 
-    return stringMatch(domain, encodedUrl);
+    if (!AdBlockProfiler::shouldSample()) {
+        const bool matched = matchRequest(context);
+        AdBlockProfiler::addEvaluation(this, matched);
+        return matched;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const bool matched = matchRequest(context);
+    AdBlockProfiler::addEvaluation(this, matched, timer.nsecsElapsed());
+    return matched;
 }
 
-bool AdBlockRule::networkMatch(const QWebEngineUrlRequestInfo &request, const QString &domain, const QString &encodedUrl) const
+bool AdBlockRule::matchRequest(const AdBlockRequestContext &context) const
 {
     if (m_type == CssRule || !m_isEnabled || m_isInternalDisabled) {
         return false;
     }
 
-    bool matched = stringMatch(domain, encodedUrl);
+    bool matched = stringMatch(context.domain(), context.urlString());
 
     if (matched) {
         // Check domain restrictions
-        if (hasOption(DomainRestrictedOption) && !matchDomain(request.firstPartyUrl().host())) {
+        if (hasOption(DomainRestrictedOption) && !matchDomain(context.firstPartyDomain())) {
             return false;
         }
 
         // Check third-party restriction
-        if (hasOption(ThirdPartyOption) && !matchThirdParty(request)) {
+        if (hasOption(ThirdPartyOption) && !matchThirdParty(context)) {
             return false;
         }
 
         // Check object restrictions
-        if (hasOption(ObjectOption) && !matchObject(request)) {
+        if (hasOption(ObjectOption) && !matchObject(context)) {
             return false;
         }
 
         // Check subdocument restriction
-        if (hasOption(SubdocumentOption) && !matchSubdocument(request)) {
+        if (hasOption(SubdocumentOption) && !matchSubdocument(context)) {
             return false;
         }
 
         // Check xmlhttprequest restriction
-        if (hasOption(XMLHttpRequestOption) && !matchXmlHttpRequest(request)) {
+        if (hasOption(XMLHttpRequestOption) && !matchXmlHttpRequest(context)) {
             return false;
         }
 
         // Check image restriction
-        if (hasOption(ImageOption) && !matchImage(request)) {
+        if (hasOption(ImageOption) && !matchImage(context)) {
             return false;
         }
 
         // Check script restriction
-        if (hasOption(ScriptOption) && !matchScript(request)) {
+        if (hasOption(ScriptOption) && !matchScript(context)) {
             return false;
         }
 
         // Check stylesheet restriction
-        if (hasOption(StyleSheetOption) && !matchStyleSheet(request)) {
+        if (hasOption(StyleSheetOption) && !matchStyleSheet(context)) {
             return false;
         }
 
         // Check object-subrequest restriction
-        if (hasOption(ObjectSubrequestOption) && !matchObjectSubrequest(request)) {
+        if (hasOption(ObjectSubrequestOption) && !matchObjectSubrequest(context)) {
             return false;
         }
     }
@@ -276,15 +287,22 @@ bool AdBlockRule::matchDomain(const QString &domain) const
         return true;
     }
 
-    if (m_blockedDomains.isEmpty()) {
-        foreach (const QString &d, m_allowedDomains) {
+    if (!m_domains) {
+        return false;
+    }
+
+    const QStringList &allowedDomains = m_domains->allowed;
+    const QStringList &blockedDomains = m_domains->blocked;
+
+    if (blockedDomains.isEmpty()) {
+        foreach (const QString &d, allowedDomains) {
             if (isMatchingDomain(domain, d)) {
                 return true;
             }
         }
     }
-    else if (m_allowedDomains.isEmpty()) {
-        foreach (const QString &d, m_blockedDomains) {
+    else if (allowedDomains.isEmpty()) {
+        foreach (const QString &d, blockedDomains) {
             if (isMatchingDomain(domain, d)) {
                 return false;
             }
@@ -292,13 +310,13 @@ bool AdBlockRule::matchDomain(const QString &domain) const
         return true;
     }
     else {
-        foreach (const QString &d, m_blockedDomains) {
+        foreach (const QString &d, blockedDomains) {
             if (isMatchingDomain(domain, d)) {
                 return false;
             }
         }
 
-        foreach (const QString &d, m_allowedDomains) {
+        foreach (const QString &d, allowedDomains) {
             if (isMatchingDomain(domain, d)) {
                 return true;
             }
@@ -308,62 +326,58 @@ bool AdBlockRule::matchDomain(const QString &domain) const
     return false;
 }
 
-bool AdBlockRule::matchThirdParty(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchThirdParty(const AdBlockRequestContext &context) const
 {
-    // Third-party matching should be performed on second-level domains
-    const QString firstPartyHost = toSecondLevelDomain(request.firstPartyUrl());
-    const QString host = toSecondLevelDomain(request.requestUrl());
-
-    bool match = firstPartyHost != host;
+    bool match = context.isThirdParty();
 
     return hasException(ThirdPartyOption) ? !match : match;
 }
 
-bool AdBlockRule::matchObject(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchObject(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeObject;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeObject;
 
     return hasException(ObjectOption) ? !match : match;
 }
 
-bool AdBlockRule::matchSubdocument(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchSubdocument(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeSubFrame;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeSubFrame;
 
     return hasException(SubdocumentOption) ? !match : match;
 }
 
-bool AdBlockRule::matchXmlHttpRequest(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchXmlHttpRequest(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeXhr;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeXhr;
 
     return hasException(XMLHttpRequestOption) ? !match : match;
 }
 
-bool AdBlockRule::matchImage(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchImage(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeImage;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeImage;
 
     return hasException(ImageOption) ? !match : match;
 }
 
-bool AdBlockRule::matchScript(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchScript(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeScript;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeScript;
 
     return hasException(ScriptOption) ? !match : match;
 }
 
-bool AdBlockRule::matchStyleSheet(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchStyleSheet(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeStylesheet;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeStylesheet;
 
     return hasException(StyleSheetOption) ? !match : match;
 }
 
-bool AdBlockRule::matchObjectSubrequest(const QWebEngineUrlRequestInfo &request) const
+bool AdBlockRule::matchObjectSubrequest(const AdBlockRequestContext &context) const
 {
-    bool match = request.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeSubResource;
+    bool match = context.resourceType() == QWebEngineUrlRequestInfo::ResourceTypeSubResource;
 
     return hasException(ObjectSubrequestOption) ? !match : match;
 }
@@ -371,6 +385,8 @@ bool AdBlockRule::matchObjectSubrequest(const QWebEngineUrlRequestInfo &request)
 void AdBlockRule::parseFilter()
 {
     QString parsedLine = m_filter;
+    // Position of parsedLine in m_filter
+    int parsedStart = 0;
 
     // Empty rule or just comment
     if (m_filter.trimmed().isEmpty() || m_filter.startsWith(QL1C('!'))) {
@@ -394,7 +410,8 @@ void AdBlockRule::parseFilter()
         }
 
         m_isException = parsedLine.at(pos + 1) == QL1C('@');
-        m_matchString = parsedLine.mid(m_isException ? pos + 3 : pos + 2);
+        m_matchStart = m_isException ? pos + 3 : pos + 2;
+        m_matchLength = parsedLine.size() - m_matchStart;
 
         // CSS rule cannot have more options -> stop parsing
         return;
@@ -404,6 +421,7 @@ void AdBlockRule::parseFilter()
     if (parsedLine.startsWith(QL1S("@@"))) {
         m_isException = true;
         parsedLine = parsedLine.mid(2);
+        parsedStart += 2;
     }
 
     // Parse all options following $ char
@@ -418,7 +436,7 @@ void AdBlockRule::parseFilter()
                 ++handledOptions;
             }
             else if (option == QL1S("match-case")) {
-                m_caseSensitivity = Qt::CaseSensitive;
+                m_caseSensitive = true;
                 ++handledOptions;
             }
             else if (option.endsWith(QL1S("third-party"))) {
@@ -492,7 +510,7 @@ void AdBlockRule::parseFilter()
 
         m_type = RegExpMatchRule;
         m_regExp = new RegExp;
-        m_regExp->regExp = QzRegExp(parsedLine, m_caseSensitivity);
+        m_regExp->regExp = QzRegExp(parsedLine, caseSensitivity());
         m_regExp->matchers = createStringMatchers(parseRegExpFilter(parsedLine));
         return;
     }
@@ -500,6 +518,7 @@ void AdBlockRule::parseFilter()
     // Remove starting and ending wildcards (*)
     if (parsedLine.startsWith(QL1C('*'))) {
         parsedLine = parsedLine.mid(1);
+        parsedStart += 1;
     }
 
     if (parsedLine.endsWith(QL1C('*'))) {
@@ -512,7 +531,8 @@ void AdBlockRule::parseFilter()
         parsedLine = parsedLine.left(parsedLine.size() - 1);
 
         m_type = DomainMatchRule;
-        m_matchString = parsedLine;
+        m_matchStart = parsedStart + 2;
+        m_matchLength = parsedLine.size();
         return;
     }
 
@@ -521,7 +541,8 @@ void AdBlockRule::parseFilter()
         parsedLine = parsedLine.left(parsedLine.size() - 1);
 
         m_type = StringEndsMatchRule;
-        m_matchString = parsedLine;
+        m_matchStart = parsedStart;
+        m_matchLength = parsedLine.size();
         return;
     }
 
@@ -533,35 +554,39 @@ void AdBlockRule::parseFilter()
        ) {
         m_type = RegExpMatchRule;
         m_regExp = new RegExp;
-        m_regExp->regExp = QzRegExp(createRegExpFromFilter(parsedLine), m_caseSensitivity);
+        m_regExp->regExp = QzRegExp(createRegExpFromFilter(parsedLine), caseSensitivity());
         m_regExp->matchers = createStringMatchers(parseRegExpFilter(parsedLine));
         return;
     }
 
     // We haven't found anything that needs use of regexp, yay!
     m_type = StringContainsMatchRule;
-    m_matchString = parsedLine;
+    m_matchStart = parsedStart;
+    m_matchLength = parsedLine.size();
 }
 
 void AdBlockRule::parseDomains(const QString &domains, const QChar &separator)
 {
     QStringList domainsList = domains.split(separator, QString::SkipEmptyParts);
 
+    if (domainsList.isEmpty()) {
+        return;
+    }
+
+    if (!m_domains) {
+        m_domains = new Domains;
+    }
+
     foreach (const QString domain, domainsList) {
-        if (domain.isEmpty()) {
-            continue;
-        }
         if (domain.startsWith(QL1C('~'))) {
-            m_blockedDomains.append(domain.mid(1));
+            m_domains->blocked.append(domain.mid(1));
         }
         else {
-            m_allowedDomains.append(domain);
+            m_domains->allowed.append(domain);
         }
     }
 
-    if (!m_blockedDomains.isEmpty() || !m_allowedDomains.isEmpty()) {
-        setOption(DomainRestrictedOption);
-    }
+    setOption(DomainRestrictedOption);
 }
 
 bool AdBlockRule::filterIsOnlyDomain(const QString &filter) const
@@ -663,7 +688,7 @@ QList<QStringMatcher> AdBlockRule::createStringMatchers(const QStringList &filte
     matchers.reserve(filters.size());
 
     foreach (const QString &filter, filters) {
-        matchers.append(QStringMatcher(filter, m_caseSensitivity));
+        matchers.append(QStringMatcher(filter, caseSensitivity()));
     }
 
     return matchers;
@@ -672,13 +697,13 @@ QList<QStringMatcher> AdBlockRule::createStringMatchers(const QStringList &filte
 bool AdBlockRule::stringMatch(const QString &domain, const QString &encodedUrl) const
 {
     if (m_type == StringContainsMatchRule) {
-        return encodedUrl.contains(m_matchString, m_caseSensitivity);
+        return encodedUrl.contains(matchString(), caseSensitivity());
     }
     else if (m_type == DomainMatchRule) {
-        return isMatchingDomain(domain, m_matchString);
+        return isMatchingDomain(domain, matchString());
     }
     else if (m_type == StringEndsMatchRule) {
-        return encodedUrl.endsWith(m_matchString, m_caseSensitivity);
+        return encodedUrl.endsWith(matchString(), caseSensitivity());
     }
     else if (m_type == RegExpMatchRule) {
         if (!isMatchingRegExpStrings(encodedUrl)) {
@@ -695,6 +720,22 @@ bool AdBlockRule::isMatchingDomain(const QString &domain, const QString &filter)
     return QzTools::matchDomain(filter, domain);
 }
 
+bool AdBlockRule::isMatchingDomain(const QString &domain, const QStringRef &filter) const
+{
+    // Same as QzTools::matchDomain, without creating new string from filter
+    if (domain == filter) {
+        return true;
+    }
+
+    if (!domain.endsWith(filter)) {
+        return false;
+    }
+
+    int index = domain.indexOf(filter);
+
+    return index > 0 && domain[index - 1] == QL1C('.');
+}
+
 bool AdBlockRule::isMatchingRegExpStrings(const QString &url) const
 {
     Q_ASSERT(m_regExp);
@@ -734,6 +775,129 @@ QStringList AdBlockRule::parseRegExpFilter(const QString &filter) const
     return list;
 }
 
+QDataStream &operator <<(QDataStream &stream, const AdBlockRule &rule)
+{
+    stream << rule.m_filter;
+    stream << quint8(rule.m_type);
+    stream << rule.m_options;
+    stream << rule.m_exceptions;
+    stream << qint32(rule.m_matchStart);
+    stream << qint32(rule.m_matchLength);
+    stream << bool(rule.m_caseSensitive);
+    stream << bool(rule.m_isEnabled);
+    stream << bool(rule.m_isException);
+    stream << bool(rule.m_isInternalDisabled);
+    stream << bool(rule.m_domains);
+
+    if (rule.m_domains) {
+        stream << rule.m_domains->allowed;
+        stream << rule.m_domains->blocked;
+    }
+
+    stream << bool(rule.m_regExp);
+
+    if (rule.m_regExp) {
+        QStringList matchers;
+        foreach (const QStringMatcher &matcher, rule.m_regExp->matchers) {
+            matchers.append(matcher.pattern());
+        }
+
+        stream << rule.m_regExp->regExp.pattern();
+        stream << matchers;
+    }
+
+    return stream;
+}
+
+QDataStream &operator >>(QDataStream &stream, AdBlockRule &rule)
+{
+    qint32 matchStart;
+    qint32 matchLength;
+    bool caseSensitive;
+    bool isEnabled;
+    bool isException;
+    bool isInternalDisabled;
+    bool hasDomains;
+    bool hasRegExp;
+
+    stream >> rule.m_filter;
+    stream >> rule.m_type;
+    stream >> rule.m_options;
+    stream >> rule.m_exceptions;
+    stream >> matchStart;
+    stream >> matchLength;
+    stream >> caseSensitive;
+    stream >> isEnabled;
+    stream >> isException;
+    stream >> isInternalDisabled;
+    stream >> hasDomains;
+
+    rule.m_matchStart = matchStart;
+    rule.m_matchLength = matchLength;
+    rule.m_caseSensitive = caseSensitive;
+    rule.m_isEnabled = isEnabled;
+    rule.m_isException = isException;
+    rule.m_isInternalDisabled = isInternalDisabled;
+
+    delete rule.m_domains;
+    rule.m_domains = 0;
+
+    if (hasDomains) {
+        rule.m_domains = new AdBlockRule::Domains;
+        stream >> rule.m_domains->allowed;
+        stream >> rule.m_domains->blocked;
+    }
+
+    stream >> hasRegExp;
+
+    delete rule.m_regExp;
+    rule.m_regExp = 0;
+
+    if (hasRegExp) {
+        QString pattern;
+        QStringList matchers;
+        stream >> pattern;
+        stream >> matchers;
+
+        rule.m_regExp = new AdBlockRule::RegExp;
+        rule.m_regExp->regExp = QzRegExp(pattern, rule.caseSensitivity());
+        rule.m_regExp->matchers = rule.createStringMatchers(matchers);
+    }
+
+    return stream;
+}
+
+QStringRef AdBlockRule::matchString() const
+{
+    return m_filter.midRef(m_matchStart, m_matchLength);
+}
+
+Qt::CaseSensitivity AdBlockRule::caseSensitivity() const
+{
+    return m_caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+}
+
+void AdBlockRule::internDomains(QSet<QString> &pool)
+{
+    if (!m_domains) {
+        return;
+    }
+
+    QStringList* lists[] = { &m_domains->allowed, &m_domains->blocked };
+
+    for (QStringList* list : lists) {
+        for (int i = 0; i < list->count(); ++i) {
+            QSet<QString>::const_iterator it = pool.constFind(list->at(i));
+            if (it == pool.constEnd()) {
+                pool.insert(list->at(i));
+            }
+            else {
+                (*list)[i] = *it;
+            }
+        }
+    }
+}
+
 bool AdBlockRule::hasOption(const AdBlockRule::RuleOption &opt) const
 {
     return (m_options & opt);
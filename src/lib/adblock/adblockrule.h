@@ -47,6 +47,7 @@
 #define ADBLOCKRULE_H
 
 #include <QObject>
+#include <QSet>
 #include <QStringList>
 #include <QStringMatcher>
 
@@ -54,9 +55,9 @@
 #include "qzregexp.h"
 
 class QUrl;
-class QWebEngineUrlRequestInfo;
-
+class QDataStream;
 class AdBlockSubscription;
+class AdBlockRequestContext;
 
 class QUPZILLA_EXPORT AdBlockRule
 {
@@ -90,22 +91,27 @@ public:
     bool isSlow() const;
     bool isInternalDisabled() const;
 
-    bool urlMatch(const QUrl &url) const;
-    bool networkMatch(const QWebEngineUrlRequestInfo &request, const QString &domain, const QString &encodedUrl) const;
+    // Share equal domain strings between rules
+    void internDomains(QSet<QString> &pool);
+
+    // Match of document and elemhide exceptions
+    bool urlMatch(const AdBlockRequestContext &context) const;
+    bool networkMatch(const AdBlockRequestContext &context) const;
 
     bool matchDomain(const QString &domain) const;
-    bool matchThirdParty(const QWebEngineUrlRequestInfo &request) const;
-    bool matchObject(const QWebEngineUrlRequestInfo &request) const;
-    bool matchSubdocument(const QWebEngineUrlRequestInfo &request) const;
-    bool matchXmlHttpRequest(const QWebEngineUrlRequestInfo &request) const;
-    bool matchImage(const QWebEngineUrlRequestInfo &request) const;
-    bool matchScript(const QWebEngineUrlRequestInfo &request) const;
-    bool matchStyleSheet(const QWebEngineUrlRequestInfo &request) const;
-    bool matchObjectSubrequest(const QWebEngineUrlRequestInfo &request) const;
+    bool matchThirdParty(const AdBlockRequestContext &context) const;
+    bool matchObject(const AdBlockRequestContext &context) const;
+    bool matchSubdocument(const AdBlockRequestContext &context) const;
+    bool matchXmlHttpRequest(const AdBlockRequestContext &context) const;
+    bool matchImage(const AdBlockRequestContext &context) const;
+    bool matchScript(const AdBlockRequestContext &context) const;
+    bool matchStyleSheet(const AdBlockRequestContext &context) const;
+    bool matchObjectSubrequest(const AdBlockRequestContext &context) const;
 
 protected:
     bool stringMatch(const QString &domain, const QString &encodedUrl) const;
     bool isMatchingDomain(const QString &domain, const QString &filter) const;
+    bool isMatchingDomain(const QString &domain, const QStringRef &filter) const;
     bool isMatchingRegExpStrings(const QString &url) const;
     QStringList parseRegExpFilter(const QString &filter) const;
 
@@ -135,14 +141,15 @@ private:
         ElementHideOption = 2048
     };
 
-    Q_DECLARE_FLAGS(RuleOptions, RuleOption)
-
     inline bool hasOption(const RuleOption &opt) const;
     inline bool hasException(const RuleOption &opt) const;
 
     inline void setOption(const RuleOption &opt);
     inline void setException(const RuleOption &opt, bool on);
 
+    // Network match without profiling
+    bool matchRequest(const AdBlockRequestContext &context) const;
+
     void parseFilter();
     void parseDomains(const QString &domains, const QChar &separator);
     bool filterIsOnlyDomain(const QString &filter) const;
@@ -150,25 +157,33 @@ private:
     QString createRegExpFromFilter(const QString &filter) const;
     QList<QStringMatcher> createStringMatchers(const QStringList &filters) const;
 
-    AdBlockSubscription* m_subscription;
+    // Parsed rule for string matching (CSS Selector for CSS rules)
+    QStringRef matchString() const;
+    inline Qt::CaseSensitivity caseSensitivity() const;
 
-    RuleType m_type;
-    RuleOptions m_options;
-    RuleOptions m_exceptions;
+    AdBlockSubscription* m_subscription;
 
     // Original rule filter
     QString m_filter;
-    // Parsed rule for string matching (CSS Selector for CSS rules)
-    QString m_matchString;
-    // Case sensitivity for string matching
-    Qt::CaseSensitivity m_caseSensitivity;
 
-    bool m_isEnabled;
-    bool m_isException;
-    bool m_isInternalDisabled;
+    // Match string is always part of original filter, so only its position is stored
+    int m_matchStart;
+    int m_matchLength;
+
+    // Type and options are packed, there are tens of thousands of rules loaded
+    quint16 m_options;
+    quint16 m_exceptions;
+    quint8 m_type;
 
-    QStringList m_allowedDomains;
-    QStringList m_blockedDomains;
+    bool m_caseSensitive : 1;
+    bool m_isEnabled : 1;
+    bool m_isException : 1;
+    bool m_isInternalDisabled : 1;
+
+    struct Domains {
+        QStringList allowed;
+        QStringList blocked;
+    };
 
     struct RegExp {
         QzRegExp regExp;
@@ -176,10 +191,15 @@ private:
     };
 
     // Use dynamic allocation to save memory
+    Domains* m_domains;
     RegExp* m_regExp;
 
+    friend QUPZILLA_EXPORT QDataStream &operator<<(QDataStream &stream, const AdBlockRule &rule);
+    friend QUPZILLA_EXPORT QDataStream &operator>>(QDataStream &stream, AdBlockRule &rule);
+
     friend class AdBlockMatcher;
     friend class AdBlockSearchTree;
+    friend class AdBlockTokenIndex;
     friend class AdBlockSubscription;
 };
 
@@ -0,0 +1,455 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "adblockrulesmodel.h"
+#include "adblocksubscription.h"
+#include "adblockrule.h"
+
+#include <QFont>
+#include <QColor>
+#include <QStringMatcher>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <algorithm>
+
+// Internal id of indexes, rules are children of subscription item
+static const quintptr SubscriptionItem = 0;
+static const quintptr RuleItem = 1;
+
+AdBlockRulesModel::AdBlockRulesModel(AdBlockSubscription* subscription, QObject* parent)
+    : QAbstractItemModel(parent)
+    , m_subscription(subscription)
+    , m_filtered(false)
+    , m_searchIndexValid(false)
+    , m_searchIndexOutdated(false)
+    , m_searchIndexWatcher(new QFutureWatcher<SearchIndex>(this))
+    , m_searchPending(false)
+    , m_searchWatcher(new QFutureWatcher<QVector<int> >(this))
+{
+    connect(m_subscription, SIGNAL(ruleChanged(const AdBlockRule*)), this, SLOT(ruleChanged(const AdBlockRule*)));
+    connect(m_subscription, SIGNAL(ruleAdded(const AdBlockRule*)), this, SLOT(rulesChanged()));
+    connect(m_subscription, SIGNAL(ruleRemoved(const AdBlockRule*)), this, SLOT(rulesChanged()));
+    connect(m_searchIndexWatcher, SIGNAL(finished()), this, SLOT(searchIndexBuilt()));
+    connect(m_searchWatcher, SIGNAL(finished()), this, SLOT(searchFinished()));
+}
+
+AdBlockRulesModel::~AdBlockRulesModel()
+{
+    m_searchIndexWatcher->waitForFinished();
+    m_searchWatcher->waitForFinished();
+}
+
+AdBlockSubscription* AdBlockRulesModel::subscription() const
+{
+    return m_subscription;
+}
+
+void AdBlockRulesModel::setStatus(const QString &status)
+{
+    m_status = status;
+
+    const QModelIndex index = subscriptionIndex();
+    emit dataChanged(index, index);
+}
+
+void AdBlockRulesModel::setFilterString(const QString &string)
+{
+    m_filterString = string.toLower();
+
+    if (m_filterString.isEmpty()) {
+        if (m_filtered) {
+            beginResetModel();
+            m_filtered = false;
+            m_visibleOffsets.clear();
+            endResetModel();
+        }
+        return;
+    }
+
+    // Search index is built only when it is first needed
+    if (!m_searchIndexValid) {
+        invalidateSearchIndex();
+        return;
+    }
+
+    startSearch();
+}
+
+QModelIndex AdBlockRulesModel::subscriptionIndex() const
+{
+    return createIndex(0, 0, SubscriptionItem);
+}
+
+QModelIndex AdBlockRulesModel::ruleIndex(const AdBlockRule* rule) const
+{
+    const int offset = m_subscription->allRules().indexOf(const_cast<AdBlockRule*>(rule));
+
+    if (offset < 0) {
+        return QModelIndex();
+    }
+
+    if (!m_filtered) {
+        return createIndex(offset, 0, RuleItem);
+    }
+
+    const QVector<int>::const_iterator it = std::lower_bound(m_visibleOffsets.constBegin(), m_visibleOffsets.constEnd(), offset);
+
+    if (it == m_visibleOffsets.constEnd() || *it != offset) {
+        return QModelIndex();
+    }
+
+    return createIndex(it - m_visibleOffsets.constBegin(), 0, RuleItem);
+}
+
+int AdBlockRulesModel::ruleOffset(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.internalId() != RuleItem) {
+        return -1;
+    }
+
+    return m_filtered ? m_visibleOffsets.value(index.row(), -1) : index.row();
+}
+
+void AdBlockRulesModel::setRulesEnabled(const QModelIndexList &indexes, bool enabled)
+{
+    QVector<int> offsets;
+    int firstRow = -1;
+    int lastRow = -1;
+
+    foreach (const QModelIndex &index, indexes) {
+        const int offset = ruleOffset(index);
+        if (offset < 0) {
+            continue;
+        }
+
+        offsets.append(offset);
+        firstRow = firstRow < 0 ? index.row() : qMin(firstRow, index.row());
+        lastRow = qMax(lastRow, index.row());
+    }
+
+    if (offsets.isEmpty()) {
+        return;
+    }
+
+    m_subscription->setRulesEnabled(offsets, enabled);
+
+    // One change for all rows, view repaints them at once
+    emit dataChanged(createIndex(firstRow, 0, RuleItem), createIndex(lastRow, 0, RuleItem));
+}
+
+Qt::ItemFlags AdBlockRulesModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return Qt::NoItemFlags;
+    }
+
+    Qt::ItemFlags flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+
+    const AdBlockRule* rule = this->rule(index);
+    if (!rule) {
+        return flags;
+    }
+
+    if (rule->isEnabled() || !rule->isComment()) {
+        flags |= Qt::ItemIsUserCheckable;
+    }
+
+    if (m_subscription->canEditRules()) {
+        flags |= Qt::ItemIsEditable;
+    }
+
+    return flags;
+}
+
+QVariant AdBlockRulesModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    if (index.internalId() == SubscriptionItem) {
+        switch (role) {
+        case Qt::DisplayRole:
+            return m_status.isEmpty() ? m_subscription->title() : m_status;
+
+        case Qt::FontRole: {
+            QFont font;
+            font.setBold(true);
+            return font;
+        }
+
+        default:
+            return QVariant();
+        }
+    }
+
+    const AdBlockRule* rule = this->rule(index);
+    if (!rule) {
+        return QVariant();
+    }
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return rule->filter();
+
+    case Qt::CheckStateRole:
+        if (!rule->isEnabled() && rule->isComment()) {
+            return QVariant();
+        }
+        return rule->isEnabled() ? Qt::Checked : Qt::Unchecked;
+
+    case Qt::ForegroundRole:
+        if (!rule->isEnabled()) {
+            return QColor(Qt::gray);
+        }
+        if (rule->isException()) {
+            return QColor(Qt::darkGreen);
+        }
+        if (rule->isCssRule()) {
+            return QColor(Qt::darkBlue);
+        }
+        return QVariant();
+
+    case Qt::FontRole:
+        if (!rule->isEnabled() && !rule->isComment()) {
+            QFont font;
+            font.setItalic(true);
+            return font;
+        }
+        return QVariant();
+
+    default:
+        return QVariant();
+    }
+}
+
+bool AdBlockRulesModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    const int offset = ruleOffset(index);
+    const AdBlockRule* rule = m_subscription->rule(offset);
+
+    if (!rule) {
+        return false;
+    }
+
+    if (role == Qt::CheckStateRole) {
+        if (value.toInt() == Qt::Checked) {
+            m_subscription->enableRule(offset);
+        }
+        else {
+            m_subscription->disableRule(offset);
+        }
+        return true;
+    }
+
+    if (role == Qt::EditRole && m_subscription->canEditRules()) {
+        const QString filter = value.toString();
+
+        if (filter != rule->filter()) {
+            m_subscription->replaceRule(new AdBlockRule(filter, m_subscription), offset);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+int AdBlockRulesModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return 1;
+    }
+
+    if (parent.internalId() != SubscriptionItem) {
+        return 0;
+    }
+
+    return m_filtered ? m_visibleOffsets.count() : m_subscription->allRules().count();
+}
+
+int AdBlockRulesModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+
+    return 1;
+}
+
+QModelIndex AdBlockRulesModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() != RuleItem) {
+        return QModelIndex();
+    }
+
+    return subscriptionIndex();
+}
+
+QModelIndex AdBlockRulesModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent)) {
+        return QModelIndex();
+    }
+
+    return createIndex(row, column, parent.isValid() ? RuleItem : SubscriptionItem);
+}
+
+AdBlockRulesModel::SearchIndex AdBlockRulesModel::buildSearchIndex(const QVector<QString> &filters)
+{
+    SearchIndex index;
+    index.starts.reserve(filters.count());
+
+    int size = 0;
+    foreach (const QString &filter, filters) {
+        size += filter.size() + 1;
+    }
+    index.text.reserve(size);
+
+    foreach (const QString &filter, filters) {
+        index.starts.append(index.text.size());
+        index.text.append(filter.toLower());
+        // Filter string can't contain new line, so matches never span two rules
+        index.text.append(QL1C('\n'));
+    }
+
+    return index;
+}
+
+QVector<int> AdBlockRulesModel::search(const SearchIndex &index, const QString &string)
+{
+    QVector<int> offsets;
+    const QStringMatcher matcher(string, Qt::CaseSensitive);
+
+    int pos = matcher.indexIn(index.text);
+
+    while (pos >= 0) {
+        const int offset = std::upper_bound(index.starts.constBegin(), index.starts.constEnd(), pos) - index.starts.constBegin() - 1;
+        offsets.append(offset);
+
+        // Continue with next rule
+        if (offset + 1 >= index.starts.count()) {
+            break;
+        }
+        pos = matcher.indexIn(index.text, index.starts.at(offset + 1));
+    }
+
+    return offsets;
+}
+
+void AdBlockRulesModel::refresh()
+{
+    beginResetModel();
+    m_filtered = false;
+    m_visibleOffsets.clear();
+    endResetModel();
+
+    if (m_searchIndexValid || m_searchIndexWatcher->isRunning() || !m_filterString.isEmpty()) {
+        invalidateSearchIndex();
+    }
+}
+
+void AdBlockRulesModel::ruleChanged(const AdBlockRule* rule)
+{
+    const QModelIndex index = ruleIndex(rule);
+
+    if (index.isValid()) {
+        emit dataChanged(index, index);
+    }
+}
+
+void AdBlockRulesModel::rulesChanged()
+{
+    refresh();
+}
+
+void AdBlockRulesModel::searchIndexBuilt()
+{
+    // Rules were changed while building
+    if (m_searchIndexOutdated) {
+        invalidateSearchIndex();
+        return;
+    }
+
+    m_searchIndex = m_searchIndexWatcher->result();
+    m_searchIndexValid = true;
+
+    if (!m_filterString.isEmpty()) {
+        startSearch();
+    }
+}
+
+void AdBlockRulesModel::searchFinished()
+{
+    // Filter string or rules were changed while searching
+    if (m_searchPending) {
+        m_searchPending = false;
+        startSearch();
+        return;
+    }
+
+    if (!m_searchIndexValid || m_searchString != m_filterString || m_filterString.isEmpty()) {
+        return;
+    }
+
+    beginResetModel();
+    m_filtered = true;
+    m_visibleOffsets = m_searchWatcher->result();
+    endResetModel();
+}
+
+const AdBlockRule* AdBlockRulesModel::rule(const QModelIndex &index) const
+{
+    return m_subscription->rule(ruleOffset(index));
+}
+
+void AdBlockRulesModel::invalidateSearchIndex()
+{
+    m_searchIndexValid = false;
+    m_searchIndex = SearchIndex();
+
+    if (m_searchIndexWatcher->isRunning()) {
+        m_searchIndexOutdated = true;
+        return;
+    }
+
+    m_searchIndexOutdated = false;
+
+    if (m_filterString.isEmpty()) {
+        return;
+    }
+
+    // Filters are implicitly shared, so copying them doesn't copy any text
+    QVector<QString> filters;
+    filters.reserve(m_subscription->allRules().count());
+
+    foreach (const AdBlockRule* rule, m_subscription->allRules()) {
+        filters.append(rule->filter());
+    }
+
+    m_searchIndexWatcher->setFuture(QtConcurrent::run(&AdBlockRulesModel::buildSearchIndex, filters));
+}
+
+void AdBlockRulesModel::startSearch()
+{
+    if (m_searchWatcher->isRunning()) {
+        m_searchPending = true;
+        return;
+    }
+
+    m_searchString = m_filterString;
+    m_searchWatcher->setFuture(QtConcurrent::run(&AdBlockRulesModel::search, m_searchIndex, m_searchString));
+}
@@ -0,0 +1,103 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef ADBLOCKRULESMODEL_H
+#define ADBLOCKRULESMODEL_H
+
+#include <QVector>
+#include <QAbstractItemModel>
+
+#include "qzcommon.h"
+
+template <typename T> class QFutureWatcher;
+
+class AdBlockRule;
+class AdBlockSubscription;
+
+// Rules of subscription are shown as children of one top-level item. Data are read from
+// rules only when view asks for them, so the model costs the same for any number of rules.
+class QUPZILLA_EXPORT AdBlockRulesModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    // Lower-cased filters of all rules in one string, for substring search
+    struct SearchIndex {
+        QString text;
+        QVector<int> starts;
+    };
+
+    explicit AdBlockRulesModel(AdBlockSubscription* subscription, QObject* parent = 0);
+    ~AdBlockRulesModel();
+
+    AdBlockSubscription* subscription() const;
+
+    void setStatus(const QString &status);
+    void setFilterString(const QString &string);
+
+    QModelIndex subscriptionIndex() const;
+    QModelIndex ruleIndex(const AdBlockRule* rule) const;
+    // Offset of rule in subscription, or -1
+    int ruleOffset(const QModelIndex &index) const;
+
+    void setRulesEnabled(const QModelIndexList &indexes, bool enabled);
+
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role);
+    int rowCount(const QModelIndex &parent) const;
+    int columnCount(const QModelIndex &parent) const;
+
+    QModelIndex parent(const QModelIndex &child) const;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+
+    static SearchIndex buildSearchIndex(const QVector<QString> &filters);
+    static QVector<int> search(const SearchIndex &index, const QString &string);
+
+public slots:
+    void refresh();
+
+private slots:
+    void ruleChanged(const AdBlockRule* rule);
+    void rulesChanged();
+    void searchIndexBuilt();
+    void searchFinished();
+
+private:
+    const AdBlockRule* rule(const QModelIndex &index) const;
+    void invalidateSearchIndex();
+    void startSearch();
+
+    AdBlockSubscription* m_subscription;
+    QString m_status;
+
+    // Rows shown while filter is active
+    bool m_filtered;
+    QVector<int> m_visibleOffsets;
+    QString m_filterString;
+
+    SearchIndex m_searchIndex;
+    bool m_searchIndexValid;
+    bool m_searchIndexOutdated;
+    QFutureWatcher<SearchIndex>* m_searchIndexWatcher;
+
+    QString m_searchString;
+    bool m_searchPending;
+    QFutureWatcher<QVector<int> >* m_searchWatcher;
+};
+
+#endif // ADBLOCKRULESMODEL_H
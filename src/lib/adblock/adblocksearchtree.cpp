@@ -17,23 +17,40 @@
 * ============================================================ */
 #include "adblocksearchtree.h"
 #include "adblockrule.h"
+#include "adblockrequestcontext.h"
 
-#include <QWebEngineUrlRequestInfo>
+#include <QVarLengthArray>
 
-AdBlockSearchTree::AdBlockSearchTree()
-    : m_root(new Node)
+#include <algorithm>
+
+// Encoded url is ASCII, so only ASCII characters are stored (as 1..128)
+static const int maxLabel = 128;
+
+static inline int labelOf(QChar c)
 {
+    const ushort code = c.unicode();
+    return code < maxLabel ? code + 1 : -1;
 }
 
-AdBlockSearchTree::~AdBlockSearchTree()
+static bool literalLessThan(const QPair<QStringRef, const AdBlockRule*> &a, const QPair<QStringRef, const AdBlockRule*> &b)
+{
+    return a.first < b.first;
+}
+
+AdBlockSearchTree::AdBlockSearchTree()
+    : m_nextCheckPos(1)
 {
-    deleteNode(m_root);
 }
 
 void AdBlockSearchTree::clear()
 {
-    deleteNode(m_root);
-    m_root = new Node;
+    m_literals.clear();
+    m_base.clear();
+    m_check.clear();
+    m_ruleIndexes.clear();
+    m_rules.clear();
+    m_nextCheckPos = 1;
+    m_prefilter.clear();
 }
 
 bool AdBlockSearchTree::add(const AdBlockRule* rule)
@@ -42,7 +59,7 @@ bool AdBlockSearchTree::add(const AdBlockRule* rule)
         return false;
     }
 
-    const QString filter = rule->m_matchString;
+    const QStringRef filter = rule->matchString();
     int len = filter.size();
 
     if (len <= 0) {
@@ -50,36 +67,76 @@ bool AdBlockSearchTree::add(const AdBlockRule* rule)
         return false;
     }
 
-    Node* node = m_root;
-
+    // Literal with non-ASCII character can never be found in encoded url
     for (int i = 0; i < len; ++i) {
-        const QChar c = filter.at(i);
-        Node *next = node->children.value(c);
-        if (!next) {
-            next = new Node;
-            next->c = c;
-            node->children[c] = next;
+        if (labelOf(filter.at(i)) < 0) {
+            return true;
         }
-        node = next;
     }
 
-    node->rule = rule;
+    m_literals.append(Literal(filter, rule));
+    m_prefilter.add(filter);
 
     return true;
 }
 
-const AdBlockRule* AdBlockSearchTree::find(const QWebEngineUrlRequestInfo &request, const QString &domain, const QString &urlString) const
+void AdBlockSearchTree::build()
 {
+    // Sorted literals with common prefix are next to each other. Stable sort keeps equal
+    // literals in order they were added, the last added rule is tried first.
+    std::stable_sort(m_literals.begin(), m_literals.end(), literalLessThan);
+
+    m_base = QVector<int>(2 * (maxLabel + 1), 0);
+    m_check = QVector<int>(2 * (maxLabel + 1), -1);
+    m_ruleIndexes = QVector<int>(2 * (maxLabel + 1), 0);
+    m_rules.clear();
+
+    // Root is state 0
+    m_check[0] = 0;
+    m_nextCheckPos = 1;
+
+    if (!m_literals.isEmpty()) {
+        buildState(0, 0, m_literals.count(), 0);
+    }
+
+    m_literals.clear();
+    m_literals.squeeze();
+
+    // Free slots at the end are not needed, lookup checks the bounds
+    int size = m_check.size();
+    while (size > 1 && m_check.at(size - 1) == -1) {
+        --size;
+    }
+
+    m_base.resize(size);
+    m_check.resize(size);
+    m_ruleIndexes.resize(size);
+    m_base.squeeze();
+    m_check.squeeze();
+    m_ruleIndexes.squeeze();
+    m_rules.squeeze();
+}
+
+const AdBlockRule* AdBlockSearchTree::find(const AdBlockRequestContext &context) const
+{
+    const QString &urlString = context.urlString();
     int len = urlString.size();
 
-    if (len <= 0) {
+    if (len <= 0 || m_check.isEmpty()) {
         return 0;
     }
 
     const QChar* string = urlString.constData();
 
+    QVarLengthArray<uchar, 1024> candidates(len);
+    m_prefilter.findCandidates(string, len, candidates.data());
+
     for (int i = 0; i < len; ++i) {
-        const AdBlockRule* rule = prefixSearch(request, domain, urlString, string++, len - i);
+        if (!candidates.at(i)) {
+            continue;
+        }
+
+        const AdBlockRule* rule = prefixSearch(context, string + i, len - i);
         if (rule) {
             return rule;
         }
@@ -88,50 +145,138 @@ const AdBlockRule* AdBlockSearchTree::find(const QWebEngineUrlRequestInfo &reque
     return 0;
 }
 
-const AdBlockRule* AdBlockSearchTree::prefixSearch(const QWebEngineUrlRequestInfo &request, const QString &domain, const QString &urlString, const QChar* string, int len) const
+const AdBlockRule* AdBlockSearchTree::prefixSearch(const AdBlockRequestContext &context, const QChar* string, int len) const
 {
-    if (len <= 0) {
-        return 0;
+    const int* base = m_base.constData();
+    const int* check = m_check.constData();
+    const int size = m_check.size();
+
+    int state = 0;
+
+    for (int i = 0; i < len; ++i) {
+        const int label = labelOf(string[i]);
+        if (label < 0) {
+            return 0;
+        }
+
+        const int next = base[state] + label;
+        if (next >= size || check[next] != state) {
+            return 0;
+        }
+
+        state = next;
+
+        const int ruleIndex = m_ruleIndexes.at(state);
+        if (!ruleIndex) {
+            continue;
+        }
+
+        for (const AdBlockRule* const* rule = m_rules.constData() + ruleIndex - 1; *rule; ++rule) {
+            if ((*rule)->networkMatch(context)) {
+                return *rule;
+            }
+        }
     }
 
-    QChar c = string[0];
+    return 0;
+}
+
+void AdBlockSearchTree::buildState(int state, int begin, int end, int depth)
+{
+    // Literals in range share prefix of length depth, the shortest are first
+    int i = begin;
 
-    Node* node = m_root->children.value(c);
-    if (!node) {
-        return nullptr;
+    while (i < end && m_literals.at(i).first.size() == depth) {
+        ++i;
     }
 
-    for (int i = 1; i < len; ++i) {
-        const QChar c = (++string)[0];
+    if (i > begin) {
+        m_ruleIndexes[state] = m_rules.count() + 1;
 
-        if (node->rule && node->rule->networkMatch(request, domain, urlString)) {
-            return node->rule;
+        for (int j = i - 1; j >= begin; --j) {
+            m_rules.append(m_literals.at(j).second);
         }
+        m_rules.append(0);
+    }
 
-        node = node->children.value(c);
-        if (!node) {
-            return nullptr;
+    QVector<int> labels;
+    QVector<int> starts;
+
+    for (int j = i; j < end; ++j) {
+        const int label = labelOf(m_literals.at(j).first.at(depth));
+
+        if (labels.isEmpty() || labels.last() != label) {
+            labels.append(label);
+            starts.append(j);
         }
     }
 
-    if (node->rule && node->rule->networkMatch(request, domain, urlString)) {
-        return node->rule;
+    if (labels.isEmpty()) {
+        return;
     }
 
-    return nullptr;
-}
+    starts.append(end);
 
-void AdBlockSearchTree::deleteNode(AdBlockSearchTree::Node* node)
-{
-    if (!node) {
-        return;
+    const int base = findBase(labels);
+    m_base[state] = base;
+
+    // All children must be placed before any of them looks for its own base
+    foreach (int label, labels) {
+        m_check[base + label] = state;
+    }
+
+    while (m_nextCheckPos < m_check.size() && m_check.at(m_nextCheckPos) != -1) {
+        ++m_nextCheckPos;
     }
 
-    QHashIterator<QChar, Node*> i(node->children);
-    while (i.hasNext()) {
-        i.next();
-        deleteNode(i.value());
+    for (int k = 0; k < labels.count(); ++k) {
+        buildState(base + labels.at(k), starts.at(k), starts.at(k + 1), depth + 1);
     }
+}
+
+int AdBlockSearchTree::findBase(const QVector<int> &labels)
+{
+    const int first = labels.first();
+    const int last = labels.last();
+
+    // First fit, starting at the first free slot
+    const int start = qMax(m_nextCheckPos, first + 1);
+    int occupied = 0;
+
+    for (int pos = start; ; ++pos) {
+        const int base = pos - first;
+
+        if (base + last >= m_check.size()) {
+            const int oldSize = m_check.size();
+            const int newSize = qMax(2 * oldSize, base + last + 1);
+
+            m_base.resize(newSize);
+            m_ruleIndexes.resize(newSize);
+            m_check.resize(newSize);
+            std::fill(m_check.begin() + oldSize, m_check.end(), -1);
+        }
+
+        if (m_check.at(pos) != -1) {
+            ++occupied;
+            continue;
+        }
+
+        bool fits = true;
 
-    delete node;
+        for (int k = 1; k < labels.count(); ++k) {
+            if (m_check.at(base + labels.at(k)) != -1) {
+                fits = false;
+                break;
+            }
+        }
+
+        if (fits) {
+            // Don't scan almost full part of the arrays again for every state,
+            // the few free slots left there are given up
+            if (occupied * 20 >= (pos - start + 1) * 19) {
+                m_nextCheckPos = pos;
+            }
+            return base;
+        }
+    }
 }
@@ -18,41 +18,54 @@
 #ifndef ADBLOCKSEARCHTREE_H
 #define ADBLOCKSEARCHTREE_H
 
-#include <QChar>
-#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
 
 #include "qzcommon.h"
+#include "adblockprefilter.h"
 
-class QWebEngineUrlRequestInfo;
+class AdBlockRequestContext;
 
 class AdBlockRule;
 
+// Trie of literals of "contains" rules, stored as double-array: child of state s with
+// character c is state t = base[s] + c, if check[t] == s. Rules are added first and
+// the arrays are built once with build(), then the tree is read-only.
+// All rules with the same literal are kept, so disabling one doesn't hide the others.
 class QUPZILLA_EXPORT AdBlockSearchTree
 {
 public:
     explicit AdBlockSearchTree();
-    ~AdBlockSearchTree();
 
     void clear();
 
     bool add(const AdBlockRule* rule);
-    const AdBlockRule* find(const QWebEngineUrlRequestInfo &request, const QString &domain, const QString &urlString) const;
+    void build();
+
+    const AdBlockRule* find(const AdBlockRequestContext &context) const;
 
 private:
-    struct Node {
-        QChar c;
-        const AdBlockRule* rule;
-        QHash<QChar, Node*> children;
+    typedef QPair<QStringRef, const AdBlockRule*> Literal;
+
+    const AdBlockRule* prefixSearch(const AdBlockRequestContext &context, const QChar* string, int len) const;
 
-        Node() : c(0) , rule(0) { }
-    };
+    void buildState(int state, int begin, int end, int depth);
+    int findBase(const QVector<int> &labels);
 
-    const AdBlockRule* prefixSearch(const QWebEngineUrlRequestInfo &request, const QString &domain,
-                                    const QString &urlString, const QChar* string, int len) const;
+    // Literals added since last build
+    QVector<Literal> m_literals;
 
-    void deleteNode(Node* node);
+    QVector<int> m_base;
+    QVector<int> m_check;
+    // Rules of state start at m_rules[m_ruleIndexes[state] - 1] and end with null,
+    // 0 means state has no rules
+    QVector<int> m_ruleIndexes;
+    QVector<const AdBlockRule*> m_rules;
+    int m_nextCheckPos;
 
-    Node* m_root;
+    // Positions where no rule can start are not searched
+    AdBlockPrefilter m_prefilter;
 };
 
 #endif // ADBLOCKSEARCHTREE_H
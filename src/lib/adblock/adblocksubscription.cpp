@@ -50,16 +50,161 @@
 #include "datapaths.h"
 #include "qztools.h"
 
+#include <QDir>
 #include <QFile>
 #include <QTimer>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
 #include <QNetworkReply>
+#include <QCryptographicHash>
+
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+
+// Cache of parsed rules, bump the version whenever AdBlockRule parsing or serialization changes
+static const quint32 cacheMagic = 0x5a514142;
+static const qint32 cacheVersion = 3;
+// Serialized rule with null filter and without domains and regexp
+static const int minCachedRuleSize = 23;
+
+// Cache is valid only for the exact contents of subscription file it was created from
+static QByteArray fileChecksum(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+    return hash.result();
+}
+
+static void writeCacheHeader(QDataStream &stream, const QByteArray &checksum)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << cacheMagic;
+    stream << cacheVersion;
+    stream << checksum;
+}
+
+static bool readCacheHeader(QDataStream &stream, const QByteArray &checksum)
+{
+    quint32 magic;
+    qint32 version;
+    QByteArray cachedChecksum;
+
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream >> magic;
+    stream >> version;
+
+    if (stream.status() != QDataStream::Ok || magic != cacheMagic || version != cacheVersion) {
+        return false;
+    }
+
+    stream >> cachedChecksum;
+
+    return stream.status() == QDataStream::Ok && !checksum.isEmpty() && cachedChecksum == checksum;
+}
+
+// Rules must be serialized before they are used by matcher
+static QByteArray serializeRules(const QVector<AdBlockRule*> &rules, const QByteArray &checksum)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    writeCacheHeader(stream, checksum);
+    stream << qint32(rules.count());
+
+    foreach (const AdBlockRule* rule, rules) {
+        stream << *rule;
+    }
+
+    return data;
+}
+
+// Runs on worker thread
+static void saveCache(const QString &cachePath, const QByteArray &data)
+{
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+
+    QSaveFile cacheFile(cachePath);
+    if (cacheFile.open(QFile::WriteOnly) && cacheFile.write(data) == data.size()) {
+        cacheFile.commit();
+    }
+}
+
+static QVector<AdBlockRule*> parseRulesChunk(const QStringList &lines, AdBlockSubscription* subscription)
+{
+    QVector<AdBlockRule*> rules;
+    rules.reserve(lines.count());
+
+    foreach (const QString &line, lines) {
+        rules.append(new AdBlockRule(line, subscription));
+    }
+
+    return rules;
+}
+
+// Runs on worker thread, chunk contains only complete lines
+static QVector<AdBlockRule*> parseDownloadedChunk(const QByteArray &data, AdBlockSubscription* subscription)
+{
+    const QStringList lines = QString::fromUtf8(data).split(QL1C('\n'));
+
+    QVector<AdBlockRule*> rules;
+    rules.reserve(lines.count());
+
+    foreach (QString line, lines) {
+        if (line.endsWith(QL1C('\r'))) {
+            line.chop(1);
+        }
+        rules.append(new AdBlockRule(line, subscription));
+    }
+
+    return rules;
+}
+
+// Runs on worker thread, waits until all chunks are parsed
+static QVector<AdBlockRule*> collectParsedRules(const QList<QFuture<QVector<AdBlockRule*> > > &futures, const QString &filePath, const QString &cachePath)
+{
+    QVector<AdBlockRule*> rules;
+
+    foreach (const QFuture<QVector<AdBlockRule*> > &future, futures) {
+        rules += future.result();
+    }
+
+    // Subscription file was replaced, so the cache is outdated
+    saveCache(cachePath, serializeRules(rules, fileChecksum(filePath)));
+
+    // Same domains are used in many rules, keep only one copy of each
+    QSet<QString> domainsPool;
+    foreach (AdBlockRule* rule, rules) {
+        rule->internDomains(domainsPool);
+    }
+
+    return rules;
+}
+
+static void deleteParsedRules(const QList<QFuture<QVector<AdBlockRule*> > > &futures)
+{
+    foreach (const QFuture<QVector<AdBlockRule*> > &future, futures) {
+        qDeleteAll(future.result());
+    }
+}
 
 AdBlockSubscription::AdBlockSubscription(const QString &title, QObject* parent)
     : QObject(parent)
     , m_reply(0)
+    , m_saveAfterLoading(false)
     , m_title(title)
+    , m_networkAccessManager(0)
     , m_updated(false)
+    , m_downloadFile(0)
+    , m_headerReceived(false)
+    , m_parseWatcher(new QFutureWatcher<QVector<AdBlockRule*> >(this))
 {
+    connect(m_parseWatcher, SIGNAL(finished()), this, SLOT(subscriptionParsed()));
 }
 
 QString AdBlockSubscription::title() const
@@ -87,22 +232,43 @@ void AdBlockSubscription::setUrl(const QUrl &url)
     m_url = url;
 }
 
-void AdBlockSubscription::loadSubscription(const QStringList &disabledRules)
+QNetworkAccessManager* AdBlockSubscription::networkAccessManager() const
+{
+    return m_networkAccessManager ? m_networkAccessManager : mApp->networkManager();
+}
+
+void AdBlockSubscription::setNetworkAccessManager(QNetworkAccessManager* networkAccessManager)
+{
+    m_networkAccessManager = networkAccessManager;
+}
+
+void AdBlockSubscription::loadSubscription(const QSet<QString> &disabledRules)
+{
+    QVector<AdBlockRule*> rules;
+    const bool valid = readRules(rules);
+
+    setRules(rules, valid, disabledRules);
+}
+
+bool AdBlockSubscription::readRules(QVector<AdBlockRule*> &rules)
 {
     QFile file(m_filePath);
 
     if (!file.exists()) {
-        QTimer::singleShot(0, this, SLOT(updateSubscription()));
-        return;
+        return false;
     }
 
     if (!file.open(QFile::ReadOnly)) {
         qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for reading" << m_filePath;
-        QTimer::singleShot(0, this, SLOT(updateSubscription()));
-        return;
+        return false;
     }
 
-    QTextStream textStream(&file);
+    // Whole file is read at once, so the checksum matches the parsed contents
+    const QByteArray data = file.readAll();
+    const QByteArray checksum = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+    file.close();
+
+    QTextStream textStream(data);
     textStream.setCodec("UTF-8");
     // Header is on 3rd line
     textStream.readLine(1024);
@@ -111,20 +277,49 @@ void AdBlockSubscription::loadSubscription(const QStringList &disabledRules)
 
     if (!header.startsWith(QLatin1String("[Adblock")) || m_title.isEmpty()) {
         qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "invalid format of adblock file" << m_filePath;
+        return false;
+    }
+
+    if (!loadCache(rules, checksum)) {
+        QStringList lines;
+        while (!textStream.atEnd()) {
+            lines.append(textStream.readLine());
+        }
+
+        rules = parseRules(lines);
+
+        // Parsed rules are serialized right away, only writing the file is done in background
+        QtConcurrent::run(saveCache, cacheFilePath(), serializeRules(rules, checksum));
+    }
+
+    // Same domains are used in many rules, keep only one copy of each
+    QSet<QString> domainsPool;
+    foreach (AdBlockRule* rule, rules) {
+        rule->internDomains(domainsPool);
+    }
+
+    return true;
+}
+
+void AdBlockSubscription::setRules(const QVector<AdBlockRule*> &rules, bool valid, const QSet<QString> &disabledRules)
+{
+    if (!valid) {
         QTimer::singleShot(0, this, SLOT(updateSubscription()));
         return;
     }
 
-    m_rules.clear();
-
-    while (!textStream.atEnd()) {
-        AdBlockRule* rule = new AdBlockRule(textStream.readLine(), this);
+    retireRules(m_rules);
+    m_rules = rules;
 
+    foreach (AdBlockRule* rule, m_rules) {
         if (disabledRules.contains(rule->filter())) {
             rule->setEnabled(false);
         }
+    }
 
-        m_rules.append(rule);
+    if (m_saveAfterLoading) {
+        m_saveAfterLoading = false;
+        saveSubscription();
     }
 
     // Initial update
@@ -137,62 +332,248 @@ void AdBlockSubscription::saveSubscription()
 {
 }
 
+QString AdBlockSubscription::cacheFilePath() const
+{
+    const QByteArray hash = QCryptographicHash::hash(QFileInfo(m_filePath).absoluteFilePath().toUtf8(), QCryptographicHash::Md5);
+    return DataPaths::path(DataPaths::Cache) + QL1S("/adblock/") + QString::fromLatin1(hash.toHex()) + QL1S(".cache");
+}
+
+QVector<AdBlockRule*> AdBlockSubscription::parseRules(const QStringList &lines)
+{
+    // Large subscriptions are split into chunks that are parsed on multiple threads
+    const int chunkSize = 5000;
+
+    if (lines.count() <= chunkSize) {
+        return parseRulesChunk(lines, this);
+    }
+
+    QList<QFuture<QVector<AdBlockRule*> > > futures;
+    for (int i = 0; i < lines.count(); i += chunkSize) {
+        futures.append(QtConcurrent::run(parseRulesChunk, lines.mid(i, chunkSize), this));
+    }
+
+    QVector<AdBlockRule*> rules;
+    rules.reserve(lines.count());
+
+    foreach (const QFuture<QVector<AdBlockRule*> > &future, futures) {
+        rules += future.result();
+    }
+
+    return rules;
+}
+
+bool AdBlockSubscription::loadCache(QVector<AdBlockRule*> &rules, const QByteArray &checksum)
+{
+    QFile file(cacheFilePath());
+
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const uchar* data = file.map(0, size);
+
+    if (!data) {
+        return false;
+    }
+
+    const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(size));
+    QDataStream stream(bytes);
+
+    if (!readCacheHeader(stream, checksum)) {
+        return false;
+    }
+
+    qint32 count;
+    stream >> count;
+
+    // Count from corrupted cache must not be trusted before reserving memory
+    const qint64 remaining = size - stream.device()->pos();
+
+    if (stream.status() != QDataStream::Ok || count < 0 || count > remaining / minCachedRuleSize) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Corrupted cache for" << m_filePath;
+        return false;
+    }
+
+    rules.reserve(count);
+
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        AdBlockRule* rule = new AdBlockRule(QString(), this);
+        stream >> *rule;
+        rules.append(rule);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Corrupted cache for" << m_filePath;
+        qDeleteAll(rules);
+        rules.clear();
+        return false;
+    }
+
+    return true;
+}
+
 void AdBlockSubscription::updateSubscription()
 {
-    if (m_reply || !m_url.isValid()) {
+    if (m_reply || m_parseWatcher->isRunning() || !m_url.isValid()) {
         return;
     }
 
-    m_reply = mApp->networkManager()->get(QNetworkRequest(m_url));
+    m_downloadFile = new QSaveFile(m_filePath);
+
+    if (!m_downloadFile->open(QFile::WriteOnly)) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for writing:" << m_filePath;
+        delete m_downloadFile;
+        m_downloadFile = 0;
+        return;
+    }
+
+    // Write subscription header
+    m_downloadFile->write(QString("Title: %1\nUrl: %2\n").arg(title(), url().toString()).toUtf8());
+
+    m_downloadBuffer.clear();
+    m_headerReceived = false;
+
+    m_reply = networkAccessManager()->get(QNetworkRequest(m_url));
+    connect(m_reply, &QNetworkReply::readyRead, this, &AdBlockSubscription::subscriptionDataReceived);
     connect(m_reply, &QNetworkReply::finished, this, &AdBlockSubscription::subscriptionDownloaded);
 }
 
+void AdBlockSubscription::subscriptionDataReceived()
+{
+    if (m_reply != qobject_cast<QNetworkReply*>(sender())) {
+        return;
+    }
+
+    // Until the header is checked, data is only buffered and written together with the header
+    const QByteArray data = m_reply->readAll();
+    if (m_headerReceived) {
+        m_downloadFile->write(data);
+    }
+    m_downloadBuffer.append(data);
+
+    // Not a subscription, don't download the rest
+    if (!parseDownloadedData(false)) {
+        m_reply->abort();
+    }
+}
+
 void AdBlockSubscription::subscriptionDownloaded()
 {
     if (m_reply != qobject_cast<QNetworkReply*>(sender())) {
         return;
     }
 
-    bool error = false;
-    const QByteArray response = QString::fromUtf8(m_reply->readAll()).toUtf8();
+    bool error = m_reply->error() != QNetworkReply::NoError;
+
+    if (!error) {
+        const QByteArray data = m_reply->readAll();
+        if (m_headerReceived) {
+            m_downloadFile->write(data);
+        }
+        m_downloadBuffer.append(data);
 
-    if (m_reply->error() != QNetworkReply::NoError ||
-        !response.startsWith(QByteArray("[Adblock")) ||
-        !saveDownloadedData(response)
-       ) {
-        error = true;
+        error = !parseDownloadedData(true) || !m_downloadFile->commit();
     }
 
     m_reply->deleteLater();
     m_reply = 0;
 
     if (error) {
+        cancelDownload();
         emit subscriptionError(tr("Cannot load subscription!"));
         return;
     }
 
-    loadSubscription(AdBlockManager::instance()->disabledRules());
+    delete m_downloadFile;
+    m_downloadFile = 0;
+
+    m_parseWatcher->setFuture(QtConcurrent::run(collectParsedRules, m_parseFutures, m_filePath, cacheFilePath()));
+    m_parseFutures.clear();
+}
+
+void AdBlockSubscription::subscriptionParsed()
+{
+    m_updated = true;
+    setRules(m_parseWatcher->result(), true, AdBlockManager::instance()->disabledRules());
 
     emit subscriptionUpdated();
     emit subscriptionChanged();
 }
 
-bool AdBlockSubscription::saveDownloadedData(const QByteArray &data)
+bool AdBlockSubscription::parseDownloadedData(bool finished)
 {
-    QFile file(m_filePath);
+    // Lines are parsed in chunks, so each worker thread has enough work
+    const int chunkSize = 256 * 1024;
 
-    if (!file.open(QFile::ReadWrite | QFile::Truncate)) {
-        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for writing:" << m_filePath;
-        return false;
+    if (!m_headerReceived) {
+        if (!m_downloadBuffer.contains('\n') && !finished) {
+            return true;
+        }
+
+        // Byte order mark is dropped, it would end up after the subscription header in the file
+        if (m_downloadBuffer.startsWith(QByteArray("\xEF\xBB\xBF"))) {
+            m_downloadBuffer.remove(0, 3);
+        }
+
+        if (!m_downloadBuffer.startsWith(QByteArray("[Adblock"))) {
+            return false;
+        }
+
+        m_downloadFile->write(m_downloadBuffer);
+
+        const int end = m_downloadBuffer.indexOf('\n');
+        m_downloadBuffer.remove(0, end < 0 ? m_downloadBuffer.size() : end + 1);
+        m_headerReceived = true;
     }
 
-    // Write subscription header
-    file.write(QString("Title: %1\nUrl: %2\n").arg(title(), url().toString()).toUtf8());
-    file.write(data);
-    file.close();
+    if (!finished && m_downloadBuffer.size() < chunkSize) {
+        return true;
+    }
+
+    int end = finished ? m_downloadBuffer.size() : m_downloadBuffer.lastIndexOf('\n');
+
+    // Last line ending doesn't start another rule
+    if (finished && m_downloadBuffer.endsWith('\n')) {
+        --end;
+    }
+
+    if (end > 0) {
+        m_parseFutures.append(QtConcurrent::run(parseDownloadedChunk, m_downloadBuffer.left(end), this));
+    }
+
+    m_downloadBuffer.remove(0, end + 1);
     return true;
 }
 
+void AdBlockSubscription::cancelDownload()
+{
+    if (m_downloadFile) {
+        m_downloadFile->cancelWriting();
+        delete m_downloadFile;
+        m_downloadFile = 0;
+    }
+
+    m_downloadBuffer.clear();
+
+    if (!m_parseFutures.isEmpty()) {
+        QtConcurrent::run(deleteParsedRules, m_parseFutures);
+        m_parseFutures.clear();
+    }
+}
+
+void AdBlockSubscription::retireRules(const QVector<AdBlockRule*> &rules)
+{
+    AdBlockManager* manager = qobject_cast<AdBlockManager*>(parent());
+
+    if (manager) {
+        manager->retireRules(rules);
+    }
+    else {
+        qDeleteAll(rules);
+    }
+}
+
 const AdBlockRule* AdBlockSubscription::rule(int offset) const
 {
     if (!QzTools::containsIndex(m_rules, offset)) {
@@ -217,10 +598,7 @@ const AdBlockRule* AdBlockSubscription::enableRule(int offset)
     rule->setEnabled(true);
     AdBlockManager::instance()->removeDisabledRule(rule->filter());
 
-    emit subscriptionChanged();
-
-    if (rule->isCssRule())
-        mApp->reloadUserStyleSheet();
+    emit ruleChanged(rule);
 
     return rule;
 }
@@ -235,14 +613,40 @@ const AdBlockRule* AdBlockSubscription::disableRule(int offset)
     rule->setEnabled(false);
     AdBlockManager::instance()->addDisabledRule(rule->filter());
 
-    emit subscriptionChanged();
-
-    if (rule->isCssRule())
-        mApp->reloadUserStyleSheet();
+    emit ruleChanged(rule);
 
     return rule;
 }
 
+void AdBlockSubscription::setRulesEnabled(const QVector<int> &offsets, bool enabled)
+{
+    if (offsets.count() == 1) {
+        if (enabled)
+            enableRule(offsets.at(0));
+        else
+            disableRule(offsets.at(0));
+        return;
+    }
+
+    AdBlockManager* manager = AdBlockManager::instance();
+
+    foreach (int offset, offsets) {
+        if (!QzTools::containsIndex(m_rules, offset)) {
+            continue;
+        }
+
+        AdBlockRule* rule = m_rules[offset];
+        rule->setEnabled(enabled);
+
+        if (enabled)
+            manager->removeDisabledRule(rule->filter());
+        else
+            manager->addDisabledRule(rule->filter());
+    }
+
+    emit subscriptionChanged();
+}
+
 bool AdBlockSubscription::canEditRules() const
 {
     return false;
@@ -274,7 +678,25 @@ const AdBlockRule* AdBlockSubscription::replaceRule(AdBlockRule* rule, int offse
 
 AdBlockSubscription::~AdBlockSubscription()
 {
-    qDeleteAll(m_rules);
+    if (m_reply) {
+        m_reply->disconnect(this);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = 0;
+    }
+
+    cancelDownload();
+
+    if (m_parseWatcher->isRunning()) {
+        m_parseWatcher->waitForFinished();
+        qDeleteAll(m_parseWatcher->result());
+    }
+
+    foreach (AdBlockRule* rule, m_rules) {
+        rule->setSubscription(0);
+    }
+
+    retireRules(m_rules);
 }
 
 // AdBlockCustomList
@@ -285,7 +707,7 @@ AdBlockCustomList::AdBlockCustomList(QObject* parent)
     setFilePath(DataPaths::currentProfilePath() + QLatin1String("/adblock/customlist.txt"));
 }
 
-void AdBlockCustomList::loadSubscription(const QStringList &disabledRules)
+bool AdBlockCustomList::readRules(QVector<AdBlockRule*> &rules)
 {
     // DuckDuckGo ad whitelist rules
     // They cannot be removed, but can be disabled.
@@ -294,26 +716,35 @@ void AdBlockCustomList::loadSubscription(const QStringList &disabledRules)
     const QString ddg1 = QSL("@@||duckduckgo.com^$document");
     const QString ddg2 = QSL("duckduckgo.com#@#.has-ad");
 
-    const QString rules = QzTools::readAllFileContents(filePath());
-
-    QFile file(filePath());
-    if (!file.exists()) {
-        saveSubscription();
+    // Missing file is created once the rules are set
+    if (QFile::exists(filePath()) && !AdBlockSubscription::readRules(rules)) {
+        return false;
     }
 
-    if (file.open(QFile::WriteOnly | QFile::Append)) {
-        QTextStream stream(&file);
-        stream.setCodec("UTF-8");
+    bool hasDdg1 = false;
+    bool hasDdg2 = false;
 
-        if (!rules.contains(ddg1 + QL1S("\n")))
-            stream << ddg1 << endl;
+    foreach (const AdBlockRule* rule, rules) {
+        if (rule->filter() == ddg1) {
+            hasDdg1 = true;
+        }
+        else if (rule->filter() == ddg2) {
+            hasDdg2 = true;
+        }
+    }
 
-        if (!rules.contains(QL1S("\n") + ddg2))
-            stream << ddg2 << endl;
+    if (!hasDdg1) {
+        rules.append(new AdBlockRule(ddg1, this));
     }
-    file.close();
 
-    AdBlockSubscription::loadSubscription(disabledRules);
+    if (!hasDdg2) {
+        rules.append(new AdBlockRule(ddg2, this));
+    }
+
+    // This may run on worker thread, file is written from setRules() on main thread
+    m_saveAfterLoading = !hasDdg1 || !hasDdg2;
+
+    return true;
 }
 
 void AdBlockCustomList::saveSubscription()
@@ -374,18 +805,20 @@ bool AdBlockCustomList::removeFilter(const QString &filter)
 
 int AdBlockCustomList::addRule(AdBlockRule* rule)
 {
-    m_rules.append(rule);
+    // Rules read on worker thread would replace the rules changed before loading finished
+    AdBlockManager::instance()->finishLoading();
 
-    emit subscriptionChanged();
+    m_rules.append(rule);
 
-    if (rule->isCssRule())
-        mApp->reloadUserStyleSheet();
+    emit ruleAdded(rule);
 
     return m_rules.count() - 1;
 }
 
 bool AdBlockCustomList::removeRule(int offset)
 {
+    AdBlockManager::instance()->finishLoading();
+
     if (!QzTools::containsIndex(m_rules, offset)) {
         return false;
     }
@@ -395,19 +828,20 @@ bool AdBlockCustomList::removeRule(int offset)
 
     m_rules.remove(offset);
 
-    emit subscriptionChanged();
-
-    if (rule->isCssRule())
-        mApp->reloadUserStyleSheet();
-
     AdBlockManager::instance()->removeDisabledRule(filter);
 
-    delete rule;
+    // Rule may stay in network rules shared by matchers, disabled rule never matches
+    rule->setEnabled(false);
+    retireRules(QVector<AdBlockRule*>() << rule);
+
+    emit ruleRemoved(rule);
     return true;
 }
 
 const AdBlockRule* AdBlockCustomList::replaceRule(AdBlockRule* rule, int offset)
 {
+    AdBlockManager::instance()->finishLoading();
+
     if (!QzTools::containsIndex(m_rules, offset)) {
         return 0;
     }
@@ -415,11 +849,11 @@ const AdBlockRule* AdBlockCustomList::replaceRule(AdBlockRule* rule, int offset)
     AdBlockRule* oldRule = m_rules.at(offset);
     m_rules[offset] = rule;
 
-    emit subscriptionChanged();
+    oldRule->setEnabled(false);
+    retireRules(QVector<AdBlockRule*>() << oldRule);
 
-    if (rule->isCssRule() || oldRule->isCssRule())
-        mApp->reloadUserStyleSheet();
+    emit ruleRemoved(oldRule);
+    emit ruleAdded(rule);
 
-    delete oldRule;
     return m_rules[offset];
 }
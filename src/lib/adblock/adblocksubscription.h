@@ -47,6 +47,8 @@
 #define ADBLOCKSUBSCRIPTION_H
 
 #include <QVector>
+#include <QFuture>
+#include <QSet>
 #include <QUrl>
 
 #include "qzcommon.h"
@@ -54,7 +56,11 @@
 #include "adblocksearchtree.h"
 
 class QUrl;
+class QSaveFile;
 class QNetworkReply;
+class QNetworkAccessManager;
+
+template <typename T> class QFutureWatcher;
 
 class QUPZILLA_EXPORT AdBlockSubscription : public QObject
 {
@@ -71,14 +77,28 @@ public:
     QUrl url() const;
     void setUrl(const QUrl &url);
 
-    virtual void loadSubscription(const QStringList &disabledRules);
+    // Updates are downloaded with application network manager if not set
+    QNetworkAccessManager* networkAccessManager() const;
+    void setNetworkAccessManager(QNetworkAccessManager* networkAccessManager);
+
+    // Parsed rules are cached in this file
+    QString cacheFilePath() const;
+
+    void loadSubscription(const QSet<QString> &disabledRules);
     virtual void saveSubscription();
 
+    // Loading in two steps, so multiple subscriptions can be read in parallel:
+    // readRules() can be called from any thread, setRules() must be called from main thread
+    virtual bool readRules(QVector<AdBlockRule*> &rules);
+    void setRules(const QVector<AdBlockRule*> &rules, bool valid, const QSet<QString> &disabledRules);
+
     const AdBlockRule* rule(int offset) const;
     QVector<AdBlockRule*> allRules() const;
 
     const AdBlockRule* enableRule(int offset);
     const AdBlockRule* disableRule(int offset);
+    // Matcher is rebuilt only once for all changed rules
+    void setRulesEnabled(const QVector<int> &offsets, bool enabled);
 
     virtual bool canEditRules() const;
     virtual bool canBeRemoved() const;
@@ -92,24 +112,49 @@ public slots:
 
 signals:
     void subscriptionChanged();
+    void ruleAdded(const AdBlockRule* rule);
+    void ruleRemoved(const AdBlockRule* rule);
+    void ruleChanged(const AdBlockRule* rule);
     void subscriptionUpdated();
     void subscriptionError(const QString &message);
 
 protected slots:
+    void subscriptionDataReceived();
     void subscriptionDownloaded();
+    void subscriptionParsed();
 
 protected:
-    virtual bool saveDownloadedData(const QByteArray &data);
+    // Rules can't be deleted right away, they may still be in use by AdBlockMatcher
+    void retireRules(const QVector<AdBlockRule*> &rules);
 
     QNetworkReply *m_reply;
     QVector<AdBlockRule*> m_rules;
 
+    // Set by readRules() when rules were changed while reading and must be saved to file
+    bool m_saveAfterLoading;
+
 private:
+    QVector<AdBlockRule*> parseRules(const QStringList &lines);
+
+    bool parseDownloadedData(bool finished);
+    void cancelDownload();
+
+    bool loadCache(QVector<AdBlockRule*> &rules, const QByteArray &checksum);
+
     QString m_title;
     QString m_filePath;
 
     QUrl m_url;
+    QNetworkAccessManager* m_networkAccessManager;
     bool m_updated;
+
+    // Update is written to temporary file and parsed on worker threads while it is
+    // being downloaded, the file is replaced only when whole update was received
+    QSaveFile* m_downloadFile;
+    QByteArray m_downloadBuffer;
+    bool m_headerReceived;
+    QList<QFuture<QVector<AdBlockRule*> > > m_parseFutures;
+    QFutureWatcher<QVector<AdBlockRule*> >* m_parseWatcher;
 };
 
 class AdBlockCustomList : public AdBlockSubscription
@@ -118,7 +163,7 @@ class AdBlockCustomList : public AdBlockSubscription
 public:
     explicit AdBlockCustomList(QObject* parent = 0);
 
-    void loadSubscription(const QStringList &disabledRules);
+    bool readRules(QVector<AdBlockRule*> &rules);
     void saveSubscription();
 
     bool canEditRules() const;
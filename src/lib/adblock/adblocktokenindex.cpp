@@ -0,0 +1,249 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "adblocktokenindex.h"
+#include "adblockrule.h"
+
+#include <QVarLengthArray>
+#include "adblockrequestcontext.h"
+
+#include <algorithm>
+
+static inline ushort toLowerAscii(ushort c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline bool isTokenChar(ushort c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+}
+
+static inline uint tokenHashStep(uint hash, ushort c)
+{
+    return hash * 31 + c;
+}
+
+static inline uint tokenHashFinish(uint hash)
+{
+    // 0 is reserved for "no token"
+    return hash ? hash : 1;
+}
+
+static void tokenize(const QString &string, QVarLengthArray<uint, 64> &tokens)
+{
+    const QChar* data = string.constData();
+    const int len = string.size();
+
+    uint hash = 0;
+    bool inToken = false;
+
+    for (int i = 0; i < len; ++i) {
+        const ushort c = toLowerAscii(data[i].unicode());
+
+        if (isTokenChar(c)) {
+            hash = tokenHashStep(hash, c);
+            inToken = true;
+        }
+        else if (inToken) {
+            tokens.append(tokenHashFinish(hash));
+            hash = 0;
+            inToken = false;
+        }
+    }
+
+    if (inToken) {
+        tokens.append(tokenHashFinish(hash));
+    }
+}
+
+// Tokens that are present in too many urls to be useful
+static bool isBadToken(const QString &token)
+{
+    return token == QL1S("http") || token == QL1S("https") || token == QL1S("www")
+           || token == QL1S("com") || token == QL1S("net") || token == QL1S("org")
+           || token == QL1S("js") || token == QL1S("html") || token == QL1S("php")
+           || token == QL1S("img") || token == QL1S("images");
+}
+
+AdBlockTokenIndex::AdBlockTokenIndex(MatchFunction match)
+    : m_match(match ? match : &AdBlockRule::networkMatch)
+{
+}
+
+void AdBlockTokenIndex::clear()
+{
+    m_rules.clear();
+    m_buckets.clear();
+    m_untokenizedRules.clear();
+}
+
+void AdBlockTokenIndex::add(const AdBlockRule* rule)
+{
+    const int index = m_rules.count();
+    m_rules.append(rule);
+
+    const uint token = ruleToken(rule);
+
+    if (token) {
+        m_buckets[token].append(index);
+    }
+    else {
+        m_untokenizedRules.append(index);
+    }
+}
+
+const AdBlockRule* AdBlockTokenIndex::find(const AdBlockRequestContext &context) const
+{
+    if (m_rules.isEmpty()) {
+        return 0;
+    }
+
+    // Rule with the lowest index wins, so the result is the same as if rules were checked in order
+    int bestIndex = m_rules.count();
+
+    findInBucket(m_untokenizedRules, context, bestIndex);
+
+    if (!m_buckets.isEmpty()) {
+        QVarLengthArray<uint, 64> tokens;
+        tokenize(context.urlString(), tokens);
+        tokenize(context.domain(), tokens);
+        std::sort(tokens.begin(), tokens.end());
+
+        uint lastToken = 0;
+
+        for (int i = 0; i < tokens.size(); ++i) {
+            const uint token = tokens.at(i);
+            if (token == lastToken) {
+                continue;
+            }
+            lastToken = token;
+
+            QHash<uint, QVector<int> >::const_iterator it = m_buckets.constFind(token);
+            if (it != m_buckets.constEnd()) {
+                findInBucket(it.value(), context, bestIndex);
+            }
+        }
+    }
+
+    return bestIndex < m_rules.count() ? m_rules.at(bestIndex) : 0;
+}
+
+void AdBlockTokenIndex::findInBucket(const QVector<int> &bucket, const AdBlockRequestContext &context, int &bestIndex) const
+{
+    // Indexes in bucket are sorted
+    const int count = bucket.count();
+
+    for (int i = 0; i < count; ++i) {
+        const int index = bucket.at(i);
+        if (index >= bestIndex) {
+            return;
+        }
+
+        if ((m_rules.at(index)->*m_match)(context)) {
+            bestIndex = index;
+            return;
+        }
+    }
+}
+
+uint AdBlockTokenIndex::ruleToken(const AdBlockRule* rule)
+{
+    if (rule->m_type == AdBlockRule::CssRule || rule->m_type == AdBlockRule::Invalid) {
+        return 0;
+    }
+
+    // Get back the filter pattern the same way as AdBlockRule::parseFilter does
+    QString pattern = rule->m_filter;
+
+    if (pattern.startsWith(QL1S("@@"))) {
+        pattern = pattern.mid(2);
+    }
+
+    const int optionsIndex = pattern.indexOf(QL1C('$'));
+    if (optionsIndex >= 0) {
+        pattern = pattern.left(optionsIndex);
+    }
+
+    // Classic regexp
+    if (pattern.startsWith(QL1C('/')) && pattern.endsWith(QL1C('/'))) {
+        return 0;
+    }
+
+    const int len = pattern.size();
+    int i = 0;
+
+    // Token can be used only if it is surrounded by non-token characters (or url boundaries)
+    // in every matching url, otherwise it may be only part of the token found in url.
+    // Both "|" and "||" anchors start the match at url (domain) boundary.
+    bool leftBounded = false;
+
+    if (pattern.startsWith(QL1S("||"))) {
+        i = 2;
+        leftBounded = true;
+    }
+    else if (pattern.startsWith(QL1C('|'))) {
+        i = 1;
+        leftBounded = true;
+    }
+
+    uint bestToken = 0;
+    int bestScore = 0;
+
+    uint hash = 0;
+    int tokenStart = -1;
+
+    for (; i <= len; ++i) {
+        const ushort c = i < len ? toLowerAscii(pattern.at(i).unicode()) : 0;
+
+        if (i < len && isTokenChar(c)) {
+            if (tokenStart < 0) {
+                tokenStart = i;
+            }
+            hash = tokenHashStep(hash, c);
+            continue;
+        }
+
+        if (tokenStart >= 0) {
+            // '*' and end of pattern are wildcards, non-ASCII chars may match case-insensitively
+            // an ASCII token character. Everything else ('^', '|' and literals) is a boundary.
+            const bool rightBounded = i < len && c != '*' && c < 128;
+
+            if (leftBounded && rightBounded) {
+                const QString token = pattern.mid(tokenStart, i - tokenStart).toLower();
+                int score = qMin(token.size(), 16) * 2;
+                if (!isBadToken(token)) {
+                    score += 100;
+                }
+
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestToken = tokenHashFinish(hash);
+                }
+            }
+
+            tokenStart = -1;
+            hash = 0;
+        }
+
+        if (i < len) {
+            leftBounded = c != '*' && c < 128;
+        }
+    }
+
+    return bestToken;
+}
@@ -0,0 +1,62 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef ADBLOCKTOKENINDEX_H
+#define ADBLOCKTOKENINDEX_H
+
+#include <QHash>
+#include <QVector>
+
+#include "qzcommon.h"
+
+class AdBlockRequestContext;
+
+class AdBlockRule;
+
+// Index of network rules that cannot be put into AdBlockSearchTree, or of document
+// and elemhide exceptions.
+// Every rule is stored in a bucket of one literal token (run of [a-z0-9%] characters)
+// that must be present in url or domain for the rule to match. On match, url and domain
+// are tokenized only once and just the buckets of found tokens are checked.
+class QUPZILLA_EXPORT AdBlockTokenIndex
+{
+public:
+    typedef bool (AdBlockRule::*MatchFunction)(const AdBlockRequestContext &context) const;
+
+    // Rules are matched with match function, AdBlockRule::networkMatch by default
+    explicit AdBlockTokenIndex(MatchFunction match = 0);
+
+    void clear();
+
+    void add(const AdBlockRule* rule);
+    const AdBlockRule* find(const AdBlockRequestContext &context) const;
+
+    // Returns hash of token used to index the rule, 0 if rule has no usable token
+    static uint ruleToken(const AdBlockRule* rule);
+
+private:
+    void findInBucket(const QVector<int> &bucket, const AdBlockRequestContext &context, int &bestIndex) const;
+
+    MatchFunction m_match;
+
+    // Rules in insertion order, buckets contain indexes into this vector
+    QVector<const AdBlockRule*> m_rules;
+    QHash<uint, QVector<int> > m_buckets;
+    QVector<int> m_untokenizedRules;
+};
+
+#endif // ADBLOCKTOKENINDEX_H
@@ -0,0 +1,168 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "adblocktreeview.h"
+#include "adblockrulesmodel.h"
+#include "adblocksubscription.h"
+
+#include <QMenu>
+#include <QKeyEvent>
+#include <QClipboard>
+#include <QApplication>
+#include <QInputDialog>
+
+AdBlockTreeView::AdBlockTreeView(AdBlockSubscription* subscription, QWidget* parent)
+    : QTreeView(parent)
+    , m_subscription(subscription)
+    , m_model(new AdBlockRulesModel(subscription, this))
+{
+    setModel(m_model);
+    setContextMenuPolicy(Qt::CustomContextMenu);
+    setSelectionMode(QAbstractItemView::ExtendedSelection);
+    setEditTriggers(QAbstractItemView::DoubleClicked | QAbstractItemView::EditKeyPressed);
+    setHeaderHidden(true);
+    setAlternatingRowColors(true);
+    setLayoutDirection(Qt::LeftToRight);
+    // All rows have the same height, view doesn't need to ask for size of every rule
+    setUniformRowHeights(true);
+    expand(m_model->subscriptionIndex());
+
+    connect(this, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(contextMenuRequested(QPoint)));
+    connect(m_subscription, SIGNAL(subscriptionUpdated()), this, SLOT(subscriptionUpdated()));
+    connect(m_subscription, SIGNAL(subscriptionError(QString)), this, SLOT(subscriptionError(QString)));
+    connect(m_model, SIGNAL(modelReset()), this, SLOT(expandAll()));
+}
+
+AdBlockSubscription* AdBlockTreeView::subscription() const
+{
+    return m_subscription;
+}
+
+void AdBlockTreeView::showRule(const AdBlockRule* rule)
+{
+    const QModelIndex index = m_model->ruleIndex(rule);
+
+    if (index.isValid()) {
+        setCurrentIndex(index);
+        scrollTo(index, QAbstractItemView::PositionAtCenter);
+    }
+}
+
+void AdBlockTreeView::refresh()
+{
+    m_model->refresh();
+}
+
+void AdBlockTreeView::filterString(const QString &string)
+{
+    m_model->setFilterString(string);
+}
+
+void AdBlockTreeView::contextMenuRequested(const QPoint &pos)
+{
+    const QModelIndex index = indexAt(pos);
+    if (!index.isValid()) {
+        return;
+    }
+
+    const bool isRule = m_model->ruleOffset(index) >= 0;
+
+    QMenu menu;
+    menu.addAction(tr("Enable Rules"), this, SLOT(enableRules()))->setEnabled(isRule);
+    menu.addAction(tr("Disable Rules"), this, SLOT(disableRules()))->setEnabled(isRule);
+
+    if (m_subscription->canEditRules()) {
+        menu.addSeparator();
+        menu.addAction(tr("Add Rule"), this, SLOT(addRule()));
+        menu.addSeparator();
+        menu.addAction(tr("Remove Rule"), this, SLOT(removeRule()))->setEnabled(isRule);
+    }
+
+    menu.exec(viewport()->mapToGlobal(pos));
+}
+
+void AdBlockTreeView::copyFilter()
+{
+    const QModelIndex index = currentIndex();
+    if (!index.isValid()) {
+        return;
+    }
+
+    QApplication::clipboard()->setText(index.data().toString());
+}
+
+void AdBlockTreeView::enableRules()
+{
+    m_model->setRulesEnabled(selectionModel()->selectedRows(), true);
+}
+
+void AdBlockTreeView::disableRules()
+{
+    m_model->setRulesEnabled(selectionModel()->selectedRows(), false);
+}
+
+void AdBlockTreeView::addRule()
+{
+    if (!m_subscription->canEditRules()) {
+        return;
+    }
+
+    QString newRule = QInputDialog::getText(this, tr("Add Custom Rule"), tr("Please write your rule here:"));
+    if (newRule.isEmpty()) {
+        return;
+    }
+
+    AdBlockRule* rule = new AdBlockRule(newRule, m_subscription);
+    m_subscription->addRule(rule);
+
+    showRule(rule);
+}
+
+void AdBlockTreeView::removeRule()
+{
+    const int offset = m_model->ruleOffset(currentIndex());
+    if (offset < 0 || !m_subscription->canEditRules()) {
+        return;
+    }
+
+    m_subscription->removeRule(offset);
+}
+
+void AdBlockTreeView::subscriptionUpdated()
+{
+    m_model->refresh();
+    m_model->setStatus(tr("%1 (recently updated)").arg(m_subscription->title()));
+}
+
+void AdBlockTreeView::subscriptionError(const QString &message)
+{
+    m_model->refresh();
+    m_model->setStatus(tr("%1 (Error: %2)").arg(m_subscription->title(), message));
+}
+
+void AdBlockTreeView::keyPressEvent(QKeyEvent* event)
+{
+    if (event->key() == Qt::Key_C && event->modifiers() & Qt::ControlModifier) {
+        copyFilter();
+    }
+
+    if (event->key() == Qt::Key_Delete) {
+        removeRule();
+    }
+
+    QTreeView::keyPressEvent(event);
+}
@@ -1,6 +1,6 @@
 /* ============================================================
-* QupZilla - WebKit based browser
-* Copyright (C) 2010-2014  David Rosca <nowrep@gmail.com>
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
 *
 * This program is free software: you can redistribute it and/or modify
 * it under the terms of the GNU General Public License as published by
@@ -15,25 +15,28 @@
 * You should have received a copy of the GNU General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 * ============================================================ */
-#ifndef ADBLOCKTREEWIDGET_H
-#define ADBLOCKTREEWIDGET_H
+#ifndef ADBLOCKTREEVIEW_H
+#define ADBLOCKTREEVIEW_H
+
+#include <QTreeView>
 
 #include "qzcommon.h"
-#include "treewidget.h"
 
 class AdBlockSubscription;
+class AdBlockRulesModel;
 class AdBlockRule;
 
-class QUPZILLA_EXPORT AdBlockTreeWidget : public TreeWidget
+class QUPZILLA_EXPORT AdBlockTreeView : public QTreeView
 {
     Q_OBJECT
 public:
-    explicit AdBlockTreeWidget(AdBlockSubscription* subscription, QWidget* parent = 0);
+    explicit AdBlockTreeView(AdBlockSubscription* subscription, QWidget* parent = 0);
 
     AdBlockSubscription* subscription() const;
 
     void showRule(const AdBlockRule* rule);
     void refresh();
+    void filterString(const QString &string);
 
 public slots:
     void addRule();
@@ -41,21 +44,18 @@ public slots:
 
 private slots:
     void contextMenuRequested(const QPoint &pos);
-    void itemChanged(QTreeWidgetItem* item);
     void copyFilter();
+    void enableRules();
+    void disableRules();
 
     void subscriptionUpdated();
     void subscriptionError(const QString &message);
 
 private:
-    void adjustItemFeatures(QTreeWidgetItem* item, const AdBlockRule* rule);
     void keyPressEvent(QKeyEvent* event);
 
     AdBlockSubscription* m_subscription;
-    QTreeWidgetItem* m_topItem;
-
-    QString m_ruleToBeSelected;
-    bool m_itemChangingBlock;
+    AdBlockRulesModel* m_model;
 };
 
-#endif // ADBLOCKTREEWIDGET_H
+#endif // ADBLOCKTREEVIEW_H
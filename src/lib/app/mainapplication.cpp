@@ -44,8 +44,10 @@
 #include "commandlineoptions.h"
 #include "searchenginesmanager.h"
 #include "desktopnotificationsfactory.h"
+#include "completer/locationcompleterindex.h"
 #include "html5permissions/html5permissionsmanager.h"
 #include "scripts.h"
+#include "sqldatabase.h"
 
 #include <QWebEngineSettings>
 #include <QDesktopServices>
@@ -85,6 +87,7 @@ MainApplication::MainApplication(int &argc, char** argv)
     , m_isStartingAfterCrash(false)
     , m_history(0)
     , m_bookmarks(0)
+    , m_locationCompleterIndex(0)
     , m_autoFill(0)
     , m_cookieJar(0)
     , m_plugins(0)
@@ -327,10 +330,13 @@ MainApplication::~MainApplication()
     QThreadPool::globalInstance()->waitForDone();
 
     // Delete all classes that are saving data in destructor
+    delete m_history;
     delete m_bookmarks;
     delete m_cookieJar;
     delete m_plugins;
 
+    SqlDatabase::instance()->waitForWrites();
+
     Settings::syncSettings();
 }
 
@@ -511,6 +517,15 @@ Bookmarks* MainApplication::bookmarks()
     return m_bookmarks;
 }
 
+LocationCompleterIndex* MainApplication::locationCompleterIndex()
+{
+    if (!m_locationCompleterIndex) {
+        m_locationCompleterIndex = new LocationCompleterIndex(this);
+        m_locationCompleterIndex->load(history(), bookmarks());
+    }
+    return m_locationCompleterIndex;
+}
+
 AutoFill* MainApplication::autoFill()
 {
     return m_autoFill;
@@ -689,6 +704,9 @@ void MainApplication::postLaunch()
 
     createJumpList();
 
+    // Index for location bar completer is loaded in background
+    locationCompleterIndex();
+
     QTimer::singleShot(5000, this, &MainApplication::runDeferredPostLaunchActions);
 }
 
@@ -1105,6 +1123,10 @@ void MainApplication::checkOptimizeDatabase()
         IconProvider::instance()->clearOldIconsInDatabase();
         settings.setValue(QSL("RunsWithoutOptimizeDb"), 0);
     }
+    else if (!isPrivate()) {
+        // Runs on writer thread, free pages are reclaimed only when there are enough of them
+        SqlDatabase::instance()->optimize();
+    }
 
     settings.endGroup();
 }
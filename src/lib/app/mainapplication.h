@@ -43,6 +43,7 @@ class BrowserWindow;
 class NetworkManager;
 class BrowsingLibrary;
 class DownloadManager;
+class LocationCompleterIndex;
 class UserAgentManager;
 class SearchEnginesManager;
 class HTML5PermissionsManager;
@@ -92,6 +93,7 @@ public:
 
     History* history();
     Bookmarks* bookmarks();
+    LocationCompleterIndex* locationCompleterIndex();
 
     AutoFill* autoFill();
     CookieJar* cookieJar();
@@ -161,6 +163,7 @@ private:
 
     History* m_history;
     Bookmarks* m_bookmarks;
+    LocationCompleterIndex* m_locationCompleterIndex;
 
     AutoFill* m_autoFill;
     CookieJar* m_cookieJar;
@@ -20,13 +20,31 @@
 #include "datapaths.h"
 #include "updater.h"
 #include "qztools.h"
+#include "sqldatabase.h"
 
 #include <QDir>
 #include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
 #include <QMessageBox>
 #include <QSettings>
 #include <iostream>
 
+// Schema migrations of browsedata.db, migration at index i updates schema from version i
+// to version i + 1. Version is stored in user_version pragma. Released migrations must
+// never be changed, new ones are only appended.
+static QList<QStringList> databaseMigrations()
+{
+    QList<QStringList> migrations;
+
+    // 1: History is filtered and sorted by date and visit count
+    migrations.append(QStringList()
+                      << QSL("CREATE INDEX IF NOT EXISTS historyDate ON history(date)")
+                      << QSL("CREATE INDEX IF NOT EXISTS historyCount ON history(count)"));
+
+    return migrations;
+}
+
 ProfileManager::ProfileManager()
     : m_databaseConnected(false)
 {
@@ -151,6 +169,46 @@ QStringList ProfileManager::availableProfiles()
     return dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
 }
 
+// static
+int ProfileManager::databaseVersion()
+{
+    return databaseMigrations().count();
+}
+
+// static
+bool ProfileManager::migrateDatabase(QSqlDatabase &db)
+{
+    const QList<QStringList> migrations = databaseMigrations();
+
+    QSqlQuery query(db);
+    query.exec(QSL("PRAGMA user_version"));
+
+    const int version = query.next() ? query.value(0).toInt() : 0;
+
+    // Database from newer version is expected to be compatible
+    for (int i = version; i < migrations.count(); ++i) {
+        db.transaction();
+
+        foreach (const QString &statement, migrations.at(i)) {
+            if (!query.exec(statement)) {
+                qWarning() << "ProfileManager::" << __FUNCTION__ << "Migration to version" << i + 1 << "failed:" << query.lastError().text();
+                db.rollback();
+                return false;
+            }
+        }
+
+        // Version is stored in database header, so it is part of the transaction
+        query.exec(QSL("PRAGMA user_version = %1").arg(i + 1));
+
+        if (!db.commit()) {
+            qWarning() << "ProfileManager::" << __FUNCTION__ << "Cannot commit migration to version" << i + 1;
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void ProfileManager::updateCurrentProfile()
 {
     QDir profileDir(DataPaths::currentProfilePath());
@@ -259,6 +317,28 @@ void ProfileManager::connectDatabase()
     if (!db.open()) {
         qWarning("Cannot open SQLite database! Continuing without database....");
     }
+    else {
+        SqlDatabase::setupConnection(db);
+
+        if (!mApp->isPrivate()) {
+            migrateDatabase(db);
+        }
+    }
+
+    SqlDatabase::instance()->setDatabase(db);
+
+    // All writes are done by SqlDatabase writer thread, default connection only reads
+    if (db.isOpen() && !mApp->isPrivate()) {
+        db.close();
+        db.setConnectOptions(QSL("QSQLITE_OPEN_READONLY"));
+
+        if (db.open()) {
+            SqlDatabase::setupConnection(db);
+        }
+        else {
+            qWarning() << "ProfileManager::" << __FUNCTION__ << "Cannot open read-only connection:" << db.lastError().text();
+        }
+    }
 
     m_databaseConnected = true;
 }
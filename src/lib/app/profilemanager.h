@@ -22,7 +22,9 @@
 
 #include "qzcommon.h"
 
-class ProfileManager
+class QSqlDatabase;
+
+class QUPZILLA_EXPORT ProfileManager
 {
 public:
     explicit ProfileManager();
@@ -47,6 +49,12 @@ public:
     // Names of available profiles
     static QStringList availableProfiles();
 
+    // Schema version of browsedata.db this version of QupZilla uses
+    static int databaseVersion();
+    // Apply all schema migrations newer than version stored in database,
+    // each one in its own transaction. Return false on error
+    static bool migrateDatabase(QSqlDatabase &db);
+
 private:
     void updateCurrentProfile();
     void updateProfile(const QString &current, const QString &profile);
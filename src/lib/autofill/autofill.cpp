@@ -269,9 +269,6 @@ QByteArray AutoFill::exportPasswords()
 
 bool AutoFill::importPasswords(const QByteArray &data)
 {
-    QSqlDatabase db = QSqlDatabase::database();
-    db.transaction();
-
     QXmlStreamReader xml(data);
 
     while (!xml.atEnd()) {
@@ -337,14 +334,12 @@ bool AutoFill::importPasswords(const QByteArray &data)
                     if (!query.next()) {
                         query.prepare("INSERT INTO autofill_exceptions (server) VALUES (?)");
                         query.addBindValue(server);
-                        query.exec();
+                        SqlDatabase::instance()->exec(query);
                     }
                 }
             }
         }
     }
 
-    db.commit();
-
     return !xml.hasError();
 }
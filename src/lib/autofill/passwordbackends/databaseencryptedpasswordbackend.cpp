@@ -22,6 +22,7 @@
 #include "aesinterface.h"
 #include "browserwindow.h"
 #include "ui_masterpassworddialog.h"
+#include "sqldatabase.h"
 
 #include <QVector>
 #include <QSqlQuery>
@@ -35,11 +36,13 @@ DatabaseEncryptedPasswordBackend::DatabaseEncryptedPasswordBackend()
     , m_askPasswordDialogVisible(false)
     , m_askMasterPassword(false)
 {
-    QSqlDatabase db = QSqlDatabase::database();
-    if (!db.tables().contains(QLatin1String("autofill_encrypted"))) {
-        db.exec("CREATE TABLE autofill_encrypted (data_encrypted TEXT, id INTEGER PRIMARY KEY,"
-                "password_encrypted TEXT, server TEXT, username_encrypted TEXT, last_used NUMERIC)");
-        db.exec("CREATE INDEX autofillEncryptedServer ON autofill_encrypted(server ASC)");
+    if (!QSqlDatabase::database().tables().contains(QLatin1String("autofill_encrypted"))) {
+        SqlDatabase::instance()->runOnWriter<bool>([](QSqlDatabase &db) {
+            QSqlQuery query(db);
+            return query.exec("CREATE TABLE autofill_encrypted (data_encrypted TEXT, id INTEGER PRIMARY KEY,"
+                              "password_encrypted TEXT, server TEXT, username_encrypted TEXT, last_used NUMERIC)") &&
+                   query.exec("CREATE INDEX autofillEncryptedServer ON autofill_encrypted(server ASC)");
+        }).waitForFinished();
     }
 }
 
@@ -162,7 +165,7 @@ void DatabaseEncryptedPasswordBackend::addEntry(const PasswordEntry &entry)
         query.bindValue(2, encryptedEntry.username);
         query.bindValue(3, encryptedEntry.password);
 
-        query.exec();
+        SqlDatabase::instance()->exec(query);
     }
 }
 
@@ -189,7 +192,7 @@ bool DatabaseEncryptedPasswordBackend::updateEntry(const PasswordEntry &entry)
             query.addBindValue(encryptedEntry.id);
         }
 
-        return query.exec();
+        return SqlDatabase::instance()->exec(query).isActive();
     }
 
     return false;
@@ -201,7 +204,7 @@ void DatabaseEncryptedPasswordBackend::updateLastUsed(PasswordEntry &entry)
     query.prepare("UPDATE autofill_encrypted SET last_used=strftime('%s', 'now') WHERE id=?");
     query.addBindValue(entry.id);
 
-    query.exec();
+    SqlDatabase::instance()->execAsync(query);
 }
 
 void DatabaseEncryptedPasswordBackend::removeEntry(const PasswordEntry &entry)
@@ -214,7 +217,7 @@ void DatabaseEncryptedPasswordBackend::removeEntry(const PasswordEntry &entry)
     query.prepare("DELETE FROM autofill_encrypted WHERE id=?");
     query.addBindValue(entry.id);
 
-    query.exec();
+    SqlDatabase::instance()->exec(query);
 
     m_stateOfMasterPassword = UnKnownState;
     if (someDataFromDatabase().isEmpty()) {
@@ -231,7 +234,7 @@ void DatabaseEncryptedPasswordBackend::removeAll()
     QSqlQuery query;
     query.prepare("DELETE FROM autofill_encrypted");
 
-    query.exec();
+    SqlDatabase::instance()->exec(query);
 
     m_stateOfMasterPassword = PasswordIsSetted;
 
@@ -415,8 +418,11 @@ void DatabaseEncryptedPasswordBackend::encryptDataBaseTableOnFly(const QByteArra
         updateQuery.addBindValue(username);
         updateQuery.addBindValue(id);
 
-        updateQuery.exec();
+        // Updates are batched into one transaction by writer thread
+        SqlDatabase::instance()->execAsync(updateQuery);
     }
+
+    SqlDatabase::instance()->waitForWrites();
 }
 
 QByteArray DatabaseEncryptedPasswordBackend::someDataFromDatabase()
@@ -473,14 +479,14 @@ void DatabaseEncryptedPasswordBackend::updateSampleData(const QByteArray &passwo
 
         query.addBindValue(QString::fromUtf8(m_someDataStoredOnDataBase));
         query.addBindValue(INTERNAL_SERVER_ID);
-        query.exec();
+        SqlDatabase::instance()->exec(query);
 
         m_stateOfMasterPassword = PasswordIsSetted;
     }
     else if (query.next()) {
         query.prepare("DELETE FROM autofill_encrypted WHERE server = ?");
         query.addBindValue(INTERNAL_SERVER_ID);
-        query.exec();
+        SqlDatabase::instance()->exec(query);
 
         m_stateOfMasterPassword = PasswordIsNotSetted;
         m_someDataStoredOnDataBase.clear();
@@ -18,6 +18,7 @@
 #include "databasepasswordbackend.h"
 #include "mainapplication.h"
 #include "autofill.h"
+#include "sqldatabase.h"
 
 #include <QVector>
 #include <QSqlQuery>
@@ -101,7 +102,7 @@ void DatabasePasswordBackend::addEntry(const PasswordEntry &entry)
     query.bindValue(1, entry.data);
     query.bindValue(2, entry.username);
     query.bindValue(3, entry.password);
-    query.exec();
+    SqlDatabase::instance()->exec(query);
 }
 
 bool DatabasePasswordBackend::updateEntry(const PasswordEntry &entry)
@@ -123,7 +124,7 @@ bool DatabasePasswordBackend::updateEntry(const PasswordEntry &entry)
         query.addBindValue(entry.id);
     }
 
-    return query.exec();
+    return SqlDatabase::instance()->exec(query).isActive();
 }
 
 void DatabasePasswordBackend::updateLastUsed(PasswordEntry &entry)
@@ -131,7 +132,7 @@ void DatabasePasswordBackend::updateLastUsed(PasswordEntry &entry)
     QSqlQuery query;
     query.prepare("UPDATE autofill SET last_used=strftime('%s', 'now') WHERE id=?");
     query.addBindValue(entry.id);
-    query.exec();
+    SqlDatabase::instance()->execAsync(query);
 }
 
 void DatabasePasswordBackend::removeEntry(const PasswordEntry &entry)
@@ -139,12 +140,12 @@ void DatabasePasswordBackend::removeEntry(const PasswordEntry &entry)
     QSqlQuery query;
     query.prepare("DELETE FROM autofill WHERE id=?");
     query.addBindValue(entry.id);
-    query.exec();
+    SqlDatabase::instance()->exec(query);
 }
 
 void DatabasePasswordBackend::removeAll()
 {
     QSqlQuery query;
     query.prepare("DELETE FROM autofill");
-    query.exec();
+    SqlDatabase::instance()->exec(query);
 }
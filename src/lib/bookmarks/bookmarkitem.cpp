@@ -18,6 +18,9 @@
 #include "bookmarkitem.h"
 #include "iconprovider.h"
 
+// Cache icon for 20 seconds
+static const int iconCacheTime = 20 * 1000;
+
 BookmarkItem::BookmarkItem(BookmarkItem::Type type, BookmarkItem* parent)
     : m_type(type)
     , m_parent(parent)
@@ -72,9 +75,6 @@ QList<BookmarkItem*> BookmarkItem::children() const
 
 QIcon BookmarkItem::icon()
 {
-    // Cache icon for 20 seconds
-    const int iconCacheTime = 20 * 1000;
-
     switch (m_type) {
     case Url:
         if (m_iconTime.isNull() || m_iconTime.elapsed() > iconCacheTime) {
@@ -89,9 +89,19 @@ QIcon BookmarkItem::icon()
     }
 }
 
+QIcon BookmarkItem::cachedIcon() const
+{
+    if (m_iconTime.isNull() || m_iconTime.elapsed() > iconCacheTime) {
+        return QIcon();
+    }
+
+    return m_icon;
+}
+
 void BookmarkItem::setIcon(const QIcon &icon)
 {
     m_icon = icon;
+    m_iconTime.restart();
 }
 
 QString BookmarkItem::urlString() const
@@ -51,6 +51,8 @@ public:
     QList<BookmarkItem*> children() const;
 
     QIcon icon();
+    // Icon of url that was loaded less than 20 seconds ago, never loads it
+    QIcon cachedIcon() const;
     void setIcon(const QIcon &icon);
 
     QString urlString() const;
@@ -18,6 +18,7 @@
 #include "bookmarksmodel.h"
 #include "bookmarkitem.h"
 #include "bookmarks.h"
+#include "iconprovider.h"
 
 #include <QApplication>
 #include <QMimeData>
@@ -39,6 +40,8 @@ BookmarksModel::BookmarksModel(BookmarkItem* root, Bookmarks* bookmarks, QObject
         connect(m_bookmarks, SIGNAL(bookmarkChanged(BookmarkItem*)), this, SLOT(bookmarkChanged(BookmarkItem*)));
     }
 
+    connect(IconProvider::instance(), SIGNAL(imageLoaded(QUrl,QImage)), this, SLOT(iconLoaded(QUrl,QImage)));
+
 #ifdef BOOKMARKSMODEL_DEBUG
     new ModelTest(this, this);
 #endif
@@ -131,6 +134,23 @@ QVariant BookmarksModel::data(const QModelIndex &index, int role) const
         }
     case Qt::DecorationRole:
         if (index.column() == 0) {
+            if (itm->isUrl()) {
+                QIcon icon = itm->cachedIcon();
+                if (icon.isNull()) {
+                    // Icon is loaded in background, dataChanged is emitted once it is ready
+                    const QImage image = IconProvider::instance()->cachedImageForUrl(itm->url());
+                    if (image.isNull()) {
+                        const QPersistentModelIndex idx(index);
+                        if (!m_iconRequests.contains(itm->url(), idx)) {
+                            m_iconRequests.insert(itm->url(), idx);
+                        }
+                        return IconProvider::emptyWebIcon();
+                    }
+                    icon = QIcon(QPixmap::fromImage(image));
+                    itm->setIcon(icon);
+                }
+                return icon;
+            }
             return itm->icon();
         }
         return QVariant();
@@ -308,6 +328,21 @@ void BookmarksModel::bookmarkChanged(BookmarkItem* item)
     emit dataChanged(idx, idx);
 }
 
+void BookmarksModel::iconLoaded(const QUrl &url, const QImage &image)
+{
+    const QIcon icon(QPixmap::fromImage(image));
+
+    foreach (const QPersistentModelIndex &idx, m_iconRequests.values(url)) {
+        BookmarkItem* itm = idx.isValid() ? item(idx) : 0;
+        if (itm) {
+            itm->setIcon(icon);
+            emit dataChanged(idx, idx);
+        }
+    }
+
+    m_iconRequests.remove(url);
+}
+
 
 // BookmarksFilterModel
 BookmarksFilterModel::BookmarksFilterModel(QAbstractItemModel* parent)
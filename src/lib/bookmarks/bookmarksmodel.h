@@ -20,10 +20,13 @@
 
 #include <QAbstractItemModel>
 #include <QSortFilterProxyModel>
+#include <QMultiHash>
+#include <QUrl>
 
 #include "qzcommon.h"
 
 class QTimer;
+class QImage;
 
 class Bookmarks;
 class BookmarkItem;
@@ -72,10 +75,14 @@ public:
 
 private slots:
     void bookmarkChanged(BookmarkItem* item);
+    void iconLoaded(const QUrl &url, const QImage &image);
 
 private:
     BookmarkItem* m_root;
     Bookmarks* m_bookmarks;
+
+    // Indexes waiting for icon to be loaded by IconProvider
+    mutable QMultiHash<QUrl, QPersistentModelIndex> m_iconRequests;
 };
 
 class QUPZILLA_EXPORT BookmarksFilterModel : public QSortFilterProxyModel
@@ -24,6 +24,7 @@
 #include "tabwidget.h"
 #include "qzsettings.h"
 #include "browserwindow.h"
+#include "sqldatabase.h"
 
 #include <iostream>
 #include <QSqlQuery>
@@ -460,9 +461,13 @@ bool BookmarksTools::migrateBookmarksIfNecessary(Bookmarks* bookmarks)
         bookmark->setUrl(url);
     }
 
-    query.exec("DROP TABLE folders");
-    query.exec("DROP TABLE bookmarks");
-    query.exec("VACUUM");
+    query.finish();
+
+    SqlDatabase::instance()->runOnWriter<bool>([](QSqlDatabase &db) {
+        QSqlQuery query(db);
+        return query.exec("DROP TABLE folders") && query.exec("DROP TABLE bookmarks");
+    }).waitForFinished();
+    SqlDatabase::instance()->optimize(true);
 
     std::cout << "Bookmarks: Bookmarks successfully migrated!" << std::endl;
     return true;
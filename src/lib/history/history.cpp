@@ -21,18 +21,61 @@
 #include "browserwindow.h"
 #include "iconprovider.h"
 #include "settings.h"
+#include "sqldatabase.h"
 
+#include <QTimer>
+#include <QFutureWatcher>
 #include <QSqlDatabase>
 #include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+#include <limits>
+
+// Rows indexed in one step of building the search index, other writes wait only for one step
+static const int searchIndexStep = 2000;
+
+// Set on writer thread once the index is complete, read from any thread
+static QAtomicInt s_hasSearchIndex(0);
+
+// Used only on writer thread. Rows with id above s_indexedId are not yet in the index
+// that is being built, they are added by following steps with their current values
+static QString s_indexTable;
+static qint64 s_indexedId = -1;
+
+static bool isIndexed(qint64 id)
+{
+    return id <= s_indexedId;
+}
 
 History::History(QObject* parent)
     : QObject(parent)
     , m_isSaving(true)
     , m_model(0)
+    , m_writing(false)
 {
+    m_journalTimer = new QTimer(this);
+    m_journalTimer->setSingleShot(true);
+    m_journalTimer->setInterval(1000);
+    connect(m_journalTimer, SIGNAL(timeout()), this, SLOT(writeJournal()));
+
+    m_writeWatcher = new QFutureWatcher<QVector<WrittenVisit> >(this);
+    connect(m_writeWatcher, SIGNAL(finished()), this, SLOT(journalWritten()));
+
+    // Each step is queued only after the previous one is done, so that writes queued
+    // in the meantime don't wait for the whole index to be built
+    m_searchIndexWatcher = new QFutureWatcher<bool>(this);
+    connect(m_searchIndexWatcher, SIGNAL(finished()), this, SLOT(searchIndexStepDone()));
+    m_searchIndexWatcher->setFuture(SqlDatabase::instance()->runOnWriter<bool>(&History::createSearchIndex));
+
     loadSettings();
 }
 
+History::~History()
+{
+    flush();
+}
+
 HistoryModel* History::model()
 {
     if (!m_model) {
@@ -84,56 +127,257 @@ void History::addHistoryEntry(const QUrl &url, QString title)
         title = tr("Empty Page");
     }
 
-    QSqlQuery query;
-    query.prepare("SELECT id, count, date, title FROM history WHERE url=?");
-    query.bindValue(0, url);
-    query.exec();
-    if (!query.next()) {
-        query.prepare("INSERT INTO history (count, date, url, title) VALUES (1,?,?,?)");
-        query.bindValue(0, QDateTime::currentMSecsSinceEpoch());
-        query.bindValue(1, url);
-        query.bindValue(2, title);
-        query.exec();
+    const qint64 date = QDateTime::currentMSecsSinceEpoch();
 
-        int id = query.lastInsertId().toInt();
-        HistoryEntry entry;
-        entry.id = id;
-        entry.count = 1;
-        entry.date = QDateTime::currentDateTime();
-        entry.url = url;
-        entry.urlString = url.toEncoded();
-        entry.title = title;
-        emit historyEntryAdded(entry);
+    // Repeated visits of the same url are written only once
+    const int index = m_journalIndex.value(url, -1);
+    if (index != -1) {
+        Visit &visit = m_journal[index];
+        visit.title = title;
+        visit.date = date;
+        visit.count++;
     }
     else {
-        int id = query.value(0).toInt();
-        int count = query.value(1).toInt();
-        QDateTime date = QDateTime::fromMSecsSinceEpoch(query.value(2).toLongLong());
-        QString oldTitle = query.value(3).toString();
-
-        query.prepare("UPDATE history SET count = count + 1, date=?, title=? WHERE url=?");
-        query.bindValue(0, QDateTime::currentMSecsSinceEpoch());
-        query.bindValue(1, title);
-        query.bindValue(2, url);
-        query.exec();
+        Visit visit;
+        visit.url = url;
+        visit.title = title;
+        visit.date = date;
+        visit.count = 1;
+
+        m_journalIndex.insert(url, m_journal.count());
+        m_journal.append(visit);
+    }
+
+    if (!m_writing && !m_journalTimer->isActive()) {
+        m_journalTimer->start();
+    }
+}
+
+void History::flush()
+{
+    m_journalTimer->stop();
+
+    if (m_writing) {
+        m_writeWatcher->waitForFinished();
+        journalWritten();
+    }
+
+    if (!m_journal.isEmpty()) {
+        writeJournal();
+        m_writeWatcher->waitForFinished();
+        journalWritten();
+    }
+}
+
+bool History::hasSearchIndex()
+{
+    return s_hasSearchIndex.load();
+}
 
-        HistoryEntry before;
-        before.id = id;
-        before.count = count;
-        before.date = date;
-        before.url = url;
-        before.urlString = url.toEncoded();
-        before.title = oldTitle;
+void History::writeJournal()
+{
+    // Journal is written again when the current write is finished
+    if (m_writing || m_journal.isEmpty()) {
+        return;
+    }
 
-        HistoryEntry after = before;
-        after.count = count + 1;
-        after.date = QDateTime::currentDateTime();
-        after.title = title;
+    const QVector<Visit> visits = m_journal;
+    m_journal.clear();
+    m_journalIndex.clear();
 
-        emit historyEntryEdited(before, after);
+    m_writing = true;
+    m_writeWatcher->setFuture(SqlDatabase::instance()->runOnWriter<QVector<WrittenVisit> >([visits](QSqlDatabase &db) {
+        return writeVisits(db, visits);
+    }));
+}
+
+void History::journalWritten()
+{
+    // Already handled in flush()
+    if (!m_writing) {
+        return;
+    }
+
+    m_writing = false;
+
+    const QVector<WrittenVisit> written = m_writeWatcher->result();
+
+    foreach (const WrittenVisit &visit, written) {
+        if (visit.added) {
+            emit historyEntryAdded(visit.after);
+        }
+        else {
+            emit historyEntryEdited(visit.before, visit.after);
+        }
+    }
+
+    if (!m_journal.isEmpty() && !m_journalTimer->isActive()) {
+        m_journalTimer->start();
     }
 }
 
+void History::searchIndexStepDone()
+{
+    if (m_searchIndexWatcher->result()) {
+        m_searchIndexWatcher->setFuture(SqlDatabase::instance()->runOnWriter<bool>(&History::buildSearchIndex));
+    }
+}
+
+QVector<History::WrittenVisit> History::writeVisits(QSqlDatabase &db, const QVector<Visit> &visits)
+{
+    QVector<WrittenVisit> written;
+    written.reserve(visits.count());
+
+    QSqlQuery selectQuery(db);
+    selectQuery.prepare(QSL("SELECT id, count, date, title FROM history WHERE url=?"));
+
+    // External content index, rows are removed with the values they were indexed with
+    QSqlQuery indexDeleteQuery(db);
+    QSqlQuery indexInsertQuery(db);
+
+    if (!s_indexTable.isEmpty()) {
+        indexDeleteQuery.prepare(QSL("INSERT INTO %1(%1, rowid, title, url) SELECT 'delete', id, title, url FROM history WHERE id=?").arg(s_indexTable));
+        indexInsertQuery.prepare(QSL("INSERT INTO %1(rowid, title, url) SELECT id, title, url FROM history WHERE id=?").arg(s_indexTable));
+    }
+
+    // UPSERT is not available in SQLite bundled with older Qt versions
+    QSqlQuery insertQuery(db);
+    insertQuery.prepare(QSL("INSERT INTO history (count, date, url, title) VALUES (?,?,?,?)"));
+    QSqlQuery updateQuery(db);
+    updateQuery.prepare(QSL("UPDATE history SET count=count+?, date=?, title=? WHERE id=?"));
+
+    foreach (const Visit &visit, visits) {
+        WrittenVisit entry;
+
+        // Previous state of the entry is needed for historyEntryEdited signal
+        selectQuery.bindValue(0, visit.url);
+        selectQuery.exec();
+        entry.added = !selectQuery.next();
+
+        if (!entry.added) {
+            entry.before.id = selectQuery.value(0).toInt();
+            entry.before.count = selectQuery.value(1).toInt();
+            entry.before.date = QDateTime::fromMSecsSinceEpoch(selectQuery.value(2).toLongLong());
+            entry.before.url = visit.url;
+            entry.before.urlString = visit.url.toEncoded();
+            entry.before.title = selectQuery.value(3).toString();
+        }
+        selectQuery.finish();
+
+        // Only title of existing entry can change
+        const bool reindex = entry.added || entry.before.title != visit.title;
+
+        if (reindex && !entry.added && isIndexed(entry.before.id)) {
+            indexDeleteQuery.bindValue(0, entry.before.id);
+            indexDeleteQuery.exec();
+        }
+
+        QSqlQuery &writeQuery = entry.added ? insertQuery : updateQuery;
+
+        if (entry.added) {
+            insertQuery.bindValue(0, visit.count);
+            insertQuery.bindValue(1, visit.date);
+            insertQuery.bindValue(2, visit.url);
+            insertQuery.bindValue(3, visit.title);
+        }
+        else {
+            updateQuery.bindValue(0, visit.count);
+            updateQuery.bindValue(1, visit.date);
+            updateQuery.bindValue(2, visit.title);
+            updateQuery.bindValue(3, entry.before.id);
+        }
+
+        if (!writeQuery.exec()) {
+            qWarning() << "History::" << __FUNCTION__ << "Cannot write visit:" << writeQuery.lastError().text();
+            continue;
+        }
+
+        entry.after.id = entry.added ? insertQuery.lastInsertId().toInt() : entry.before.id;
+        entry.after.count = entry.added ? visit.count : entry.before.count + visit.count;
+        entry.after.date = QDateTime::fromMSecsSinceEpoch(visit.date);
+        entry.after.url = visit.url;
+        entry.after.urlString = visit.url.toEncoded();
+        entry.after.title = visit.title;
+
+        // Id of deleted row may be reused below the rows that were already indexed
+        if (reindex && isIndexed(entry.after.id)) {
+            indexInsertQuery.bindValue(0, entry.after.id);
+            indexInsertQuery.exec();
+        }
+
+        written.append(entry);
+    }
+
+    return written;
+}
+
+bool History::createSearchIndex(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+    query.exec(QSL("SELECT name FROM sqlite_master WHERE type='table' AND name='history_fts'"));
+
+    if (query.next()) {
+        s_indexTable = QSL("history_fts");
+        s_indexedId = std::numeric_limits<qint64>::max();
+        s_hasSearchIndex.store(1);
+        return false;
+    }
+    query.finish();
+
+    // Index is built under another name and renamed once all rows are indexed,
+    // index that was not finished before quitting is built again
+    query.exec(QSL("DROP TABLE IF EXISTS history_fts_build"));
+
+    // Trigram tokenizer matches any substring of at least 3 characters, case insensitive
+    if (!query.exec(QSL("CREATE VIRTUAL TABLE history_fts_build USING fts5(title, url, content='history', content_rowid='id', tokenize='trigram')"))) {
+        qWarning() << "History::" << __FUNCTION__ << "Full-text search is not available:" << query.lastError().text();
+        return false;
+    }
+
+    s_indexTable = QSL("history_fts_build");
+    s_indexedId = 0;
+    return true;
+}
+
+bool History::buildSearchIndex(QSqlDatabase &db)
+{
+    if (s_indexTable != QL1S("history_fts_build")) {
+        return false;
+    }
+
+    QSqlQuery query(db);
+    query.prepare(QSL("SELECT max(id) FROM (SELECT id FROM history WHERE id>? ORDER BY id LIMIT %1)").arg(searchIndexStep));
+    query.addBindValue(s_indexedId);
+    query.exec();
+
+    const QVariant lastId = query.next() ? query.value(0) : QVariant();
+    query.finish();
+
+    if (lastId.isNull()) {
+        if (!query.exec(QSL("ALTER TABLE history_fts_build RENAME TO history_fts"))) {
+            qWarning() << "History::" << __FUNCTION__ << "Cannot finish search index:" << query.lastError().text();
+            return false;
+        }
+
+        s_indexTable = QSL("history_fts");
+        s_indexedId = std::numeric_limits<qint64>::max();
+        s_hasSearchIndex.store(1);
+        return false;
+    }
+
+    query.prepare(QSL("INSERT INTO history_fts_build(rowid, title, url) SELECT id, title, url FROM history WHERE id>? AND id<=?"));
+    query.addBindValue(s_indexedId);
+    query.addBindValue(lastId);
+
+    if (!query.exec()) {
+        qWarning() << "History::" << __FUNCTION__ << "Cannot build search index:" << query.lastError().text();
+        return false;
+    }
+
+    s_indexedId = lastId.toLongLong();
+    return true;
+}
+
 // DeleteHistoryEntry
 void History::deleteHistoryEntry(int index)
 {
@@ -145,25 +389,48 @@ void History::deleteHistoryEntry(int index)
 
 void History::deleteHistoryEntry(const QList<int> &list)
 {
-    QSqlDatabase db = QSqlDatabase::database();
-    db.transaction();
+    // Pending visits must not recreate deleted entries
+    flush();
 
-    foreach (int index, list) {
-        QSqlQuery query;
-        query.prepare("SELECT count, date, url, title FROM history WHERE id=?");
-        query.addBindValue(index);
+    const QVector<HistoryEntry> entries = SqlDatabase::instance()->runOnWriter<QVector<HistoryEntry> >([list](QSqlDatabase &db) {
+        return deleteEntries(db, list);
+    }).result();
+
+    foreach (const HistoryEntry &entry, entries) {
+        emit historyEntryDeleted(entry);
+    }
+}
 
-        if (!query.exec() || !query.next()) {
+QVector<HistoryEntry> History::deleteEntries(QSqlDatabase &db, const QList<int> &ids)
+{
+    QVector<HistoryEntry> entries;
+
+    QSqlQuery selectQuery(db);
+    selectQuery.prepare(QSL("SELECT count, date, url, title FROM history WHERE id=?"));
+
+    QSqlQuery query(db);
+
+    foreach (int index, ids) {
+        selectQuery.bindValue(0, index);
+
+        if (!selectQuery.exec() || !selectQuery.next()) {
             continue;
         }
 
         HistoryEntry entry;
         entry.id = index;
-        entry.count = query.value(0).toInt();
-        entry.date = QDateTime::fromMSecsSinceEpoch(query.value(1).toLongLong());
-        entry.url = query.value(2).toUrl();
+        entry.count = selectQuery.value(0).toInt();
+        entry.date = QDateTime::fromMSecsSinceEpoch(selectQuery.value(1).toLongLong());
+        entry.url = selectQuery.value(2).toUrl();
         entry.urlString = entry.url.toEncoded();
-        entry.title = query.value(3).toString();
+        entry.title = selectQuery.value(3).toString();
+        selectQuery.finish();
+
+        if (isIndexed(index)) {
+            query.prepare(QSL("INSERT INTO %1(%1, rowid, title, url) SELECT 'delete', id, title, url FROM history WHERE id=?").arg(s_indexTable));
+            query.addBindValue(index);
+            query.exec();
+        }
 
         query.prepare("DELETE FROM history WHERE id=?");
         query.addBindValue(index);
@@ -173,14 +440,16 @@ void History::deleteHistoryEntry(const QList<int> &list)
         query.addBindValue(entry.url.toEncoded(QUrl::RemoveFragment));
         query.exec();
 
-        emit historyEntryDeleted(entry);
+        entries.append(entry);
     }
 
-    db.commit();
+    return entries;
 }
 
 void History::deleteHistoryEntry(const QString &url, const QString &title)
 {
+    flush();
+
     QSqlQuery query;
     query.prepare("SELECT id FROM history WHERE url=? AND title=?");
     query.bindValue(0, url);
@@ -200,6 +469,8 @@ QList<int> History::indexesFromTimeRange(qint64 start, qint64 end)
         return list;
     }
 
+    flush();
+
     QSqlQuery query;
     query.prepare("SELECT id FROM history WHERE date BETWEEN ? AND ?");
     query.addBindValue(end);
@@ -215,6 +486,8 @@ QList<int> History::indexesFromTimeRange(qint64 start, qint64 end)
 
 bool History::urlIsStored(const QString &url)
 {
+    flush();
+
     QSqlQuery query;
     query.prepare("SELECT id FROM history WHERE url=?");
     query.bindValue(0, url);
@@ -224,6 +497,8 @@ bool History::urlIsStored(const QString &url)
 
 QVector<HistoryEntry> History::mostVisited(int count)
 {
+    flush();
+
     QVector<HistoryEntry> list;
     QSqlQuery query;
     query.exec(QString("SELECT count, date, id, title, url FROM history ORDER BY count DESC LIMIT %1").arg(count));
@@ -241,13 +516,31 @@ QVector<HistoryEntry> History::mostVisited(int count)
 
 void History::clearHistory()
 {
-    QSqlQuery query;
-    query.exec(QSL("DELETE FROM history"));
-    query.exec(QSL("VACUUM"));
+    m_journal.clear();
+    m_journalIndex.clear();
+    flush();
+
+    SqlDatabase::instance()->runOnWriter<bool>(&History::deleteAllEntries).waitForFinished();
+    SqlDatabase::instance()->optimize();
 
     emit resetHistory();
 }
 
+bool History::deleteAllEntries(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+
+    if (!query.exec(QSL("DELETE FROM history"))) {
+        return false;
+    }
+
+    if (!s_indexTable.isEmpty()) {
+        query.exec(QSL("INSERT INTO %1(%1) VALUES('delete-all')").arg(s_indexTable));
+    }
+
+    return true;
+}
+
 void History::setSaving(bool state)
 {
     m_isSaving = state;
@@ -22,10 +22,16 @@
 #include <QList>
 #include <QDateTime>
 #include <QUrl>
+#include <QHash>
+#include <QVector>
 
 #include "qzcommon.h"
 
 class QIcon;
+class QTimer;
+class QSqlDatabase;
+
+template <typename T> class QFutureWatcher;
 
 class WebView;
 class HistoryModel;
@@ -35,6 +41,7 @@ class QUPZILLA_EXPORT History : public QObject
     Q_OBJECT
 public:
     History(QObject* parent);
+    ~History();
 
     struct HistoryEntry {
         int id;
@@ -68,6 +75,13 @@ public:
 
     void loadSettings();
 
+    // Writes all visits waiting in journal and waits until they are stored
+    void flush();
+
+    // Whether full-text index of titles and urls can be used for searching,
+    // it is built in background in small steps when not found in database
+    static bool hasSearchIndex();
+
 signals:
     void historyEntryAdded(const HistoryEntry &entry);
     void historyEntryDeleted(const HistoryEntry &entry);
@@ -75,14 +89,52 @@ signals:
 
     void resetHistory();
 
+private slots:
+    void writeJournal();
+    void journalWritten();
+    void searchIndexStepDone();
+
 private:
+    // Visits of one url, coalesced until the journal is written
+    struct Visit {
+        QUrl url;
+        QString title;
+        qint64 date;
+        int count;
+    };
+
+    struct WrittenVisit {
+        bool added;
+        HistoryEntry before;
+        HistoryEntry after;
+    };
+
+    // Called on database writer thread
+    static QVector<WrittenVisit> writeVisits(QSqlDatabase &db, const QVector<Visit> &visits);
+    static QVector<HistoryEntry> deleteEntries(QSqlDatabase &db, const QList<int> &ids);
+    static bool deleteAllEntries(QSqlDatabase &db);
+    // Return whether there are rows left to be indexed by next step
+    static bool createSearchIndex(QSqlDatabase &db);
+    static bool buildSearchIndex(QSqlDatabase &db);
+
     bool m_isSaving;
     HistoryModel* m_model;
+
+    // Visits are written in one transaction by database writer thread, so that page
+    // loads don't wait for database
+    QVector<Visit> m_journal;
+    QHash<QUrl, int> m_journalIndex;
+    QTimer* m_journalTimer;
+    QFutureWatcher<QVector<WrittenVisit> >* m_writeWatcher;
+    bool m_writing;
+
+    QFutureWatcher<bool>* m_searchIndexWatcher;
 };
 
 typedef History::HistoryEntry HistoryEntry;
 
 // Hint to QVector to use std::realloc on item moving
 Q_DECLARE_TYPEINFO(HistoryEntry, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(HistoryEntry)
 
 #endif // HISTORY_H
@@ -17,12 +17,13 @@
 * ============================================================ */
 #include "historymodel.h"
 #include "historyitem.h"
+#include "historysearchjob.h"
 #include "iconprovider.h"
 
-#include <QApplication>
 #include <QSqlQuery>
 #include <QDateTime>
 #include <QTimer>
+#include <QPixmap>
 
 static QString dateTimeToString(const QDateTime &dateTime)
 {
@@ -46,6 +47,8 @@ HistoryModel::HistoryModel(History* history)
     connect(m_history, SIGNAL(historyEntryAdded(HistoryEntry)), this, SLOT(historyEntryAdded(HistoryEntry)));
     connect(m_history, SIGNAL(historyEntryDeleted(HistoryEntry)), this, SLOT(historyEntryDeleted(HistoryEntry)));
     connect(m_history, SIGNAL(historyEntryEdited(HistoryEntry,HistoryEntry)), this, SLOT(historyEntryEdited(HistoryEntry,HistoryEntry)));
+
+    connect(IconProvider::instance(), SIGNAL(imageLoaded(QUrl,QImage)), this, SLOT(iconLoaded(QUrl,QImage)));
 }
 
 QVariant HistoryModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -130,7 +133,19 @@ QVariant HistoryModel::data(const QModelIndex &index, int role) const
         break;
     case Qt::DecorationRole:
         if (index.column() == 0) {
-            return item->icon().isNull() ? IconProvider::emptyWebIcon() : item->icon();
+            if (item->icon().isNull()) {
+                // Icon is loaded in background, dataChanged is emitted once it is ready
+                const QImage image = IconProvider::instance()->cachedImageForUrl(entry.url);
+                if (image.isNull()) {
+                    const QPersistentModelIndex idx(index);
+                    if (!m_iconRequests.contains(entry.url, idx)) {
+                        m_iconRequests.insert(entry.url, idx);
+                    }
+                    return IconProvider::emptyWebIcon();
+                }
+                item->setIcon(QPixmap::fromImage(image));
+            }
+            return item->icon();
         }
     }
 
@@ -257,6 +272,29 @@ void HistoryModel::removeTopLevelIndexes(const QList<QPersistentModelIndex> &ind
     }
 }
 
+void HistoryModel::addHistoryEntries(const QVector<HistoryEntry> &entries)
+{
+    foreach (const HistoryEntry &entry, entries) {
+        HistoryItem* parentItem = findTopLevelItem(entry.date.toMSecsSinceEpoch());
+
+        if (!parentItem) {
+            continue;
+        }
+
+        const int row = sortedRow(parentItem, entry);
+
+        if (row < parentItem->childCount() && parentItem->child(row)->historyEntry.id == entry.id) {
+            // Filter models re-evaluate only rows of entries that were already in model
+            HistoryItem* item = parentItem->child(row);
+            emit dataChanged(createIndex(row, 0, item), createIndex(row, columnCount() - 1, item));
+        }
+        // Fetched items already contain all their entries
+        else if (parentItem->canFetchMore) {
+            insertSortedEntry(parentItem, entry);
+        }
+    }
+}
+
 void HistoryModel::resetHistory()
 {
     beginResetModel();
@@ -264,6 +302,7 @@ void HistoryModel::resetHistory()
     delete m_rootItem;
     m_todayItem = 0;
     m_rootItem = new HistoryItem(0);
+    m_iconRequests.clear();
 
     init();
 
@@ -287,9 +326,10 @@ void HistoryModel::fetchMore(const QModelIndex &parent)
 
     parentItem->canFetchMore = false;
 
-    QList<int> idList;
+    // Item may already contain entries added by addHistoryEntries()
+    QSet<int> idList;
     for (int i = 0; i < parentItem->childCount(); ++i) {
-        idList.append(parentItem->child(i)->historyEntry.id);
+        idList.insert(parentItem->child(i)->historyEntry.id);
     }
 
     QSqlQuery query;
@@ -318,6 +358,14 @@ void HistoryModel::fetchMore(const QModelIndex &parent)
         return;
     }
 
+    // Keep entries added before fetching in order
+    if (parentItem->childCount() > 0) {
+        foreach (const HistoryEntry &entry, list) {
+            insertSortedEntry(parentItem, entry);
+        }
+        return;
+    }
+
     beginInsertRows(parent, 0, list.size() - 1);
 
     foreach (const HistoryEntry &entry, list) {
@@ -397,20 +445,80 @@ void HistoryModel::historyEntryEdited(const HistoryEntry &before, const HistoryE
     historyEntryAdded(after);
 }
 
-HistoryItem* HistoryModel::findHistoryItem(const HistoryEntry &entry)
+void HistoryModel::iconLoaded(const QUrl &url, const QImage &image)
+{
+    foreach (const QPersistentModelIndex &index, m_iconRequests.values(url)) {
+        HistoryItem* item = index.isValid() ? itemFromIndex(index) : 0;
+        if (item) {
+            item->setIcon(QPixmap::fromImage(image));
+            emit dataChanged(index, index);
+        }
+    }
+
+    m_iconRequests.remove(url);
+}
+
+int HistoryModel::sortedRow(HistoryItem* parentItem, const HistoryEntry &entry) const
+{
+    // Children are sorted by date, newest first
+    int row = 0;
+    int last = parentItem->childCount();
+
+    while (row < last) {
+        const int middle = (row + last) / 2;
+
+        if (parentItem->child(middle)->historyEntry.date > entry.date) {
+            row = middle + 1;
+        }
+        else {
+            last = middle;
+        }
+    }
+
+    for (int i = row; i < parentItem->childCount() && parentItem->child(i)->historyEntry.date == entry.date; ++i) {
+        if (parentItem->child(i)->historyEntry.id == entry.id) {
+            return i;
+        }
+    }
+
+    return row;
+}
+
+void HistoryModel::insertSortedEntry(HistoryItem* parentItem, const HistoryEntry &entry)
 {
-    HistoryItem* parentItem = 0;
-    qint64 timestamp = entry.date.toMSecsSinceEpoch();
+    const int row = sortedRow(parentItem, entry);
 
+    if (row < parentItem->childCount() && parentItem->child(row)->historyEntry.id == entry.id) {
+        return;
+    }
+
+    beginInsertRows(createIndex(parentItem->row(), 0, parentItem), row, row);
+
+    HistoryItem* item = new HistoryItem();
+    item->historyEntry = entry;
+
+    parentItem->insertChild(row, item);
+
+    endInsertRows();
+}
+
+HistoryItem* HistoryModel::findTopLevelItem(qint64 timestamp) const
+{
     for (int i = 0; i < m_rootItem->childCount(); ++i) {
         HistoryItem* item = m_rootItem->child(i);
 
         if (item->endTimestamp() < timestamp) {
-            parentItem = item;
-            break;
+            return item;
         }
     }
 
+    return 0;
+}
+
+HistoryItem* HistoryModel::findHistoryItem(const HistoryEntry &entry)
+{
+    HistoryItem* parentItem = findTopLevelItem(entry.date.toMSecsSinceEpoch());
+
     if (!parentItem) {
         return 0;
     }
@@ -524,6 +632,15 @@ HistoryFilterModel::HistoryFilterModel(QAbstractItemModel* parent)
     connect(m_filterTimer, SIGNAL(timeout()), this, SLOT(startFiltering()));
 }
 
+bool HistoryFilterModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!m_pattern.isEmpty()) {
+        return false;
+    }
+
+    return QSortFilterProxyModel::canFetchMore(parent);
+}
+
 void HistoryFilterModel::setFilterFixedString(const QString &pattern)
 {
     m_pattern = pattern;
@@ -533,30 +650,53 @@ void HistoryFilterModel::setFilterFixedString(const QString &pattern)
 
 void HistoryFilterModel::startFiltering()
 {
+    if (m_searchJob) {
+        m_searchJob->cancel();
+        m_searchJob = 0;
+    }
+
+    m_matchingIds.clear();
+    invalidateFilter();
+
     if (m_pattern.isEmpty()) {
         emit collapseAllItems();
-        QSortFilterProxyModel::setFilterFixedString(m_pattern);
         return;
     }
 
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-
-    // Expand all items also calls fetchmore
+    // Found entries are shown in expanded items as they arrive
     emit expandAllItems();
 
-    QSortFilterProxyModel::setFilterFixedString(m_pattern);
+    m_searchJob = new HistorySearchJob(m_pattern);
+    connect(m_searchJob, SIGNAL(resultsReady(QVector<HistoryEntry>)), this, SLOT(searchResultsReady(QVector<HistoryEntry>)));
+    connect(m_searchJob, SIGNAL(finished()), m_searchJob, SLOT(deleteLater()));
+}
 
-    QApplication::restoreOverrideCursor();
+void HistoryFilterModel::searchResultsReady(const QVector<HistoryEntry> &entries)
+{
+    // Results of cancelled job
+    if (sender() != m_searchJob) {
+        return;
+    }
+
+    foreach (const HistoryEntry &entry, entries) {
+        m_matchingIds.insert(entry.id);
+    }
+
+    // New rows are accepted as they are inserted, rows that were already in model
+    // are reported as changed, so the whole filter is never invalidated
+    HistoryModel* model = qobject_cast<HistoryModel*>(sourceModel());
+    if (model) {
+        model->addHistoryEntries(entries);
+    }
 }
 
 bool HistoryFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
     const QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
 
-    if (index.data(HistoryModel::IsTopLevelRole).toBool()) {
+    if (m_pattern.isEmpty() || index.data(HistoryModel::IsTopLevelRole).toBool()) {
         return true;
     }
 
-    return (index.data(HistoryModel::UrlStringRole).toString().contains(m_pattern, Qt::CaseInsensitive) ||
-            index.data(HistoryModel::TitleRole).toString().contains(m_pattern, Qt::CaseInsensitive));
+    return m_matchingIds.contains(index.data(HistoryModel::IdRole).toInt());
 }
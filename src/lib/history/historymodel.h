@@ -20,14 +20,19 @@
 
 #include <QAbstractItemModel>
 #include <QSortFilterProxyModel>
+#include <QPointer>
+#include <QSet>
+#include <QMultiHash>
 
 #include "qzcommon.h"
 #include "history.h"
 
 class QTimer;
+class QImage;
 
 class History;
 class HistoryItem;
+class HistorySearchJob;
 
 class QUPZILLA_EXPORT HistoryModel : public QAbstractItemModel
 {
@@ -67,6 +72,11 @@ public:
 
     void removeTopLevelIndexes(const QList<QPersistentModelIndex> &indexes);
 
+    // Inserts entries into top level items that were not fetched yet, so that
+    // found entries can be shown without fetching whole items. Entries that
+    // are already in model are reported with dataChanged()
+    void addHistoryEntries(const QVector<HistoryEntry> &entries);
+
 signals:
 
 private slots:
@@ -76,7 +86,13 @@ private slots:
     void historyEntryDeleted(const HistoryEntry &entry);
     void historyEntryEdited(const HistoryEntry &before, const HistoryEntry &after);
 
+    void iconLoaded(const QUrl &url, const QImage &image);
+
 private:
+    // Row of entry in children of parentItem, or row where it should be inserted
+    int sortedRow(HistoryItem* parentItem, const HistoryEntry &entry) const;
+    void insertSortedEntry(HistoryItem* parentItem, const HistoryEntry &entry);
+    HistoryItem* findTopLevelItem(qint64 timestamp) const;
     HistoryItem* findHistoryItem(const HistoryEntry &entry);
     void checkEmptyParentItem(HistoryItem* item);
     void init();
@@ -84,6 +100,9 @@ private:
     HistoryItem* m_rootItem;
     HistoryItem* m_todayItem;
     History* m_history;
+
+    // Indexes waiting for icon to be loaded by IconProvider
+    mutable QMultiHash<QUrl, QPersistentModelIndex> m_iconRequests;
 };
 
 class QUPZILLA_EXPORT HistoryFilterModel : public QSortFilterProxyModel
@@ -92,6 +111,9 @@ class QUPZILLA_EXPORT HistoryFilterModel : public QSortFilterProxyModel
 public:
     explicit HistoryFilterModel(QAbstractItemModel* parent);
 
+    // Top level items are not fetched while filtering, only found entries are added
+    bool canFetchMore(const QModelIndex &parent) const;
+
 public slots:
     void setFilterFixedString(const QString &pattern);
 
@@ -104,10 +126,14 @@ protected:
 
 private slots:
     void startFiltering();
+    void searchResultsReady(const QVector<HistoryEntry> &entries);
 
 private:
     QString m_pattern;
     QTimer* m_filterTimer;
+
+    QPointer<HistorySearchJob> m_searchJob;
+    QSet<int> m_matchingIds;
 };
 
 #endif // HISTORYMODEL_H
@@ -0,0 +1,101 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "historysearchjob.h"
+#include "sqldatabase.h"
+#include "qztools.h"
+
+#include <QSqlQuery>
+
+#include <QtConcurrent/QtConcurrentRun>
+
+// Number of entries reported at once
+static const int batchSize = 250;
+
+HistorySearchJob::HistorySearchJob(const QString &searchString)
+    : QObject()
+    , m_searchString(searchString)
+    , m_jobCancelled(0)
+{
+    qRegisterMetaType<QVector<HistoryEntry> >("QVector<HistoryEntry>");
+
+    m_watcher = new QFutureWatcher<void>(this);
+    connect(m_watcher, SIGNAL(finished()), this, SIGNAL(finished()));
+
+    QFuture<void> future = QtConcurrent::run(this, &HistorySearchJob::runJob);
+    m_watcher->setFuture(future);
+}
+
+QString HistorySearchJob::searchString() const
+{
+    return m_searchString;
+}
+
+void HistorySearchJob::cancel()
+{
+    m_jobCancelled.store(1);
+}
+
+void HistorySearchJob::runJob()
+{
+    QSqlQuery query(SqlDatabase::instance()->readDatabase());
+
+    // Trigram index can only be used for strings of at least 3 characters
+    if (m_searchString.size() >= 3 && History::hasSearchIndex()) {
+        query.prepare(QSL("SELECT history.id, history.count, history.title, history.url, history.date FROM history_fts "
+                          "JOIN history ON history.id = history_fts.rowid WHERE history_fts MATCH ? ORDER BY history.date DESC"));
+        QString phrase = m_searchString;
+        phrase.replace(QL1C('"'), QL1S("\"\""));
+        query.addBindValue(QL1C('"') + phrase + QL1C('"'));
+    }
+    else {
+        query.prepare(QSL("SELECT id, count, title, url, date FROM history WHERE title LIKE ? ESCAPE '\\' OR url LIKE ? ESCAPE '\\' ORDER BY date DESC"));
+        const QString pattern = QzTools::escapeSqlLikeString(m_searchString);
+        query.addBindValue(QString("%%1%").arg(pattern));
+        query.addBindValue(QString("%%1%").arg(pattern));
+    }
+
+    query.setForwardOnly(true);
+    query.exec();
+
+    QVector<HistoryEntry> entries;
+    entries.reserve(batchSize);
+
+    while (query.next()) {
+        if (m_jobCancelled.load()) {
+            return;
+        }
+
+        HistoryEntry entry;
+        entry.id = query.value(0).toInt();
+        entry.count = query.value(1).toInt();
+        entry.title = query.value(2).toString();
+        entry.url = query.value(3).toUrl();
+        entry.date = QDateTime::fromMSecsSinceEpoch(query.value(4).toLongLong());
+        entry.urlString = entry.url.toEncoded();
+        entries.append(entry);
+
+        if (entries.size() == batchSize) {
+            emit resultsReady(entries);
+            entries.clear();
+        }
+    }
+
+    if (!entries.isEmpty() && !m_jobCancelled.load()) {
+        emit resultsReady(entries);
+    }
+}
@@ -0,0 +1,54 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef HISTORYSEARCHJOB_H
+#define HISTORYSEARCHJOB_H
+
+#include <QFutureWatcher>
+#include <QVector>
+
+#include "qzcommon.h"
+#include "history.h"
+
+// Searches titles and urls of all history entries on worker thread, matching
+// entries are reported in batches as they are read, newest first
+class QUPZILLA_EXPORT HistorySearchJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HistorySearchJob(const QString &searchString);
+
+    QString searchString() const;
+
+    // No more results are reported after cancelling
+    void cancel();
+
+signals:
+    // Emitted from worker thread
+    void resultsReady(const QVector<HistoryEntry> &entries);
+    void finished();
+
+private:
+    void runJob();
+
+    QString m_searchString;
+    QFutureWatcher<void>* m_watcher;
+    QAtomicInt m_jobCancelled;
+};
+
+#endif // HISTORYSEARCHJOB_H
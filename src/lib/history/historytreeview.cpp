@@ -20,7 +20,6 @@
 #include "historyitem.h"
 #include "headerview.h"
 #include "mainapplication.h"
-#include "iconprovider.h"
 
 #include <QClipboard>
 #include <QKeyEvent>
@@ -251,16 +250,3 @@ void HistoryTreeView::keyPressEvent(QKeyEvent* event)
         }
     }
 }
-
-void HistoryTreeView::drawRow(QPainter* painter, const QStyleOptionViewItem &options, const QModelIndex &index) const
-{
-    bool itemTopLevel = index.data(HistoryModel::IsTopLevelRole).toBool();
-    bool iconLoaded = !index.data(HistoryModel::IconRole).value<QIcon>().isNull();
-
-    if (index.isValid() && !itemTopLevel && !iconLoaded) {
-        const QPersistentModelIndex idx = index;
-        model()->setData(idx, IconProvider::iconForUrl(index.data(HistoryModel::UrlRole).toUrl()), HistoryModel::IconRole);
-    }
-
-    QTreeView::drawRow(painter, options, index);
-}
@@ -65,8 +65,6 @@ protected:
     void mouseDoubleClickEvent(QMouseEvent* event);
     void keyPressEvent(QKeyEvent* event);
 
-    void drawRow(QPainter* painter, const QStyleOptionViewItem &options, const QModelIndex &index) const;
-
 private:
     History* m_history;
     HistoryFilterModel* m_filter;
@@ -54,10 +54,15 @@ SOURCES += \
     adblock/adblockicon.cpp \
     adblock/adblockmanager.cpp \
     adblock/adblockmatcher.cpp \
+    adblock/adblockprefilter.cpp \
+    adblock/adblockprofiler.cpp \
+    adblock/adblockrequestcontext.cpp \
     adblock/adblockrule.cpp \
     adblock/adblocksearchtree.cpp \
     adblock/adblocksubscription.cpp \
-    adblock/adblocktreewidget.cpp \
+    adblock/adblocktokenindex.cpp \
+    adblock/adblockrulesmodel.cpp \
+    adblock/adblocktreeview.cpp \
     app/autosaver.cpp \
     app/browserwindow.cpp \
     app/commandlineoptions.cpp \
@@ -108,9 +113,11 @@ SOURCES += \
     history/historymanager.cpp \
     history/historymenu.cpp \
     history/historymodel.cpp \
+    history/historysearchjob.cpp \
     history/historytreeview.cpp \
     navigation/completer/locationcompleter.cpp \
     navigation/completer/locationcompleterdelegate.cpp \
+    navigation/completer/locationcompleterindex.cpp \
     navigation/completer/locationcompletermodel.cpp \
     navigation/completer/locationcompleterrefreshjob.cpp \
     navigation/completer/locationcompleterview.cpp \
@@ -228,15 +235,21 @@ HEADERS  += \
     3rdparty/squeezelabelv2.h \
     3rdparty/stylehelper.h \
     adblock/adblockaddsubscriptiondialog.h \
+    adblock/adblockcache.h \
     adblock/adblockurlinterceptor.h \
     adblock/adblockdialog.h \
     adblock/adblockicon.h \
     adblock/adblockmanager.h \
     adblock/adblockmatcher.h \
+    adblock/adblockprefilter.h \
+    adblock/adblockprofiler.h \
+    adblock/adblockrequestcontext.h \
     adblock/adblockrule.h \
     adblock/adblocksearchtree.h \
     adblock/adblocksubscription.h \
-    adblock/adblocktreewidget.h \
+    adblock/adblocktokenindex.h \
+    adblock/adblockrulesmodel.h \
+    adblock/adblocktreeview.h \
     app/autosaver.h \
     app/browserwindow.h \
     app/commandlineoptions.h \
@@ -287,9 +300,11 @@ HEADERS  += \
     history/historymanager.h \
     history/historymenu.h \
     history/historymodel.h \
+    history/historysearchjob.h \
     history/historytreeview.h \
     navigation/completer/locationcompleterdelegate.h \
     navigation/completer/locationcompleter.h \
+    navigation/completer/locationcompleterindex.h \
     navigation/completer/locationcompletermodel.h \
     navigation/completer/locationcompleterrefreshjob.h \
     navigation/completer/locationcompleterview.h \
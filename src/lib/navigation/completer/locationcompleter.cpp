@@ -38,6 +38,8 @@ LocationCompleter::LocationCompleter(QObject* parent)
     , m_locationBar(0)
     , m_lastRefreshTimestamp(0)
     , m_popupClosed(false)
+    , m_refreshJob(0)
+    , m_hasPendingSearch(false)
 {
     if (!s_view) {
         s_model = new LocationCompleterModel;
@@ -59,6 +61,10 @@ void LocationCompleter::setLocationBar(LocationBar* locationBar)
 void LocationCompleter::closePopup()
 {
     m_popupClosed = true;
+    m_hasPendingSearch = false;
+
+    emit cancelRefreshJob();
+
     s_view->close();
 }
 
@@ -70,11 +76,16 @@ void LocationCompleter::complete(const QString &string)
     // Eg. popup was not closed yet this completion session
     m_popupClosed = false;
 
-    emit cancelRefreshJob();
+    // Keystrokes are coalesced while a job is running, results of the
+    // running job are outdated so it is cancelled
+    if (m_refreshJob) {
+        m_pendingSearchString = trimmedStr;
+        m_hasPendingSearch = true;
+        emit cancelRefreshJob();
+        return;
+    }
 
-    LocationCompleterRefreshJob* job = new LocationCompleterRefreshJob(trimmedStr);
-    connect(job, SIGNAL(finished()), this, SLOT(refreshJobFinished()));
-    connect(this, SIGNAL(cancelRefreshJob()), job, SLOT(jobCancelled()));
+    startRefreshJob(trimmedStr);
 }
 
 void LocationCompleter::showMostVisited()
@@ -87,9 +98,14 @@ void LocationCompleter::refreshJobFinished()
     LocationCompleterRefreshJob* job = qobject_cast<LocationCompleterRefreshJob*>(sender());
     Q_ASSERT(job);
 
-    // Don't show results of older jobs
+    if (job == m_refreshJob) {
+        m_refreshJob = 0;
+        m_session = job->session();
+    }
+
+    // Don't show results of older or cancelled jobs
     // Also don't open the popup again when it was already closed
-    if (job->timestamp() > m_lastRefreshTimestamp && !m_popupClosed) {
+    if (job->timestamp() > m_lastRefreshTimestamp && !job->isCancelled() && !m_popupClosed) {
         s_model->setCompletions(job->completions());
         m_lastRefreshTimestamp = job->timestamp();
 
@@ -99,8 +115,16 @@ void LocationCompleter::refreshJobFinished()
             emit showDomainCompletion(job->domainCompletion());
         }
     }
+    else {
+        qDeleteAll(job->completions());
+    }
 
     job->deleteLater();
+
+    if (m_hasPendingSearch && !m_refreshJob) {
+        m_hasPendingSearch = false;
+        startRefreshJob(m_pendingSearchString);
+    }
 }
 
 void LocationCompleter::slotPopupClosed()
@@ -231,6 +255,14 @@ void LocationCompleter::indexDeleteRequested(const QModelIndex &index)
     }
 }
 
+void LocationCompleter::startRefreshJob(const QString &searchString)
+{
+    // Results of previous job are narrowed when search string was extended
+    m_refreshJob = new LocationCompleterRefreshJob(searchString, m_session);
+    connect(m_refreshJob, SIGNAL(finished()), this, SLOT(refreshJobFinished()));
+    connect(this, SIGNAL(cancelRefreshJob()), m_refreshJob, SLOT(jobCancelled()));
+}
+
 void LocationCompleter::switchToTab(BrowserWindow* window, int tab)
 {
     Q_ASSERT(window);
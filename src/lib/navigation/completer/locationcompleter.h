@@ -21,6 +21,7 @@
 #include <QObject>
 
 #include "qzcommon.h"
+#include "locationcompleterrefreshjob.h"
 
 class QUrl;
 class QModelIndex;
@@ -65,6 +66,8 @@ private slots:
     void indexDeleteRequested(const QModelIndex &index);
 
 private:
+    void startRefreshJob(const QString &searchString);
+
     void switchToTab(BrowserWindow* window, int tab);
     void loadUrl(const QUrl &url);
 
@@ -77,6 +80,12 @@ private:
     QString m_originalText;
     bool m_popupClosed;
 
+    // Only one job runs at a time, the last string typed meanwhile is completed after it
+    LocationCompleterRefreshJob* m_refreshJob;
+    QString m_pendingSearchString;
+    bool m_hasPendingSearch;
+    LocationCompleterRefreshJob::Session m_session;
+
     static LocationCompleterView* s_view;
     static LocationCompleterModel* s_model;
 };
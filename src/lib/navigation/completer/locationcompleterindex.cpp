@@ -0,0 +1,846 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "locationcompleterindex.h"
+#include "bookmarkitem.h"
+#include "bookmarks.h"
+#include "sqldatabase.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <QSet>
+#include <QMap>
+#include <QHash>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+
+// Longer words are indexed only by their beginning
+static const int maxTokenLength = 32;
+
+static bool hasTokenWithPrefix(const QStringList &tokens, const QString &prefix)
+{
+    QStringList::const_iterator it = std::lower_bound(tokens.constBegin(), tokens.constEnd(), prefix);
+    return it != tokens.constEnd() && it->startsWith(prefix);
+}
+
+// Scheme and www are in almost all urls, words that would match every record are not indexed
+static bool isCommonUrlToken(const QString &token)
+{
+    return token == QL1S("http") || token == QL1S("https") || token == QL1S("www");
+}
+
+static void removeCommonUrlTokens(QStringList &tokens)
+{
+    tokens.erase(std::remove_if(tokens.begin(), tokens.end(), isCommonUrlToken), tokens.end());
+}
+
+static QString indexedHost(const QUrl &url)
+{
+    if (url.scheme() != QL1S("http") && url.scheme() != QL1S("https")) {
+        return QString();
+    }
+    return url.host().toLower();
+}
+
+// Records of urls with their words stored in a prefix tree
+class LocationCompleterIndex::Data
+{
+public:
+    Data()
+    {
+        m_nodes.append(Node());
+    }
+
+    void setHistoryEntry(int id, const QUrl &url, const QString &title, int count, qint64 date)
+    {
+        const int index = record(url);
+        Record &r = m_records[index];
+
+        r.hasHistory = true;
+        r.historyId = id;
+        r.historyTitle = title;
+        r.historyCount = count;
+        r.entry.lastVisit = date;
+
+        update(index);
+    }
+
+    void removeHistoryEntry(const QUrl &url)
+    {
+        const int index = m_urls.value(url, -1);
+        if (index == -1) {
+            return;
+        }
+
+        Record &r = m_records[index];
+        r.hasHistory = false;
+        r.historyId = -1;
+        r.historyTitle.clear();
+        r.historyCount = 0;
+        r.entry.lastVisit = 0;
+
+        update(index);
+    }
+
+    void clearHistory()
+    {
+        const QList<QUrl> urls = m_urls.keys();
+
+        foreach (const QUrl &url, urls) {
+            removeHistoryEntry(url);
+        }
+    }
+
+    void setBookmark(BookmarkItem* item, const QUrl &url, const QString &title, int count)
+    {
+        removeBookmark(item);
+
+        const int index = record(url);
+        Record &r = m_records[index];
+
+        BookmarkData bookmark;
+        bookmark.bookmark = item;
+        bookmark.url = url;
+        bookmark.title = title;
+        bookmark.count = count;
+        r.bookmarks.append(bookmark);
+
+        m_bookmarks.insert(item, index);
+        update(index);
+    }
+
+    void removeBookmark(BookmarkItem* item)
+    {
+        const int index = m_bookmarks.value(item, -1);
+        if (index == -1) {
+            return;
+        }
+
+        Record &r = m_records[index];
+        for (int i = 0; i < r.bookmarks.count(); ++i) {
+            if (r.bookmarks.at(i).bookmark == item) {
+                r.bookmarks.remove(i);
+                break;
+            }
+        }
+
+        m_bookmarks.remove(item);
+        update(index);
+    }
+
+    void setTyped(const QUrl &url)
+    {
+        m_typedUrls.insert(url);
+
+        const int index = m_urls.value(url, -1);
+        if (index != -1) {
+            m_records[index].entry.typed = true;
+        }
+    }
+
+    // Records matching all words
+    QVector<int> match(const QStringList &words, int sources) const
+    {
+        if (words.isEmpty()) {
+            return QVector<int>();
+        }
+
+        // Records are collected only for the word with least matches,
+        // other words are checked in words of each record
+        int bestNode = -1;
+
+        foreach (const QString &word, words) {
+            const int node = findNode(word);
+            if (node == -1) {
+                return QVector<int>();
+            }
+
+            if (bestNode == -1 || m_nodes.at(node).size < m_nodes.at(bestNode).size) {
+                bestNode = node;
+            }
+        }
+
+        QVector<int> candidates;
+        QVector<int> stack;
+        stack.append(bestNode);
+
+        while (!stack.isEmpty()) {
+            const Node &node = m_nodes.at(stack.takeLast());
+            candidates += node.records;
+
+            for (int i = 0; i < node.children.count(); ++i) {
+                stack.append(node.children.at(i).second);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        return filter(words, candidates, sources);
+    }
+
+    // Records from list matching all words
+    QVector<int> filter(const QStringList &words, const QVector<int> &records, int sources) const
+    {
+        QVector<int> matches;
+        matches.reserve(records.count());
+
+        foreach (int index, records) {
+            const Record &r = m_records.at(index);
+            bool matched = isFromSources(r, sources);
+
+            for (int i = 0; matched && i < words.count(); ++i) {
+                matched = hasTokenWithPrefix(r.tokens, words.at(i));
+            }
+
+            if (matched) {
+                matches.append(index);
+            }
+        }
+
+        return matches;
+    }
+
+    QVector<Entry> mostFrecent(int limit, int sources) const
+    {
+        QVector<int> indexes;
+        indexes.reserve(m_urls.count());
+
+        foreach (int index, m_urls) {
+            if (isFromSources(m_records.at(index), sources)) {
+                indexes.append(index);
+            }
+        }
+
+        return bestEntries(indexes, limit);
+    }
+
+    QVector<Entry> bestEntries(const QVector<int> &indexes, int limit) const
+    {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+        QVector<QPair<double, int> > scored;
+        scored.reserve(indexes.count());
+
+        foreach (int index, indexes) {
+            scored.append(qMakePair(-frecency(m_records.at(index).entry, now), index));
+        }
+
+        const int count = qMin(limit, scored.count());
+        std::partial_sort(scored.begin(), scored.begin() + count, scored.end());
+
+        QVector<Entry> entries;
+        entries.reserve(count);
+
+        for (int i = 0; i < count; ++i) {
+            entries.append(m_records.at(scored.at(i).second).entry);
+        }
+
+        return entries;
+    }
+
+    QString completeDomain(const QString &text) const
+    {
+        const QString prefix = text.toLower();
+
+        if (prefix.isEmpty() || prefix == QL1S("www.") || prefix.contains(QL1C('/'))) {
+            return QString();
+        }
+
+        const bool withoutWww = prefix.startsWith(QL1C('w')) && !prefix.startsWith(QL1S("www."));
+        QString host = findHost(prefix, withoutWww);
+
+        if (host.isEmpty() && !withoutWww && !prefix.startsWith(QL1S("www."))) {
+            host = findHost(QL1S("www.") + prefix, false);
+        }
+
+        return host;
+    }
+
+private:
+    struct Record {
+        Record()
+            : hasHistory(false)
+            , historyId(-1)
+            , historyCount(0)
+        {
+            entry.id = -1;
+            entry.count = 0;
+            entry.lastVisit = 0;
+            entry.typed = false;
+            entry.bookmark = 0;
+        }
+
+        Entry entry;
+        bool hasHistory;
+        int historyId;
+        QString historyTitle;
+        int historyCount;
+        QVector<BookmarkData> bookmarks;
+        // Sorted words of url and titles
+        QStringList tokens;
+    };
+
+    struct Node {
+        Node() : size(0) { }
+
+        // Sorted by character
+        QVector<QPair<QChar, int> > children;
+        // Records with word ending in this node
+        QVector<int> records;
+        // Number of words in this subtree
+        int size;
+    };
+
+    static bool isFromSources(const Record &r, int sources)
+    {
+        return ((sources & SearchHistory) && r.hasHistory) || ((sources & SearchBookmarks) && !r.bookmarks.isEmpty());
+    }
+
+    static bool childLessThan(const QPair<QChar, int> &child, QChar c)
+    {
+        return child.first < c;
+    }
+
+    int record(const QUrl &url)
+    {
+        int index = m_urls.value(url, -1);
+        if (index != -1) {
+            return index;
+        }
+
+        if (m_freeRecords.isEmpty()) {
+            index = m_records.count();
+            m_records.append(Record());
+        }
+        else {
+            index = m_freeRecords.takeLast();
+        }
+
+        m_records[index].entry.url = url;
+        m_records[index].entry.typed = m_typedUrls.contains(url);
+        m_urls.insert(url, index);
+
+        const QString host = indexedHost(url);
+        if (!host.isEmpty()) {
+            m_hosts[host]++;
+        }
+
+        return index;
+    }
+
+    // Updates entry and words after history or bookmark data of record changed
+    void update(int index)
+    {
+        Record &r = m_records[index];
+        QStringList tokens;
+
+        if (r.hasHistory || !r.bookmarks.isEmpty()) {
+            r.entry.id = r.historyId;
+            r.entry.title = r.bookmarks.isEmpty() ? r.historyTitle : r.bookmarks.first().title;
+            r.entry.count = r.historyCount;
+            r.entry.bookmark = r.bookmarks.isEmpty() ? 0 : r.bookmarks.first().bookmark;
+
+            tokens = tokenize(r.entry.url.toString()) + tokenize(r.historyTitle);
+            foreach (const BookmarkData &bookmark, r.bookmarks) {
+                r.entry.count = qMax(r.entry.count, bookmark.count);
+                tokens += tokenize(bookmark.title);
+            }
+
+            removeCommonUrlTokens(tokens);
+            std::sort(tokens.begin(), tokens.end());
+            tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+        }
+
+        QStringList removed;
+        QStringList added;
+        std::set_difference(r.tokens.constBegin(), r.tokens.constEnd(), tokens.constBegin(), tokens.constEnd(), std::back_inserter(removed));
+        std::set_difference(tokens.constBegin(), tokens.constEnd(), r.tokens.constBegin(), r.tokens.constEnd(), std::back_inserter(added));
+
+        foreach (const QString &token, removed) {
+            removeToken(token, index);
+        }
+        foreach (const QString &token, added) {
+            insertToken(token, index);
+        }
+
+        r.tokens = tokens;
+
+        // Record is neither in history nor in bookmarks
+        if (!r.hasHistory && r.bookmarks.isEmpty()) {
+            const QString host = indexedHost(r.entry.url);
+            if (!host.isEmpty() && --m_hosts[host] == 0) {
+                m_hosts.remove(host);
+            }
+
+            m_urls.remove(r.entry.url);
+            m_records[index] = Record();
+            m_freeRecords.append(index);
+        }
+    }
+
+    void insertToken(const QString &token, int index)
+    {
+        int node = 0;
+        m_nodes[node].size++;
+
+        foreach (const QChar &c, token) {
+            QVector<QPair<QChar, int> > &children = m_nodes[node].children;
+            QVector<QPair<QChar, int> >::iterator it = std::lower_bound(children.begin(), children.end(), c, childLessThan);
+
+            if (it != children.end() && it->first == c) {
+                node = it->second;
+            }
+            else {
+                const int child = m_freeNodes.isEmpty() ? m_nodes.count() : m_freeNodes.takeLast();
+                children.insert(it, qMakePair(c, child));
+                if (child == m_nodes.count()) {
+                    m_nodes.append(Node());
+                }
+                node = child;
+            }
+
+            m_nodes[node].size++;
+        }
+
+        m_nodes[node].records.append(index);
+    }
+
+    void removeToken(const QString &token, int index)
+    {
+        QVector<int> path;
+        path.append(0);
+
+        foreach (const QChar &c, token) {
+            const int node = findChild(path.last(), c);
+            if (node == -1) {
+                return;
+            }
+            path.append(node);
+        }
+
+        const int position = m_nodes.at(path.last()).records.indexOf(index);
+        if (position == -1) {
+            return;
+        }
+
+        m_nodes[path.last()].records.remove(position);
+
+        foreach (int node, path) {
+            m_nodes[node].size--;
+        }
+
+        // Nodes without words are removed from the tree and reused for new words
+        for (int i = 1; i < path.count(); ++i) {
+            if (m_nodes.at(path.at(i)).size > 0) {
+                continue;
+            }
+
+            QVector<QPair<QChar, int> > &children = m_nodes[path.at(i - 1)].children;
+            children.erase(std::lower_bound(children.begin(), children.end(), token.at(i - 1), childLessThan));
+
+            for (int j = i; j < path.count(); ++j) {
+                m_nodes[path.at(j)] = Node();
+                m_freeNodes.append(path.at(j));
+            }
+            break;
+        }
+    }
+
+    int findChild(int node, QChar c) const
+    {
+        const QVector<QPair<QChar, int> > &children = m_nodes.at(node).children;
+        QVector<QPair<QChar, int> >::const_iterator it = std::lower_bound(children.constBegin(), children.constEnd(), c, childLessThan);
+        return it != children.constEnd() && it->first == c ? it->second : -1;
+    }
+
+    int findNode(const QString &prefix) const
+    {
+        int node = 0;
+
+        foreach (const QChar &c, prefix) {
+            node = findChild(node, c);
+            if (node == -1) {
+                return -1;
+            }
+        }
+
+        return m_nodes.at(node).size > 0 ? node : -1;
+    }
+
+    QString findHost(const QString &prefix, bool skipWww) const
+    {
+        QMap<QString, int>::const_iterator it = m_hosts.lowerBound(prefix);
+
+        for (; it != m_hosts.constEnd() && it.key().startsWith(prefix); ++it) {
+            if (!skipWww || !it.key().startsWith(QL1S("www."))) {
+                return it.key();
+            }
+        }
+
+        return QString();
+    }
+
+    QVector<Record> m_records;
+    QVector<int> m_freeRecords;
+    QHash<QUrl, int> m_urls;
+    QHash<BookmarkItem*, int> m_bookmarks;
+    QSet<QUrl> m_typedUrls;
+
+    // Prefix tree of words, root is the first node
+    QVector<Node> m_nodes;
+    QVector<int> m_freeNodes;
+
+    // Hosts of http(s) urls with number of records
+    QMap<QString, int> m_hosts;
+};
+
+// LocationCompleterIndex
+LocationCompleterIndex::LocationCompleterIndex(QObject* parent)
+    : QObject(parent)
+    , m_data(new Data)
+    , m_generation(0)
+    , m_loaded(false)
+    , m_loadWatcher(0)
+{
+}
+
+LocationCompleterIndex::~LocationCompleterIndex()
+{
+    if (m_loadWatcher) {
+        m_loadWatcher->waitForFinished();
+        delete m_loadWatcher->result();
+    }
+
+    delete m_data;
+}
+
+void LocationCompleterIndex::load(History* history, Bookmarks* bookmarks)
+{
+    connect(history, SIGNAL(historyEntryAdded(HistoryEntry)), this, SLOT(addHistoryEntry(HistoryEntry)));
+    connect(history, SIGNAL(historyEntryDeleted(HistoryEntry)), this, SLOT(removeHistoryEntry(HistoryEntry)));
+    connect(history, SIGNAL(historyEntryEdited(HistoryEntry,HistoryEntry)), this, SLOT(historyEntryEdited(HistoryEntry,HistoryEntry)));
+    connect(history, SIGNAL(resetHistory()), this, SLOT(clearHistory()));
+
+    connect(bookmarks, SIGNAL(bookmarkAdded(BookmarkItem*)), this, SLOT(addBookmark(BookmarkItem*)));
+    connect(bookmarks, SIGNAL(bookmarkRemoved(BookmarkItem*)), this, SLOT(removeBookmark(BookmarkItem*)));
+    connect(bookmarks, SIGNAL(bookmarkChanged(BookmarkItem*)), this, SLOT(addBookmark(BookmarkItem*)));
+
+    // Bookmarks are only accessed from main thread
+    QVector<BookmarkData> bookmarkList;
+    QList<BookmarkItem*> items = bookmarks->rootItem()->children();
+
+    while (!items.isEmpty()) {
+        BookmarkItem* item = items.takeLast();
+
+        if (item->isUrl()) {
+            BookmarkData bookmark;
+            bookmark.bookmark = item;
+            bookmark.url = item->url();
+            bookmark.title = item->title();
+            bookmark.count = item->visitCount();
+            bookmarkList.append(bookmark);
+        }
+
+        items += item->children();
+    }
+
+    m_loadWatcher = new QFutureWatcher<Data*>(this);
+    connect(m_loadWatcher, SIGNAL(finished()), this, SLOT(loadFinished()));
+
+    m_loadWatcher->setFuture(QtConcurrent::run(&LocationCompleterIndex::loadData, bookmarkList));
+}
+
+bool LocationCompleterIndex::isLoaded() const
+{
+    QReadLocker locker(&m_lock);
+    return m_loaded;
+}
+
+QVector<LocationCompleterIndex::Entry> LocationCompleterIndex::complete(const QString &searchString, int limit, int sources, Candidates* candidates) const
+{
+    QStringList words = tokenize(searchString);
+    const bool hasWords = !words.isEmpty();
+    removeCommonUrlTokens(words);
+
+    QReadLocker locker(&m_lock);
+
+    // Only scheme or www, it matches every url
+    if (hasWords && words.isEmpty()) {
+        if (candidates) {
+            candidates->searchString.clear();
+        }
+        return m_data->mostFrecent(limit, sources);
+    }
+
+    // Entries matching extended search string also matched the previous one
+    const bool narrow = candidates && candidates->generation == m_generation && candidates->sources == sources
+                        && !candidates->searchString.isEmpty() && searchString.startsWith(candidates->searchString, Qt::CaseInsensitive);
+
+    const QVector<int> matches = narrow ? m_data->filter(words, candidates->records, sources) : m_data->match(words, sources);
+
+    if (candidates) {
+        // Nothing matches string without words, but extended string may
+        candidates->searchString = words.isEmpty() ? QString() : searchString;
+        candidates->sources = sources;
+        candidates->generation = m_generation;
+        candidates->records = matches;
+    }
+
+    return m_data->bestEntries(matches, limit);
+}
+
+QVector<LocationCompleterIndex::Entry> LocationCompleterIndex::mostFrecent(int limit, int sources) const
+{
+    QReadLocker locker(&m_lock);
+    return m_data->mostFrecent(limit, sources);
+}
+
+QString LocationCompleterIndex::completeDomain(const QString &text) const
+{
+    QReadLocker locker(&m_lock);
+    return m_data->completeDomain(text);
+}
+
+// static
+double LocationCompleterIndex::frecency(const Entry &entry, qint64 now)
+{
+    const qint64 day = 24 * 60 * 60 * 1000;
+    const qint64 age = now - entry.lastVisit;
+
+    // Points for age of the last visit, never visited bookmarks get the lowest
+    int weight = 10;
+
+    if (entry.lastVisit > 0) {
+        if (age <= 4 * day) {
+            weight = 100;
+        }
+        else if (age <= 14 * day) {
+            weight = 70;
+        }
+        else if (age <= 31 * day) {
+            weight = 50;
+        }
+        else if (age <= 90 * day) {
+            weight = 30;
+        }
+    }
+
+    double bonus = 1.0;
+
+    if (entry.typed) {
+        bonus += 1.0;
+    }
+    if (entry.bookmark) {
+        bonus += 0.75;
+    }
+
+    return qMax(entry.count, 1) * weight * bonus;
+}
+
+// static
+QStringList LocationCompleterIndex::tokenize(const QString &text)
+{
+    QStringList tokens;
+    QString token;
+
+    foreach (const QChar &c, text) {
+        if (c.isLetterOrNumber()) {
+            if (token.length() < maxTokenLength) {
+                token.append(c.toLower());
+            }
+        }
+        else if (!token.isEmpty()) {
+            tokens.append(token);
+            token.clear();
+        }
+    }
+
+    if (!token.isEmpty()) {
+        tokens.append(token);
+    }
+
+    return tokens;
+}
+
+void LocationCompleterIndex::addTypedUrl(const QUrl &url)
+{
+    Change change;
+    change.type = Change::TypedUrl;
+    change.url = url;
+    addChange(change);
+}
+
+void LocationCompleterIndex::addHistoryEntry(const HistoryEntry &entry)
+{
+    Change change;
+    change.type = Change::AddHistoryEntry;
+    change.entry = entry;
+    addChange(change);
+}
+
+void LocationCompleterIndex::removeHistoryEntry(const HistoryEntry &entry)
+{
+    Change change;
+    change.type = Change::RemoveHistoryEntry;
+    change.entry = entry;
+    addChange(change);
+}
+
+void LocationCompleterIndex::clearHistory()
+{
+    Change change;
+    change.type = Change::ClearHistory;
+    addChange(change);
+}
+
+void LocationCompleterIndex::addBookmark(BookmarkItem* item)
+{
+    if (item->isFolder()) {
+        foreach (BookmarkItem* child, item->children()) {
+            addBookmark(child);
+        }
+        return;
+    }
+
+    if (!item->isUrl()) {
+        return;
+    }
+
+    Change change;
+    change.type = Change::AddBookmark;
+    change.bookmark = item;
+    change.url = item->url();
+    change.title = item->title();
+    change.count = item->visitCount();
+    addChange(change);
+}
+
+void LocationCompleterIndex::removeBookmark(BookmarkItem* item)
+{
+    if (item->isFolder()) {
+        foreach (BookmarkItem* child, item->children()) {
+            removeBookmark(child);
+        }
+        return;
+    }
+
+    Change change;
+    change.type = Change::RemoveBookmark;
+    change.bookmark = item;
+    addChange(change);
+}
+
+void LocationCompleterIndex::historyEntryEdited(const HistoryEntry &before, const HistoryEntry &after)
+{
+    if (before.url != after.url) {
+        removeHistoryEntry(before);
+    }
+
+    addHistoryEntry(after);
+}
+
+void LocationCompleterIndex::loadFinished()
+{
+    Data* data = m_loadWatcher->result();
+
+    QWriteLocker locker(&m_lock);
+
+    delete m_data;
+    m_data = data;
+
+    foreach (const Change &change, m_changes) {
+        applyChange(m_data, change);
+    }
+
+    m_changes.clear();
+    m_generation++;
+    m_loaded = true;
+
+    m_loadWatcher->deleteLater();
+    m_loadWatcher = 0;
+}
+
+// static
+LocationCompleterIndex::Data* LocationCompleterIndex::loadData(const QVector<BookmarkData> &bookmarks)
+{
+    Data* data = new Data;
+
+    QSqlQuery query(SqlDatabase::instance()->readDatabase());
+    query.setForwardOnly(true);
+    query.exec(QSL("SELECT id, count, date, url, title FROM history"));
+
+    while (query.next()) {
+        data->setHistoryEntry(query.value(0).toInt(), query.value(3).toUrl(), query.value(4).toString(),
+                              query.value(1).toInt(), query.value(2).toLongLong());
+    }
+
+    foreach (const BookmarkData &bookmark, bookmarks) {
+        data->setBookmark(bookmark.bookmark, bookmark.url, bookmark.title, bookmark.count);
+    }
+
+    return data;
+}
+
+// static
+void LocationCompleterIndex::applyChange(Data* data, const Change &change)
+{
+    switch (change.type) {
+    case Change::TypedUrl:
+        data->setTyped(change.url);
+        break;
+
+    case Change::AddHistoryEntry:
+        data->setHistoryEntry(change.entry.id, change.entry.url, change.entry.title,
+                              change.entry.count, change.entry.date.toMSecsSinceEpoch());
+        break;
+
+    case Change::RemoveHistoryEntry:
+        data->removeHistoryEntry(change.entry.url);
+        break;
+
+    case Change::ClearHistory:
+        data->clearHistory();
+        break;
+
+    case Change::AddBookmark:
+        data->setBookmark(change.bookmark, change.url, change.title, change.count);
+        break;
+
+    case Change::RemoveBookmark:
+        data->removeBookmark(change.bookmark);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void LocationCompleterIndex::addChange(const Change &change)
+{
+    QWriteLocker locker(&m_lock);
+
+    applyChange(m_data, change);
+    m_generation++;
+
+    // Loaded data doesn't contain this change yet
+    if (m_loadWatcher) {
+        m_changes.append(change);
+    }
+}
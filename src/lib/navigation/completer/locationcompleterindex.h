@@ -0,0 +1,153 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#ifndef LOCATIONCOMPLETERINDEX_H
+#define LOCATIONCOMPLETERINDEX_H
+
+#include <QObject>
+#include <QVector>
+#include <QReadWriteLock>
+#include <QUrl>
+
+#include "qzcommon.h"
+#include "history.h"
+
+template <typename T> class QFutureWatcher;
+
+class Bookmarks;
+class BookmarkItem;
+
+// In-memory index of history and bookmarks used by location bar completer.
+// Urls are found by prefixes of words in host, path and title and ranked by frecency.
+// It is loaded from database in background and then kept in sync with history and bookmarks
+class QUPZILLA_EXPORT LocationCompleterIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Source {
+        SearchHistory = 1,
+        SearchBookmarks = 2,
+        SearchAll = SearchHistory | SearchBookmarks
+    };
+
+    struct Entry {
+        int id;                 // History id, -1 if url is only bookmarked
+        QUrl url;
+        QString title;
+        int count;
+        qint64 lastVisit;
+        bool typed;
+        BookmarkItem* bookmark; // 0 if url is not bookmarked
+    };
+
+    // Records matching the last search string. When the search string is extended,
+    // only these are searched again
+    struct Candidates {
+        Candidates() : sources(0), generation(-1) { }
+
+        QString searchString;
+        int sources;
+        int generation;
+        QVector<int> records;
+    };
+
+    explicit LocationCompleterIndex(QObject* parent = 0);
+    ~LocationCompleterIndex();
+
+    // Loads history from database in background, then follows changes of history and bookmarks
+    void load(History* history, Bookmarks* bookmarks);
+    bool isLoaded() const;
+
+    // Following functions can be called from any thread
+
+    // Entries matching all words of search string, ordered by frecency.
+    // Candidates of previous search are used and updated if not null
+    QVector<Entry> complete(const QString &searchString, int limit, int sources = SearchAll, Candidates* candidates = 0) const;
+    QVector<Entry> mostFrecent(int limit, int sources = SearchAll) const;
+
+    // Host of http(s) url starting with text, empty if none
+    QString completeDomain(const QString &text) const;
+
+    // Firefox-style frecency: visit count weighted by age of last visit,
+    // with bonus for typed and bookmarked urls
+    static double frecency(const Entry &entry, qint64 now);
+
+    // Splits text to lowercase words
+    static QStringList tokenize(const QString &text);
+
+public slots:
+    void addTypedUrl(const QUrl &url);
+
+    void addHistoryEntry(const HistoryEntry &entry);
+    void removeHistoryEntry(const HistoryEntry &entry);
+    void clearHistory();
+
+    void addBookmark(BookmarkItem* item);
+    void removeBookmark(BookmarkItem* item);
+
+private slots:
+    void historyEntryEdited(const HistoryEntry &before, const HistoryEntry &after);
+    void loadFinished();
+
+private:
+    class Data;
+
+    struct Change {
+        Change() : bookmark(0), count(0) { }
+
+        enum Type {
+            TypedUrl,
+            AddHistoryEntry,
+            RemoveHistoryEntry,
+            ClearHistory,
+            AddBookmark,
+            RemoveBookmark
+        };
+
+        Type type;
+        QUrl url;
+        HistoryEntry entry;
+        BookmarkItem* bookmark;
+        QString title;
+        int count;
+    };
+
+    struct BookmarkData {
+        BookmarkItem* bookmark;
+        QUrl url;
+        QString title;
+        int count;
+    };
+
+    static Data* loadData(const QVector<BookmarkData> &bookmarks);
+    static void applyChange(Data* data, const Change &change);
+    void addChange(const Change &change);
+
+    mutable QReadWriteLock m_lock;
+    Data* m_data;
+    // Changed with each change of data, candidates of older generation are not valid
+    int m_generation;
+
+    bool m_loaded;
+
+    // Changes done while loading are applied again to loaded data
+    QVector<Change> m_changes;
+    QFutureWatcher<Data*>* m_loadWatcher;
+};
+
+#endif // LOCATIONCOMPLETERINDEX_H
@@ -29,23 +29,36 @@
 LocationCompleterModel::LocationCompleterModel(QObject* parent)
     : QStandardItemModel(parent)
 {
+    connect(IconProvider::instance(), SIGNAL(imageLoaded(QUrl,QImage)), this, SLOT(iconLoaded(QUrl,QImage)));
 }
 
 void LocationCompleterModel::setCompletions(const QList<QStandardItem*> &items)
 {
     foreach (QStandardItem* item, items) {
-        item->setIcon(QPixmap::fromImage(item->data(ImageRole).value<QImage>()));
-        setTabPosition(item);
-
-        if (item->icon().isNull()) {
-            item->setIcon(IconProvider::emptyWebIcon());
+        QImage image = item->data(ImageRole).value<QImage>();
+        if (image.isNull()) {
+            image = IconProvider::instance()->cachedImageForUrl(item->data(UrlRole).toUrl());
         }
+
+        item->setIcon(image.isNull() ? IconProvider::emptyWebIcon() : QIcon(QPixmap::fromImage(image)));
+        setTabPosition(item);
     }
 
     clear();
     appendColumn(items);
 }
 
+void LocationCompleterModel::iconLoaded(const QUrl &url, const QImage &image)
+{
+    for (int i = 0; i < rowCount(); ++i) {
+        QStandardItem* itm = item(i);
+        if (itm->data(UrlRole).toUrl() == url) {
+            itm->setData(image, ImageRole);
+            itm->setIcon(QPixmap::fromImage(image));
+        }
+    }
+}
+
 QSqlQuery LocationCompleterModel::createDomainQuery(const QString &text)
 {
     if (text.isEmpty() || text == QLatin1String("www.")) {
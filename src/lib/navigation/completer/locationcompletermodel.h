@@ -24,9 +24,11 @@
 
 class QSqlQuery;
 class QUrl;
+class QImage;
 
 class LocationCompleterModel : public QStandardItemModel
 {
+    Q_OBJECT
 public:
     enum Role {
         IdRole = Qt::UserRole + 1,
@@ -48,6 +50,9 @@ public:
     static QSqlQuery createHistoryQuery(const QString &searchString, int limit, bool exactMatch = false);
     static QSqlQuery createDomainQuery(const QString &text);
 
+private slots:
+    void iconLoaded(const QUrl &url, const QImage &image);
+
 private:
     enum Type {
         HistoryAndBookmarks = 0,
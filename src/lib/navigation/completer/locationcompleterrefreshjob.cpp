@@ -17,6 +17,7 @@
 * ============================================================ */
 #include "locationcompleterrefreshjob.h"
 #include "locationcompletermodel.h"
+#include "locationcompleterindex.h"
 #include "mainapplication.h"
 #include "bookmarkitem.h"
 #include "iconprovider.h"
@@ -31,10 +32,12 @@
 
 #include <QtConcurrent/QtConcurrentRun>
 
-LocationCompleterRefreshJob::LocationCompleterRefreshJob(const QString &searchString)
+LocationCompleterRefreshJob::LocationCompleterRefreshJob(const QString &searchString, const Session &session)
     : QObject()
     , m_timestamp(QDateTime::currentMSecsSinceEpoch())
     , m_searchString(searchString)
+    , m_session(session)
+    , m_index(mApp->locationCompleterIndex())
     , m_jobCancelled(false)
 {
     m_watcher = new QFutureWatcher<void>(this);
@@ -64,9 +67,22 @@ QString LocationCompleterRefreshJob::domainCompletion() const
     return m_domainCompletion;
 }
 
+LocationCompleterRefreshJob::Session LocationCompleterRefreshJob::session() const
+{
+    return m_session;
+}
+
+bool LocationCompleterRefreshJob::isCancelled() const
+{
+    return m_jobCancelled;
+}
+
 void LocationCompleterRefreshJob::jobCancelled()
 {
     m_jobCancelled = true;
+
+    // Job that didn't start yet is not run at all
+    m_watcher->cancel();
 }
 
 void LocationCompleterRefreshJob::slotFinished()
@@ -87,25 +103,57 @@ void LocationCompleterRefreshJob::runJob()
         return;
     }
 
+    // Database is queried only until the index is loaded
+    const bool indexLoaded = m_index->isLoaded();
+
     if (m_searchString.isEmpty()) {
         completeMostVisited();
     }
+    else if (indexLoaded) {
+        completeFromIndex();
+    }
     else {
         completeFromHistory();
     }
 
-    // Load all icons into QImage
+    // Load all icons into QImage with one query, icons of previous job are reused.
+    // Icons not saved in database yet are set by model from IconProvider
+    QList<QUrl> urls;
     foreach (QStandardItem* item, m_items) {
-        if (m_jobCancelled) {
-            return;
+        const QUrl url = item->data(LocationCompleterModel::UrlRole).toUrl();
+        if (!m_session.images.contains(url)) {
+            urls.append(url);
         }
+    }
 
+    const QHash<QUrl, QImage> loadedImages = urls.isEmpty() ? QHash<QUrl, QImage>() : IconProvider::imagesForUrls(urls);
+
+    if (m_jobCancelled) {
+        return;
+    }
+
+    QHash<QUrl, QImage> images;
+
+    foreach (QStandardItem* item, m_items) {
         const QUrl url = item->data(LocationCompleterModel::UrlRole).toUrl();
-        item->setData(IconProvider::imageForUrl(url), LocationCompleterModel::ImageRole);
+        const QImage image = m_session.images.contains(url) ? m_session.images.value(url) : loadedImages.value(url);
+
+        item->setData(image, LocationCompleterModel::ImageRole);
+        images.insert(url, image);
     }
 
+    m_session.images = images;
+
     // Get domain completion
     if (!m_searchString.isEmpty() && qzSettings->useInlineCompletion) {
+        if (indexLoaded) {
+            const QString domain = m_index->completeDomain(m_searchString);
+            if (!domain.isEmpty()) {
+                m_domainCompletion = createDomainCompletion(domain);
+            }
+            return;
+        }
+
         QSqlQuery domainQuery = LocationCompleterModel::createDomainQuery(m_searchString);
         if (domainQuery.lastQuery().isEmpty()) {
             return;
@@ -118,6 +166,44 @@ void LocationCompleterRefreshJob::runJob()
     }
 }
 
+void LocationCompleterRefreshJob::completeFromIndex()
+{
+    Type showType = (Type) qzSettings->showLocationSuggestions;
+    int sources = 0;
+
+    if (showType == HistoryAndBookmarks || showType == History) {
+        sources |= LocationCompleterIndex::SearchHistory;
+    }
+    if (showType == HistoryAndBookmarks || showType == Bookmarks) {
+        sources |= LocationCompleterIndex::SearchBookmarks;
+    }
+
+    if (!sources) {
+        return;
+    }
+
+    const int limit = 30;
+    const QVector<LocationCompleterIndex::Entry> entries = m_index->complete(m_searchString, limit, sources, &m_session.candidates);
+
+    foreach (const LocationCompleterIndex::Entry &entry, entries) {
+        const bool bookmark = entry.bookmark && (sources & LocationCompleterIndex::SearchBookmarks);
+
+        QStandardItem* item = new QStandardItem();
+        item->setText(entry.url.toEncoded());
+        item->setData(bookmark ? -1 : entry.id, LocationCompleterModel::IdRole);
+        item->setData(entry.title, LocationCompleterModel::TitleRole);
+        item->setData(entry.url, LocationCompleterModel::UrlRole);
+        item->setData(entry.count, LocationCompleterModel::CountRole);
+        item->setData(QVariant(bookmark), LocationCompleterModel::BookmarkRole);
+        if (bookmark) {
+            item->setData(QVariant::fromValue<void*>(static_cast<void*>(entry.bookmark)), LocationCompleterModel::BookmarkItemRole);
+        }
+        item->setData(m_searchString, LocationCompleterModel::SearchStringRole);
+
+        m_items.append(item);
+    }
+}
+
 void LocationCompleterRefreshJob::completeFromHistory()
 {
     QList<QUrl> urlList;
@@ -150,6 +236,10 @@ void LocationCompleterRefreshJob::completeFromHistory()
     std::sort(m_items.begin(), m_items.end(), countBiggerThan);
 
     // Search in history
+    if (m_jobCancelled) {
+        return;
+    }
+
     if (showType == HistoryAndBookmarks || showType == History) {
         const int historyLimit = 20;
         QSqlQuery query = LocationCompleterModel::createHistoryQuery(m_searchString, historyLimit);
@@ -178,6 +268,23 @@ void LocationCompleterRefreshJob::completeFromHistory()
 
 void LocationCompleterRefreshJob::completeMostVisited()
 {
+    if (m_index->isLoaded()) {
+        const QVector<LocationCompleterIndex::Entry> entries = m_index->mostFrecent(15, LocationCompleterIndex::SearchHistory);
+
+        foreach (const LocationCompleterIndex::Entry &entry, entries) {
+            QStandardItem* item = new QStandardItem();
+
+            item->setText(entry.url.toEncoded());
+            item->setData(entry.id, LocationCompleterModel::IdRole);
+            item->setData(entry.title, LocationCompleterModel::TitleRole);
+            item->setData(entry.url, LocationCompleterModel::UrlRole);
+            item->setData(QVariant(false), LocationCompleterModel::BookmarkRole);
+
+            m_items.append(item);
+        }
+        return;
+    }
+
     QSqlQuery query(QSL("SELECT id, url, title FROM history ORDER BY count DESC LIMIT 15"));
     SqlDatabase::instance()->exec(query);
 
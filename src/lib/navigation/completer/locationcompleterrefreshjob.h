@@ -19,8 +19,12 @@
 #define LOCATIONCOMPLETERREFRESHJOB_H
 
 #include <QFutureWatcher>
+#include <QImage>
+#include <QHash>
+#include <QUrl>
 
 #include "qzcommon.h"
+#include "locationcompleterindex.h"
 
 class QStandardItem;
 
@@ -29,7 +33,13 @@ class QUPZILLA_EXPORT LocationCompleterRefreshJob : public QObject
     Q_OBJECT
 
 public:
-    explicit LocationCompleterRefreshJob(const QString &searchString);
+    // Data of previous job in this completion session, reused by the next job
+    struct Session {
+        LocationCompleterIndex::Candidates candidates;
+        QHash<QUrl, QImage> images;
+    };
+
+    explicit LocationCompleterRefreshJob(const QString &searchString, const Session &session = Session());
 
     // Timestamp when the job was created
     qint64 timestamp() const;
@@ -38,6 +48,9 @@ public:
     QList<QStandardItem*> completions() const;
     QString domainCompletion() const;
 
+    Session session() const;
+    bool isCancelled() const;
+
 signals:
     void finished();
 
@@ -54,6 +67,7 @@ private:
     };
 
     void runJob();
+    void completeFromIndex();
     void completeFromHistory();
     void completeMostVisited();
 
@@ -63,7 +77,9 @@ private:
     QString m_searchString;
     QString m_domainCompletion;
     QList<QStandardItem*> m_items;
+    Session m_session;
     QFutureWatcher<void>* m_watcher;
+    LocationCompleterIndex* m_index;
     bool m_jobCancelled;
 };
 
@@ -35,6 +35,7 @@
 #include "autofillicon.h"
 #include "searchenginesmanager.h"
 #include "completer/locationcompleter.h"
+#include "completer/locationcompleterindex.h"
 
 #include <QTimer>
 #include <QMimeData>
@@ -293,6 +294,9 @@ void LocationBar::requestLoadUrl()
         setText(urlString);
     }
 
+    // Typed urls are ranked higher in completer
+    mApp->locationCompleterIndex()->addTypedUrl(req.url());
+
     m_webView->userLoadAction(req);
 }
 
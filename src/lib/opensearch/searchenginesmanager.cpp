@@ -26,6 +26,7 @@
 #include "settings.h"
 #include "qzsettings.h"
 #include "webview.h"
+#include "sqldatabase.h"
 
 #include <QNetworkReply>
 #include <QMessageBox>
@@ -453,7 +454,7 @@ void SearchEnginesManager::removeEngine(const Engine &engine)
     query.prepare("DELETE FROM search_engines WHERE name=? AND url=?");
     query.bindValue(0, engine.name);
     query.bindValue(1, engine.url);
-    query.exec();
+    SqlDatabase::instance()->execAsync(query);
 
     m_allEngines.remove(index);
     emit enginesChanged();
@@ -493,19 +494,26 @@ void SearchEnginesManager::saveSettings()
     //
     // But as long as user is not playing with search engines every run it is acceptable.
 
-    QSqlQuery query;
-    query.exec("DELETE FROM search_engines");
-
+    // Icons can be converted only on main thread
+    QVector<QVariantList> rows;
     foreach (const Engine &en, m_allEngines) {
-        query.prepare("INSERT INTO search_engines (name, icon, url, shortcut, suggestionsUrl, suggestionsParameters, postData) VALUES (?, ?, ?, ?, ?, ?, ?)");
-        query.addBindValue(en.name);
-        query.addBindValue(iconToBase64(en.icon));
-        query.addBindValue(en.url);
-        query.addBindValue(en.shortcut);
-        query.addBindValue(en.suggestionsUrl);
-        query.addBindValue(en.suggestionsParameters);
-        query.addBindValue(en.postData);
-
-        query.exec();
+        rows.append(QVariantList() << en.name << iconToBase64(en.icon) << en.url << en.shortcut
+                    << en.suggestionsUrl << en.suggestionsParameters << en.postData);
     }
+
+    SqlDatabase::instance()->runOnWriter<bool>([rows](QSqlDatabase &db) {
+        QSqlQuery query(db);
+        query.exec("DELETE FROM search_engines");
+
+        foreach (const QVariantList &row, rows) {
+            query.prepare("INSERT INTO search_engines (name, icon, url, shortcut, suggestionsUrl, suggestionsParameters, postData) VALUES (?, ?, ?, ?, ?, ?, ?)");
+            foreach (const QVariant &value, row) {
+                query.addBindValue(value);
+            }
+
+            query.exec();
+        }
+
+        return true;
+    });
 }
@@ -27,6 +27,7 @@
 #include "ui_clearprivatedata.h"
 #include "iconprovider.h"
 #include "qztools.h"
+#include "sqldatabase.h"
 #include "cookiemanager.h"
 #include "desktopnotificationsfactory.h"
 
@@ -166,6 +167,10 @@ void ClearPrivateData::optimizeDb()
 
     IconProvider::instance()->clearOldIconsInDatabase();
 
+    // Rebuilding database blocks other writers, so it is only done on user request
+    SqlDatabase::instance()->optimize(true);
+    SqlDatabase::instance()->waitForWrites();
+
     QString sizeAfter = QzTools::fileSizeToString(QFileInfo(profilePath + "/browsedata.db").size());
 
     mApp->restoreOverrideCursor();
@@ -23,6 +23,7 @@
 #include "mainapplication.h"
 #include "settings.h"
 #include "qztools.h"
+#include "sqldatabase.h"
 
 #include <QUrl>
 #include <QMenu>
@@ -278,7 +279,7 @@ void AutoFillManager::removeExcept()
     QSqlQuery query;
     query.prepare("DELETE FROM autofill_exceptions WHERE id=?");
     query.addBindValue(id);
-    query.exec();
+    SqlDatabase::instance()->execAsync(query);
 
     delete curItem;
 }
@@ -286,7 +287,8 @@ void AutoFillManager::removeExcept()
 void AutoFillManager::removeAllExcept()
 {
     QSqlQuery query;
-    query.exec("DELETE FROM autofill_exceptions");
+    query.prepare("DELETE FROM autofill_exceptions");
+    SqlDatabase::instance()->execAsync(query);
 
     ui->treeExcept->clear();
 }
@@ -25,11 +25,16 @@
 
 #include <QTimer>
 #include <QBuffer>
+#include <QDebug>
+#include <QSqlError>
 #include <QFutureWatcher>
 #include <QtConcurrent/QtConcurrentRun>
 
 Q_GLOBAL_STATIC(IconProvider, qz_icon_provider)
 
+// SQLite allows at most 999 bound values, each url is bound twice
+static const int maxImagesBatch = 200;
+
 static QByteArray encodeUrl(const QUrl &url)
 {
     return url.toEncoded(QUrl::RemoveFragment | QUrl::StripTrailingSlash);
@@ -37,9 +42,13 @@ static QByteArray encodeUrl(const QUrl &url)
 
 IconProvider::IconProvider()
     : QWidget()
+    , m_imageCache(2000)
 {
     m_autoSaver = new AutoSaver(this);
     connect(m_autoSaver, SIGNAL(save()), this, SLOT(saveIconsToDatabase()));
+
+    m_imagesWatcher = new QFutureWatcher<QHash<QUrl, QImage> >(this);
+    connect(m_imagesWatcher, SIGNAL(finished()), this, SLOT(requestedImagesLoaded()));
 }
 
 void IconProvider::saveIcon(WebView* view)
@@ -77,6 +86,8 @@ void IconProvider::saveIcon(WebView* view)
 
     m_autoSaver->changeOccurred();
     m_iconBuffer.append(item);
+
+    m_imageCache.insert(encodeUrl(item.first), new QImage(item.second));
 }
 
 QIcon IconProvider::bookmarkIcon() const
@@ -234,6 +245,87 @@ QImage IconProvider::imageForDomain(const QUrl &url, bool allowNull)
     return allowNull ? QImage() : IconProvider::emptyWebImage();
 }
 
+QHash<QUrl, QImage> IconProvider::imagesForUrls(const QList<QUrl> &urls)
+{
+    QHash<QUrl, QImage> images;
+    QMultiHash<QByteArray, QUrl> encodedUrls;
+
+    foreach (const QUrl &url, urls) {
+        if (!url.path().isEmpty()) {
+            encodedUrls.insert(encodeUrl(url), url);
+        }
+    }
+
+    if (encodedUrls.isEmpty()) {
+        return images;
+    }
+
+    const QList<QByteArray> keys = encodedUrls.uniqueKeys();
+
+    QStringList placeholders;
+    for (int i = 0; i < keys.count() * 2; ++i) {
+        placeholders.append(QSL("?"));
+    }
+
+    // Urls are saved both as text and as blob, binding both types lets the lookup use url index
+    QSqlQuery query(SqlDatabase::instance()->readDatabase());
+    query.prepare(QSL("SELECT url, icon FROM icons WHERE url IN (%1)").arg(placeholders.join(QL1C(','))));
+
+    foreach (const QByteArray &key, keys) {
+        query.addBindValue(key);
+        query.addBindValue(QString::fromUtf8(key));
+    }
+
+    if (!query.exec()) {
+        qWarning() << "IconProvider::" << __FUNCTION__ << query.lastError().text();
+        return images;
+    }
+
+    while (query.next()) {
+        const QImage image = QImage::fromData(query.value(1).toByteArray());
+        if (image.isNull()) {
+            continue;
+        }
+
+        foreach (const QUrl &url, encodedUrls.values(query.value(0).toByteArray())) {
+            images.insert(url, image);
+        }
+    }
+
+    return images;
+}
+
+QImage IconProvider::cachedImageForUrl(const QUrl &url)
+{
+    if (url.path().isEmpty()) {
+        return emptyWebImage();
+    }
+
+    const QByteArray encodedUrl = encodeUrl(url);
+
+    if (QImage* image = m_imageCache.object(encodedUrl)) {
+        return *image;
+    }
+
+    foreach (const BufferedIcon &ic, m_iconBuffer) {
+        if (encodeUrl(ic.first) == encodedUrl) {
+            return ic.second;
+        }
+    }
+
+    if (!m_requestedKeys.contains(encodedUrl)) {
+        m_requestedKeys.insert(encodedUrl);
+        m_requestedUrls.append(url);
+
+        // All urls requested while painting are loaded together
+        if (m_requestedUrls.count() == 1) {
+            QTimer::singleShot(0, this, SLOT(loadRequestedImages()));
+        }
+    }
+
+    return QImage();
+}
+
 IconProvider* IconProvider::instance()
 {
     return qz_icon_provider();
@@ -275,10 +367,51 @@ void IconProvider::clearOldIconsInDatabase()
     QSqlQuery query;
     query.prepare(QSL("DELETE FROM icons WHERE url IN (SELECT url FROM history WHERE date < ?)"));
     query.addBindValue(date.toMSecsSinceEpoch());
-    query.exec();
+    SqlDatabase::instance()->execAsync(query);
+
+    // Freed pages are reclaimed after the delete is committed
+    SqlDatabase::instance()->optimize();
+
+    m_imageCache.clear();
+}
+
+void IconProvider::loadRequestedImages()
+{
+    // Only one batch is loaded at once, the rest is loaded when it finishes
+    if (m_imagesWatcher->isRunning() || m_requestedUrls.isEmpty()) {
+        return;
+    }
+
+    m_loadingUrls = m_requestedUrls.mid(0, maxImagesBatch);
+    m_requestedUrls = m_requestedUrls.mid(maxImagesBatch);
+
+    m_imagesWatcher->setFuture(QtConcurrent::run(&IconProvider::imagesForUrls, m_loadingUrls));
+}
+
+void IconProvider::requestedImagesLoaded()
+{
+    const QHash<QUrl, QImage> images = m_imagesWatcher->result();
+    const QList<QUrl> urls = m_loadingUrls;
+    m_loadingUrls.clear();
+
+    foreach (const QUrl &url, urls) {
+        const QByteArray encodedUrl = encodeUrl(url);
+        m_requestedKeys.remove(encodedUrl);
+
+        // Icon may have been saved while loading
+        QImage image;
+        if (QImage* cached = m_imageCache.object(encodedUrl)) {
+            image = *cached;
+        }
+        else {
+            image = images.value(url, emptyWebImage());
+            m_imageCache.insert(encodedUrl, new QImage(image));
+        }
+
+        emit imageLoaded(url, image);
+    }
 
-    query.clear();
-    query.exec(QSL("VACUUM"));
+    loadRequestedImages();
 }
 
 QIcon IconProvider::iconFromImage(const QImage &image)
@@ -21,6 +21,9 @@
 #include <QWidget>
 #include <QStyle>
 #include <QImage>
+#include <QCache>
+#include <QHash>
+#include <QSet>
 #include <QUrl>
 
 #include <functional>
@@ -32,6 +35,8 @@ class QIcon;
 class WebView;
 class AutoSaver;
 
+template <typename T> class QFutureWatcher;
+
 // Needs to be QWidget subclass, otherwise qproperty- setting won't work
 class QUPZILLA_EXPORT IconProvider : public QWidget
 {
@@ -66,12 +71,28 @@ public:
     static QIcon iconForDomain(const QUrl &url, bool allowNull = false);
     static QImage imageForDomain(const QUrl &url, bool allowNull = false);
 
+    // Icons for all urls loaded with one query, urls without icon are not in result.
+    // Can be called from any thread, unsaved icons are not included
+    static QHash<QUrl, QImage> imagesForUrls(const QList<QUrl> &urls);
+
+    // Returns null image if icon for url is not loaded yet, it is then loaded in background
+    // together with other requested urls and imageLoaded() is emitted.
+    // Urls without icon are loaded as emptyWebImage()
+    QImage cachedImageForUrl(const QUrl &url);
+
     static IconProvider* instance();
 
+signals:
+    void imageLoaded(const QUrl &url, const QImage &image);
+
 public slots:
     void saveIconsToDatabase();
     void clearOldIconsInDatabase();
 
+private slots:
+    void loadRequestedImages();
+    void requestedImagesLoaded();
+
 private:
     typedef QPair<QUrl, QImage> BufferedIcon;
 
@@ -82,6 +103,12 @@ private:
     QVector<BufferedIcon> m_iconBuffer;
 
     AutoSaver* m_autoSaver;
+
+    QCache<QByteArray, QImage> m_imageCache;
+    QList<QUrl> m_requestedUrls;
+    QSet<QByteArray> m_requestedKeys;
+    QList<QUrl> m_loadingUrls;
+    QFutureWatcher<QHash<QUrl, QImage> >* m_imagesWatcher;
 };
 
 #endif // ICONPROVIDER_H
@@ -217,6 +217,14 @@ QString QzTools::escapeSqlGlobString(QString urlString)
     return urlString;
 }
 
+QString QzTools::escapeSqlLikeString(QString string)
+{
+    string.replace(QL1C('\\'), QStringLiteral("\\\\"));
+    string.replace(QL1C('%'), QStringLiteral("\\%"));
+    string.replace(QL1C('_'), QStringLiteral("\\_"));
+    return string;
+}
+
 QString QzTools::ensureUniqueFilename(const QString &name, const QString &appendFormat)
 {
     Q_ASSERT(appendFormat.contains(QL1S("%1")));
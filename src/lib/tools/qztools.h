@@ -50,6 +50,8 @@ public:
     static QString urlEncodeQueryString(const QUrl &url);
     static QString fromPunycode(const QString &str);
     static QString escapeSqlGlobString(QString urlString);
+    // Escape character is backslash
+    static QString escapeSqlLikeString(QString string);
 
     static QString ensureUniqueFilename(const QString &name, const QString &appendFormat = QString("(%1)"));
     static QString getFileNameFromUrl(const QUrl &url);
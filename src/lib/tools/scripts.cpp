@@ -142,6 +142,67 @@ QString Scripts::setCss(const QString &css)
     return source.arg(style);
 }
 
+// Intended for QWebEngineScript::DocumentCreation, when there may not be any element yet
+QString Scripts::setCssOnCreation(const QString &css, const QString &styleId, const QStringList &excludedSchemes)
+{
+    QString source = QL1S("(function() {"
+                          "var schemes = [%3];"
+                          "if (schemes.indexOf(location.protocol.slice(0, -1)) != -1) return;"
+                          "if (window['%2_disabled']) return;"
+                          "var css = document.createElement('style');"
+                          "css.setAttribute('type', 'text/css');"
+                          "css.setAttribute('id', '%2');"
+                          "css.appendChild(document.createTextNode('%1'));"
+                          "function insert() {"
+                          "    if (window['%2_disabled']) return;"
+                          "    (document.head || document.documentElement).appendChild(css);"
+                          "}"
+                          "if (document.documentElement) {"
+                          "    insert();"
+                          "    return;"
+                          "}"
+                          "var observer = new MutationObserver(function() {"
+                          "    if (!document.documentElement) return;"
+                          "    observer.disconnect();"
+                          "    insert();"
+                          "});"
+                          "observer.observe(document, {childList: true});"
+                          "})()");
+
+    QString style = css;
+    style.replace(QL1S("'"), QL1S("\\'"));
+    style.replace(QL1S("\n"), QL1S("\\n"));
+
+    QStringList schemes;
+    foreach (const QString &scheme, excludedSchemes) {
+        schemes.append(QL1C('\'') + scheme + QL1C('\''));
+    }
+
+    return source.arg(style, styleId, schemes.join(QL1C(',')));
+}
+
+// Works regardless of whether it runs before or after setCssOnCreation() script
+QString Scripts::disableCssOnCreation(const QString &styleId)
+{
+    QString source = QL1S("(function() {"
+                          "window['%1_disabled'] = true;"
+                          "var css = document.getElementById('%1');"
+                          "if (css) css.parentNode.removeChild(css);"
+                          "})()");
+
+    return source.arg(styleId);
+}
+
+QString Scripts::removeCss(const QString &styleId)
+{
+    QString source = QL1S("(function() {"
+                          "var css = document.getElementById('%1');"
+                          "if (css) css.parentNode.removeChild(css);"
+                          "})()");
+
+    return source.arg(styleId);
+}
+
 QString Scripts::sendPostData(const QUrl &url, const QByteArray &data)
 {
     QString source = QL1S("(function() {"
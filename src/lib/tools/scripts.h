@@ -20,6 +20,7 @@
 #define SCRIPTS_H
 
 #include <QString>
+#include <QStringList>
 
 #include "qzcommon.h"
 
@@ -32,6 +33,9 @@ public:
     static QString setupFormObserver();
 
     static QString setCss(const QString &css);
+    static QString setCssOnCreation(const QString &css, const QString &styleId, const QStringList &excludedSchemes);
+    static QString disableCssOnCreation(const QString &styleId);
+    static QString removeCss(const QString &styleId);
     static QString sendPostData(const QUrl &url, const QByteArray &data);
     static QString completeFormData(const QByteArray &data);
     static QString getOpenSearchLinks();
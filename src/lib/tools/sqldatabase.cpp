@@ -18,66 +18,534 @@
 #include "sqldatabase.h"
 
 #include <QThread>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlRecord>
+#include <QSqlResult>
 #include <QMutexLocker>
-#include <QApplication>
-
-#include <QtConcurrent/QtConcurrentRun>
 
 Q_GLOBAL_STATIC(SqlDatabase, qz_sql_database)
 
+// Writers wait when the queue is full
+static const int maxQueuedWrites = 1000;
+// Writes committed in one transaction
+static const int maxBatchedWrites = 100;
+// Prepared statements kept for each connection
+static const int maxCachedStatements = 32;
+// Interval of log checkpoints done by writer thread (ms)
+static const int checkpointInterval = 30 * 1000;
+// Free pages are reclaimed only when there are at least this many of them
+static const int minFreePages = 256;
+// Pages reclaimed in one transaction, writer lock is held only for one step
+static const int incrementalVacuumPages = 128;
+
+static bool isReadQuery(const QString &query)
+{
+    return query.trimmed().startsWith(QL1S("SELECT"), Qt::CaseInsensitive);
+}
+
+// Connection with cache of prepared statements, used only from the thread it was created in
+class SqlConnection
+{
+public:
+    explicit SqlConnection(const QString &name, const QString &databaseName, const QString &connectOptions, int generation)
+        : m_name(name)
+        , m_generation(generation)
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QSL("QSQLITE"), m_name);
+        db.setDatabaseName(databaseName);
+        db.setConnectOptions(connectOptions);
+
+        if (!db.open()) {
+            qWarning() << "SqlConnection::" << __FUNCTION__ << "Cannot open database:" << db.lastError().text();
+        }
+        else {
+            SqlDatabase::setupConnection(db);
+        }
+
+        m_statements.setMaxCost(maxCachedStatements);
+    }
+
+    ~SqlConnection()
+    {
+        m_statements.clear();
+
+        QSqlDatabase::database(m_name, false).close();
+        QSqlDatabase::removeDatabase(m_name);
+    }
+
+    int generation() const
+    {
+        return m_generation;
+    }
+
+    QSqlDatabase database() const
+    {
+        return QSqlDatabase::database(m_name, false);
+    }
+
+    QSqlQuery* statement(const QString &query)
+    {
+        QSqlQuery* statement = m_statements.object(query);
+
+        if (!statement) {
+            statement = new QSqlQuery(database());
+            statement->prepare(query);
+            m_statements.insert(query, statement);
+        }
+
+        return statement;
+    }
+
+private:
+    QString m_name;
+    int m_generation;
+    QCache<QString, QSqlQuery> m_statements;
+};
+
+class SqlWriterThread : public QThread
+{
+public:
+    explicit SqlWriterThread(SqlDatabase* database)
+        : QThread()
+        , m_database(database)
+    {
+    }
+
+protected:
+    void run()
+    {
+        m_database->runWriter();
+    }
+
+private:
+    SqlDatabase* m_database;
+};
+
+static int pragmaValue(QSqlDatabase &db, const QString &pragma)
+{
+    QSqlQuery query(db);
+    query.exec(QSL("PRAGMA %1").arg(pragma));
+    return query.next() ? query.value(0).toInt() : 0;
+}
+
+// Result copied from executed statement, so the statement can be reset right away
+// and callers never share state of the cached statement
+class SqlRowsResult : public QSqlResult
+{
+public:
+    explicit SqlRowsResult(QSqlQuery* statement)
+        : QSqlResult(statement->driver())
+        , m_record(statement->record())
+        , m_numRowsAffected(statement->isSelect() ? 0 : statement->numRowsAffected())
+        , m_lastInsertId(statement->lastInsertId())
+    {
+        while (statement->isSelect() && statement->next()) {
+            QVector<QVariant> row(m_record.count());
+            for (int i = 0; i < row.count(); ++i) {
+                row[i] = statement->value(i);
+            }
+            m_rows.append(row);
+        }
+
+        setQuery(statement->lastQuery());
+        setSelect(statement->isSelect());
+        setActive(statement->isActive());
+        setLastError(statement->lastError());
+        setAt(QSql::BeforeFirstRow);
+    }
+
+protected:
+    QVariant data(int i)
+    {
+        return m_rows.at(at()).value(i);
+    }
+
+    bool isNull(int i)
+    {
+        return data(i).isNull();
+    }
+
+    bool reset(const QString &)
+    {
+        return false;
+    }
+
+    bool fetch(int i)
+    {
+        if (i < 0 || i >= m_rows.count()) {
+            return false;
+        }
+
+        setAt(i);
+        return true;
+    }
+
+    bool fetchFirst()
+    {
+        return fetch(0);
+    }
+
+    bool fetchLast()
+    {
+        return fetch(m_rows.count() - 1);
+    }
+
+    int size()
+    {
+        return m_rows.count();
+    }
+
+    int numRowsAffected()
+    {
+        return m_numRowsAffected;
+    }
+
+    QVariant lastInsertId() const
+    {
+        return m_lastInsertId;
+    }
+
+    QSqlRecord record() const
+    {
+        return m_record;
+    }
+
+private:
+    QSqlRecord m_record;
+    QVector<QVector<QVariant> > m_rows;
+    int m_numRowsAffected;
+    QVariant m_lastInsertId;
+};
+
+static QSqlQuery execStatement(QSqlQuery* statement, const QList<QVariant> &values)
+{
+    for (int i = 0; i < values.count(); ++i) {
+        statement->bindValue(i, values.at(i));
+    }
+
+    statement->exec();
+
+    // Statement that was not stepped to the end keeps read transaction open until it is
+    // executed again, which would stop log checkpoints from ever completing
+    QSqlQuery query(new SqlRowsResult(statement));
+    statement->finish();
+    return query;
+}
+
 // SqlDatabase
 SqlDatabase::SqlDatabase(QObject* parent)
     : QObject(parent)
+    , m_generation(0)
+    , m_runningWrites(0)
+    , m_stopping(false)
+    , m_writerThread(0)
+    , m_writerConnection(0)
 {
 }
 
 SqlDatabase::~SqlDatabase()
 {
-    QMutableHashIterator<QThread*, QSqlDatabase> i(m_databases);
-    while (i.hasNext()) {
-        i.next();
-        i.value().close();
+    m_mutex.lock();
+    m_stopping = true;
+    m_writeQueued.wakeAll();
+    m_mutex.unlock();
+
+    // Queued writes are committed before the thread finishes
+    if (m_writerThread) {
+        m_writerThread->wait();
+        delete m_writerThread;
     }
 }
 
-QSqlDatabase SqlDatabase::databaseForThread(QThread* thread)
+void SqlDatabase::setDatabase(const QSqlDatabase &database)
 {
     QMutexLocker lock(&m_mutex);
 
-    if (!m_databases.contains(thread)) {
-        const QString threadStr = QString::number((quintptr) thread);
-        m_databases[thread] = QSqlDatabase::cloneDatabase(QSqlDatabase::database(), QL1S("QupZilla/") + threadStr);
-        m_databases[thread].open();
-    }
-
-    Q_ASSERT(m_databases[thread].isOpen());
+    m_databaseName = database.databaseName();
+    m_connectOptions = database.connectOptions();
+    m_generation++;
+}
 
-    return m_databases[thread];
+QSqlDatabase SqlDatabase::readDatabase()
+{
+    return readConnection()->database();
 }
 
 QSqlQuery SqlDatabase::exec(QSqlQuery &query)
 {
-    if (QThread::currentThread() == qApp->thread()) {
-        query.exec();
-        return query;
+    if (!isReadQuery(query.lastQuery())) {
+        return query = execAsync(query).result();
     }
 
-    QSqlQuery out(databaseForThread(QThread::currentThread()));
-    out.prepare(query.lastQuery());
+    QSqlQuery* statement = readConnection()->statement(query.lastQuery());
 
+    return query = execStatement(statement, query.boundValues().values());
+}
+
+QFuture<QSqlQuery> SqlDatabase::execAsync(const QSqlQuery &query)
+{
+    const QString queryString = query.lastQuery();
     const QList<QVariant> boundValues = query.boundValues().values();
 
-    foreach (const QVariant &variant, boundValues) {
-        out.addBindValue(variant);
+    QFutureInterface<QSqlQuery> interface;
+    interface.reportStarted();
+
+    WriteJob job;
+    job.run = [this, queryString, boundValues, interface](QSqlDatabase &) mutable {
+        const QSqlQuery query = execStatement(m_writerConnection->statement(queryString), boundValues);
+        interface.reportResult(query);
+        return query.isActive();
+    };
+    job.finish = [interface]() mutable {
+        interface.reportFinished();
+    };
+    job.transaction = true;
+
+    queueWrite(job);
+
+    return interface.future();
+}
+
+void SqlDatabase::waitForWrites()
+{
+    QMutexLocker lock(&m_mutex);
+
+    while (!m_writeQueue.isEmpty() || m_runningWrites > 0) {
+        m_writesDone.wait(&m_mutex);
     }
+}
+
+void SqlDatabase::optimize(bool rebuild)
+{
+    WriteJob job;
+    job.run = [this, rebuild](QSqlDatabase &db) {
+        runOptimize(db, rebuild);
+        return true;
+    };
+    job.finish = []() {};
+    job.transaction = false;
 
-    out.exec();
-    return query = out;
+    queueWrite(job);
 }
 
-QFuture<QSqlQuery> SqlDatabase::execAsync(const QSqlQuery &query)
+// static
+void SqlDatabase::setupConnection(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+
+    // Readers don't block writer and never wait for it. Fails for read-only
+    // connections, journal mode is persistent so it is set by any writable one
+    query.exec(QSL("PRAGMA journal_mode=WAL"));
+
+    // In WAL mode commits are still atomic with NORMAL, only the last
+    // transactions may be lost on power failure
+    query.exec(QSL("PRAGMA synchronous=NORMAL"));
+
+    // 8 MiB page cache and 64 MiB memory mapped I/O
+    query.exec(QSL("PRAGMA cache_size=-8192"));
+    query.exec(QSL("PRAGMA mmap_size=67108864"));
+
+    // Log is checkpointed by writer thread, not by the connection that commits
+    query.exec(QSL("PRAGMA wal_autocheckpoint=0"));
+    query.exec(QSL("PRAGMA journal_size_limit=4194304"));
+}
+
+void SqlDatabase::queueWrite(const WriteJob &job)
 {
-    return QtConcurrent::run(this, &SqlDatabase::exec, query);
+    QMutexLocker lock(&m_mutex);
+
+    // Write queued from another write is executed right away in its transaction
+    if (m_writerThread && QThread::currentThread() == m_writerThread && job.transaction) {
+        lock.unlock();
+
+        QSqlDatabase db = m_writerConnection->database();
+        job.run(db);
+        job.finish();
+        return;
+    }
+
+    while (m_writeQueue.count() >= maxQueuedWrites) {
+        m_queueNotFull.wait(&m_mutex);
+    }
+
+    m_writeQueue.enqueue(job);
+    m_writeQueued.wakeOne();
+
+    if (!m_writerThread) {
+        m_writerThread = new SqlWriterThread(this);
+        m_writerThread->start();
+    }
+}
+
+void SqlDatabase::runWriter()
+{
+    QElapsedTimer checkpointTimer;
+    checkpointTimer.start();
+
+    forever {
+        QList<WriteJob> jobs;
+
+        m_mutex.lock();
+
+        // Wakes up also when idle to checkpoint the log
+        if (m_writeQueue.isEmpty() && !m_stopping) {
+            m_writeQueued.wait(&m_mutex, checkpointInterval);
+        }
+
+        if (m_writeQueue.isEmpty() && m_stopping) {
+            m_mutex.unlock();
+            break;
+        }
+
+        // Job that can't run inside transaction is executed alone
+        if (!m_writeQueue.isEmpty() && !m_writeQueue.head().transaction) {
+            jobs.append(m_writeQueue.dequeue());
+        }
+
+        while (!m_writeQueue.isEmpty() && m_writeQueue.head().transaction && jobs.count() < maxBatchedWrites) {
+            jobs.append(m_writeQueue.dequeue());
+        }
+
+        m_runningWrites = jobs.count();
+        m_queueNotFull.wakeAll();
+
+        if (!m_writerConnection || m_writerConnection->generation() != m_generation) {
+            delete m_writerConnection;
+            m_writerConnection = new SqlConnection(QSL("QupZilla/writer"), m_databaseName, m_connectOptions, m_generation);
+        }
+
+        m_mutex.unlock();
+
+        QSqlDatabase db = m_writerConnection->database();
+
+        if (jobs.count() == 1 && !jobs.first().transaction) {
+            jobs.first().run(db);
+        }
+        else if (!jobs.isEmpty()) {
+            db.transaction();
+
+            // Each job has its own savepoint, so failed job is rolled back
+            // alone and the other jobs of the batch are still committed
+            QSqlQuery savepoint(db);
+
+            foreach (const WriteJob &job, jobs) {
+                savepoint.exec(QSL("SAVEPOINT job"));
+
+                if (!job.run(db)) {
+                    savepoint.exec(QSL("ROLLBACK TO job"));
+                }
+
+                // Some errors roll back the whole transaction, following jobs get a new one
+                if (!savepoint.exec(QSL("RELEASE job"))) {
+                    db.transaction();
+                }
+            }
+
+            if (!db.commit()) {
+                qWarning() << "SqlDatabase::" << __FUNCTION__ << "Cannot commit writes:" << db.lastError().text();
+                db.rollback();
+            }
+        }
+
+        foreach (const WriteJob &job, jobs) {
+            job.finish();
+        }
+
+        if (checkpointTimer.elapsed() >= checkpointInterval) {
+            checkpoint(db);
+            checkpointTimer.restart();
+        }
+
+        m_mutex.lock();
+        m_runningWrites = 0;
+        m_writesDone.wakeAll();
+        m_mutex.unlock();
+    }
+
+    delete m_writerConnection;
+    m_writerConnection = 0;
+}
+
+void SqlDatabase::runOptimize(QSqlDatabase &db, bool rebuild)
+{
+    QSqlQuery query(db);
+
+    // Switching to incremental mode needs rebuilding the database, but only once
+    if (pragmaValue(db, QSL("auto_vacuum")) != 2) {
+        if (!rebuild) {
+            checkpoint(db);
+            return;
+        }
+
+        query.exec(QSL("PRAGMA auto_vacuum=INCREMENTAL"));
+
+        if (!query.exec(QSL("VACUUM"))) {
+            qWarning() << "SqlDatabase::" << __FUNCTION__ << "Cannot vacuum database:" << query.lastError().text();
+        }
+    }
+
+    int freePages = pragmaValue(db, QSL("freelist_count"));
+
+    // Statement frees one page each time it is stepped, but exec() steps it only once.
+    // Each step is committed on its own, so other connections can write in between
+    QSqlQuery vacuumQuery(db);
+    vacuumQuery.prepare(QSL("PRAGMA incremental_vacuum"));
+
+    while (freePages >= minFreePages) {
+        db.transaction();
+
+        for (int i = 0; i < incrementalVacuumPages; ++i) {
+            if (!vacuumQuery.exec()) {
+                qWarning() << "SqlDatabase::" << __FUNCTION__ << "Cannot reclaim free pages:" << vacuumQuery.lastError().text();
+                break;
+            }
+        }
+
+        db.commit();
+
+        const int count = pragmaValue(db, QSL("freelist_count"));
+        if (count >= freePages) {
+            break;
+        }
+        freePages = count;
+    }
+
+    checkpoint(db);
+}
+
+void SqlDatabase::checkpoint(QSqlDatabase &db)
+{
+    // Passive checkpoint doesn't wait for readers and writers of other connections
+    QSqlQuery query(db);
+    query.exec(QSL("PRAGMA wal_checkpoint(PASSIVE)"));
+}
+
+SqlConnection* SqlDatabase::readConnection()
+{
+    static QAtomicInt connectionNumber;
+
+    QMutexLocker lock(&m_mutex);
+
+    SqlConnection* connection = m_readConnections.hasLocalData() ? m_readConnections.localData() : 0;
+    if (connection && connection->generation() == m_generation) {
+        return connection;
+    }
+
+    QString connectOptions = m_connectOptions;
+    if (!connectOptions.contains(QL1S("QSQLITE_OPEN_READONLY"))) {
+        connectOptions.append(connectOptions.isEmpty() ? QL1S("QSQLITE_OPEN_READONLY") : QL1S(";QSQLITE_OPEN_READONLY"));
+    }
+
+    const QString name = QSL("QupZilla/reader/%1").arg(connectionNumber.fetchAndAddRelaxed(1));
+
+    // Old connection of this thread is deleted
+    connection = new SqlConnection(name, m_databaseName, connectOptions, m_generation);
+    m_readConnections.setLocalData(connection);
+
+    return connection;
 }
 
 // instance
@@ -18,15 +18,27 @@
 #ifndef SQLDATABASE_H
 #define SQLDATABASE_H
 
-#include <QHash>
 #include <QMutex>
+#include <QQueue>
 #include <QFuture>
+#include <QFutureInterface>
+#include <QWaitCondition>
+#include <QThreadStorage>
+#include <QSqlDatabase>
 #include <QSqlQuery>
 
 #include <QVariant> // Fix build with Qt 4.7
 
+#include <functional>
+
 #include "qzcommon.h"
 
+class SqlConnection;
+class SqlWriterThread;
+
+// All writes are done by one writer thread that owns read-write connection, other
+// threads read using their own read-only connections.
+// Database is in WAL mode, writer thread also checkpoints the log in background
 class QUPZILLA_EXPORT SqlDatabase : public QObject
 {
     Q_OBJECT
@@ -35,20 +47,93 @@ public:
     explicit SqlDatabase(QObject* parent = 0);
     ~SqlDatabase();
 
-    // Returns database connection for thread, creates new connection if not exists
-    QSqlDatabase databaseForThread(QThread* thread);
+    // Sets database that all connections will open, existing connections are reopened
+    void setDatabase(const QSqlDatabase &database);
+
+    // Returns read-only database connection for current thread, creates new connection if not exists
+    QSqlDatabase readDatabase();
 
-    // Executes query using correct database for current thread
+    // Executes query using read-only connection of current thread and cached prepared statement.
+    // Queries other than SELECT are executed by writer thread, waiting until they are committed.
+    // Rows of SELECT, numRowsAffected() and lastInsertId() are copied into returned query and
+    // the cached statement is reset, so returned query can't be prepared again
     QSqlQuery exec(QSqlQuery &query);
 
-    // Executes query asynchronously on one thread from QThreadPool
+    // Queues query to writer thread, failed query is rolled back without other queued writes
     QFuture<QSqlQuery> execAsync(const QSqlQuery &query);
 
+    // Calls function with writer connection on writer thread. Queued writes are batched
+    // into one transaction, so the function must not begin or commit transaction itself,
+    // each function runs in its own savepoint. Future is finished once the transaction is committed
+    template <typename T>
+    QFuture<T> runOnWriter(const std::function<T(QSqlDatabase &db)> &function);
+
+    // Waits until all queued writes are committed
+    void waitForWrites();
+
+    // Queues reclaiming of free pages and log checkpoint to writer thread. Pages can be
+    // reclaimed only after the database was rebuilt once, rebuilding blocks all writers
+    // until it is done, so it is only done on user request
+    void optimize(bool rebuild = false);
+
+    // Sets pragmas of connection to profile database, must be called right after opening it
+    static void setupConnection(QSqlDatabase &db);
+
     static SqlDatabase* instance();
 
 private:
-    QHash<QThread*, QSqlDatabase> m_databases;
+    struct WriteJob {
+        // Returns false when changes of the job must be rolled back
+        std::function<bool(QSqlDatabase &db)> run;
+        std::function<void()> finish;
+        bool transaction;
+    };
+
+    friend class SqlWriterThread;
+
+    void queueWrite(const WriteJob &job);
+    void runWriter();
+    void runOptimize(QSqlDatabase &db, bool rebuild);
+    void checkpoint(QSqlDatabase &db);
+
+    SqlConnection* readConnection();
+
     QMutex m_mutex;
+    QString m_databaseName;
+    QString m_connectOptions;
+    int m_generation;
+
+    QQueue<WriteJob> m_writeQueue;
+    QWaitCondition m_writeQueued;
+    QWaitCondition m_queueNotFull;
+    QWaitCondition m_writesDone;
+    int m_runningWrites;
+    bool m_stopping;
+
+    SqlWriterThread* m_writerThread;
+    SqlConnection* m_writerConnection;
+    QThreadStorage<SqlConnection*> m_readConnections;
 };
 
+template <typename T>
+QFuture<T> SqlDatabase::runOnWriter(const std::function<T(QSqlDatabase &db)> &function)
+{
+    QFutureInterface<T> interface;
+    interface.reportStarted();
+
+    WriteJob job;
+    job.run = [function, interface](QSqlDatabase &db) mutable {
+        interface.reportResult(function(db));
+        return true;
+    };
+    job.finish = [interface]() mutable {
+        interface.reportFinished();
+    };
+    job.transaction = true;
+
+    queueWrite(job);
+
+    return interface.future();
+}
+
 #endif // SQLDATABASE_H
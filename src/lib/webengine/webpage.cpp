@@ -54,6 +54,7 @@
 #include <QWebChannel>
 #include <QWebEngineHistory>
 #include <QWebEngineSettings>
+#include <QWebEngineScriptCollection>
 #include <QTimer>
 #include <QDesktopServices>
 #include <QMessageBox>
@@ -409,9 +410,38 @@ bool WebPage::acceptNavigationRequest(const QUrl &url, QWebEnginePage::Navigatio
     if (url.scheme() == QL1S("abp") && AdBlockManager::instance()->addSubscriptionFromUrl(url))
         return false;
 
+    if (isMainFrame)
+        updateElementHidingException(url);
+
     return QWebEnginePage::acceptNavigationRequest(url, type, isMainFrame);
 }
 
+void WebPage::updateElementHidingException(const QUrl &url)
+{
+    // Global element hiding style is injected on document creation, pages with exceptions
+    // get a script that stops it. Style is still removed on load finished for redirects.
+    AdBlockManager* manager = AdBlockManager::instance();
+    const QString name = manager->elementHidingStyleId() + QL1S("_disabled");
+    const bool exception = manager->elementHidingExceptionForUrl(url);
+    const QWebEngineScript oldScript = scripts().findScript(name);
+
+    if (exception == !oldScript.isNull())
+        return;
+
+    if (!exception) {
+        scripts().remove(oldScript);
+        return;
+    }
+
+    QWebEngineScript script;
+    script.setName(name);
+    script.setInjectionPoint(QWebEngineScript::DocumentCreation);
+    script.setWorldId(WebPage::SafeJsWorld);
+    script.setRunsOnSubFrames(false);
+    script.setSourceCode(Scripts::disableCssOnCreation(manager->elementHidingStyleId()));
+    scripts().insert(script);
+}
+
 bool WebPage::certificateError(const QWebEngineCertificateError &error)
 {
     return mApp->networkManager()->certificateError(error, view());
@@ -463,10 +493,11 @@ void WebPage::cleanBlockedObjects()
         return;
     }
 
-    // Apply global element hiding rules
-    const QString elementHiding = manager->elementHidingRules(url());
-    if (!elementHiding.isEmpty())
-        runJavaScript(Scripts::setCss(elementHiding), WebPage::SafeJsWorld);
+    // Global element hiding rules are already applied on document creation
+    if (!manager->elementHidingEnabledForUrl(url())) {
+        runJavaScript(Scripts::removeCss(manager->elementHidingStyleId()), WebPage::SafeJsWorld);
+        return;
+    }
 
     // Apply domain-specific element hiding rules
     const QString siteElementHiding = manager->elementHidingRulesForDomain(url());
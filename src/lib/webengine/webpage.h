@@ -99,6 +99,7 @@ private:
     QStringList chooseFiles(FileSelectionMode mode, const QStringList &oldFiles, const QStringList &acceptedMimeTypes) Q_DECL_OVERRIDE;
     QWebEnginePage* createWindow(QWebEnginePage::WebWindowType type) Q_DECL_OVERRIDE;
 
+    void updateElementHidingException(const QUrl &url);
     void handleUnknownProtocol(const QUrl &url);
     void desktopServicesOpen(const QUrl &url);
 
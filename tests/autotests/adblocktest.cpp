@@ -17,8 +17,26 @@
 * ============================================================ */
 #include "adblocktest.h"
 #include "adblockrule.h"
+#include "adblockmatcher.h"
+#include "adblockrequestcontext.h"
+#include "adblockprefilter.h"
+#include "adblocksearchtree.h"
+#include "adblocktokenindex.h"
+#include "adblockcache.h"
+#include "adblockrulesmodel.h"
+#include "adblockprofiler.h"
+#include "adblocksubscription.h"
+#include "datapaths.h"
+#include "settings.h"
 
 #include <QtTest/QtTest>
+#include <QDir>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QNetworkProxy>
+#include <QNetworkAccessManager>
+#include <QtConcurrent/QtConcurrentRun>
 
 class AdBlockRule_Test : public AdBlockRule
 {
@@ -34,6 +52,16 @@ public:
     }
 };
 
+void AdBlockTest::initTestCase()
+{
+    DataPaths::setCurrentProfilePath(QDir::tempPath() + "/qz-adblocktest");
+    Settings::createSettings(QDir::tempPath() + "/qz-adblocktest/settings.ini");
+
+    // AdBlockManager is only asked for disabled rules after download, it must not load any subscriptions
+    Settings settings;
+    settings.setValue("AdBlock/enabled", false);
+}
+
 void AdBlockTest::isMatchingCookieTest_data()
 {
     // Test copied from CookiesTest
@@ -107,3 +135,540 @@ void AdBlockTest::parseRegExpFilterTest()
 
     QCOMPARE(rule_test.parseRegExpFilter(parsedFilter), result);
 }
+
+void AdBlockTest::prefilterTest_data()
+{
+    QTest::addColumn<QStringList>("literals");
+    QTest::addColumn<QString>("string");
+
+    const QStringList literals = QStringList() << "/banner/" << "ads." << "&adtype=" << "-728x90.";
+
+    QTest::newRow("empty") << literals << QString();
+    QTest::newRow("short") << literals << QString("ad");
+    QTest::newRow("none") << literals << QString("https://www.example.com/index.html");
+    QTest::newRow("start") << literals << QString("ads.example.com/");
+    QTest::newRow("end") << literals << QString("https://example.com/banner/");
+    QTest::newRow("many") << literals << QString("https://ads.example.com/banner/x-728x90.png?a=1&adtype=2&ads.").repeated(20);
+    QTest::newRow("shortLiteral") << (QStringList() << "ad" << "/banner/") << QString("https://example.com/ad/x");
+}
+
+void AdBlockTest::prefilterTest()
+{
+    QFETCH(QStringList, literals);
+    QFETCH(QString, string);
+
+    AdBlockPrefilter prefilter;
+    foreach (const QString &literal, literals) {
+        prefilter.add(QStringRef(&literal));
+    }
+
+    QVector<uchar> candidates(string.size());
+    prefilter.findCandidates(string.constData(), string.size(), candidates.data());
+
+    // Every position where literal starts must be a candidate
+    for (int i = 0; i < string.size(); ++i) {
+        foreach (const QString &literal, literals) {
+            if (string.midRef(i).startsWith(literal)) {
+                QVERIFY(candidates.at(i));
+            }
+        }
+    }
+}
+
+void AdBlockTest::networkMatchTest_data()
+{
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<QUrl>("url");
+    QTest::addColumn<QUrl>("firstPartyUrl");
+    QTest::addColumn<int>("resourceType");
+    QTest::addColumn<bool>("result");
+
+    const QUrl firstParty("https://www.example.com/");
+    const int script = QWebEngineUrlRequestInfo::ResourceTypeScript;
+    const int image = QWebEngineUrlRequestInfo::ResourceTypeImage;
+
+    QTest::newRow("contains") << "/banner/" << QUrl("https://ads.com/banner/1.png") << firstParty << image << true;
+    QTest::newRow("containsCase") << "/BANNER/" << QUrl("https://ads.com/Banner/1.png") << firstParty << image << true;
+    QTest::newRow("matchCase") << "/BANNER/$match-case" << QUrl("https://ads.com/banner/1.png") << firstParty << image << false;
+    QTest::newRow("domain") << "||ads.com^" << QUrl("https://cdn.ads.com/x.js") << firstParty << script << true;
+    QTest::newRow("domainOther") << "||ads.com^" << QUrl("https://badads.com/x.js") << firstParty << script << false;
+    QTest::newRow("endsWith") << "/ad.js|" << QUrl("https://cdn.com/ad.js") << firstParty << script << true;
+    QTest::newRow("regexp") << "||cdn.com^*/ad.js" << QUrl("https://cdn.com/x/ad.js") << firstParty << script << true;
+    QTest::newRow("thirdParty") << "/ad.js$third-party" << QUrl("https://cdn.com/ad.js") << firstParty << script << true;
+    QTest::newRow("firstParty") << "/ad.js$third-party" << QUrl("https://static.example.com/ad.js") << firstParty << script << false;
+    QTest::newRow("notThirdParty") << "/ad.js$~third-party" << QUrl("https://static.example.com/ad.js") << firstParty << script << true;
+    QTest::newRow("type") << "/ad.js$image" << QUrl("https://cdn.com/ad.js") << firstParty << script << false;
+    QTest::newRow("notType") << "/ad.js$~image" << QUrl("https://cdn.com/ad.js") << firstParty << script << true;
+    QTest::newRow("firstPartyDomain") << "/ad.js$domain=example.com" << QUrl("https://cdn.com/ad.js") << firstParty << script << true;
+    QTest::newRow("otherFirstPartyDomain") << "/ad.js$domain=~example.com" << QUrl("https://cdn.com/ad.js") << firstParty << script << false;
+}
+
+void AdBlockTest::networkMatchTest()
+{
+    QFETCH(QString, filter);
+    QFETCH(QUrl, url);
+    QFETCH(QUrl, firstPartyUrl);
+    QFETCH(int, resourceType);
+    QFETCH(bool, result);
+
+    AdBlockRule rule(filter);
+    AdBlockRequestContext context(url, firstPartyUrl, static_cast<QWebEngineUrlRequestInfo::ResourceType>(resourceType));
+
+    QCOMPARE(rule.networkMatch(context), result);
+}
+
+void AdBlockTest::searchTreeTest_data()
+{
+    QTest::addColumn<QUrl>("url");
+    QTest::addColumn<QString>("result");
+
+    QTest::newRow("none") << QUrl("https://www.example.com/index.html") << QString();
+    QTest::newRow("shortestPrefix") << QUrl("https://cdn.com/banner/1.png") << QString("/ban");
+    QTest::newRow("sharedPrefix") << QUrl("https://ads.example.com/") << QString("ads.");
+    QTest::newRow("optionsNotMatching") << QUrl("https://cdn.com/ad.js") << QString("ad.js");
+    QTest::newRow("nonAscii") << QUrl("https://cdn.com/bänner/") << QString();
+}
+
+void AdBlockTest::searchTreeTest()
+{
+    QVector<AdBlockRule*> rules;
+    rules << new AdBlockRule(QSL("/banner/")) << new AdBlockRule(QSL("/ban")) << new AdBlockRule(QSL("ads.example"))
+          << new AdBlockRule(QSL("ads.")) << new AdBlockRule(QSL("/ad.js$image")) << new AdBlockRule(QSL("ad.js"))
+          << new AdBlockRule(QString::fromUtf8("bänner"));
+
+    AdBlockSearchTree tree;
+    foreach (const AdBlockRule* rule, rules) {
+        QVERIFY(tree.add(rule));
+    }
+    tree.build();
+
+    QFETCH(QUrl, url);
+    QFETCH(QString, result);
+
+    AdBlockRequestContext context(url, QUrl(QSL("https://www.example.com/")), QWebEngineUrlRequestInfo::ResourceTypeScript);
+    const AdBlockRule* rule = tree.find(context);
+
+    QCOMPARE(rule ? rule->filter() : QString(), result);
+
+    qDeleteAll(rules);
+}
+
+void AdBlockTest::searchTreeDuplicateLiteralTest()
+{
+    // Same literal in two subscriptions, the later one is removed from matcher
+    QVector<AdBlockRule*> rules;
+    rules << new AdBlockRule(QSL("/banner/")) << new AdBlockRule(QSL("/banner/"));
+
+    AdBlockMatcher* matcher = new AdBlockMatcher;
+    matcher->update(rules);
+
+    const AdBlockRequestContext context(QUrl(QSL("https://cdn.com/banner/1.png")), QUrl(QSL("https://www.example.com/")), QWebEngineUrlRequestInfo::ResourceTypeImage);
+    QVERIFY(matcher->match(context) == rules.at(1));
+
+    AdBlockMatcher* clone = matcher->clone();
+    rules.at(1)->setEnabled(false);
+    clone->removeRule(rules.at(1));
+
+    QVERIFY(clone->match(context) == rules.at(0));
+
+    rules.at(0)->setEnabled(false);
+    QVERIFY(!clone->match(context));
+
+    delete clone;
+    delete matcher;
+    qDeleteAll(rules);
+}
+
+void AdBlockTest::tokenIndexTest()
+{
+    const QStringList filters = QStringList()
+            << "||ads.example.com^" << "|https://cdn.com/ad" << "/banner/*/img^" << "/ad.js|"
+            << "&adtype=" << "||tracker.net/pixel.gif$image" << "/track/*$domain=example.com|~sub.example.com"
+            << "@@||ads.example.com/allowed^" << "@@/banner/ok/$domain=other.org" << "/\\/ad[0-9]+\\.png/"
+            << "*/popup." << "||ads.com^$third-party" << "-728x90." << "^adserver^" << "/ads/"
+            << "%20ads" << "ads." << "||example.com/ads/*.gif|" << "/pagead/$script" << "|http://"
+            << "@@||cdn.com/ad.js$script" << "ad" << "@@$domain=other.org" << "/ad/$~image";
+
+    QVector<AdBlockRule*> rules;
+    AdBlockTokenIndex index;
+
+    foreach (const QString &filter, filters) {
+        AdBlockRule* rule = new AdBlockRule(filter);
+        rules.append(rule);
+        index.add(rule);
+    }
+
+    const QStringList hosts = QStringList()
+            << "ads.example.com" << "sub.ads.example.com" << "badads.example.com" << "cdn.com" << "www.cdn.com"
+            << "tracker.net" << "ads.com" << "example.com" << "sub.example.com" << "adserver.org";
+
+    const QStringList paths = QStringList()
+            << "/" << "/ad.js" << "/ad.jsx" << "/allowed/x" << "/banner/x/img/1.png" << "/banner/ok/1.png"
+            << "/ad12.png" << "/adx.png" << "/x/popup.html" << "/a-728x90.gif" << "/adserver/" << "/ads/1.gif"
+            << "/ads/1.gifx" << "/%20ads" << "/pixel.gif" << "/track/me" << "/pagead/x.js" << "/?a=1&adtype=2"
+            << "/ad/" << "/Ad/" << "/x";
+
+    const QList<QUrl> firstPartyUrls = QList<QUrl>()
+            << QUrl("https://example.com/") << QUrl("https://sub.example.com/") << QUrl("https://other.org/");
+
+    const QList<int> resourceTypes = QList<int>()
+            << QWebEngineUrlRequestInfo::ResourceTypeImage << QWebEngineUrlRequestInfo::ResourceTypeScript;
+
+    // Index must return the same rule as checking all rules in order
+    foreach (const QString &scheme, QStringList() << "http" << "https") {
+        foreach (const QString &host, hosts) {
+            foreach (const QString &path, paths) {
+                const QUrl url(QSL("%1://%2%3").arg(scheme, host, path));
+
+                foreach (const QUrl &firstPartyUrl, firstPartyUrls) {
+                    foreach (int resourceType, resourceTypes) {
+                        const AdBlockRequestContext context(url, firstPartyUrl, QWebEngineUrlRequestInfo::ResourceType(resourceType));
+
+                        const AdBlockRule* expected = 0;
+                        foreach (const AdBlockRule* rule, rules) {
+                            if (rule->networkMatch(context)) {
+                                expected = rule;
+                                break;
+                            }
+                        }
+
+                        const AdBlockRule* rule = index.find(context);
+                        if (rule != expected) {
+                            QFAIL(qPrintable(QSL("%1 (%2): expected %3, found %4").arg(url.toString(), firstPartyUrl.toString(),
+                                             expected ? expected->filter() : QSL("none"), rule ? rule->filter() : QSL("none"))));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    qDeleteAll(rules);
+}
+
+void AdBlockTest::urlTokenIndexTest()
+{
+    const QStringList filters = QStringList()
+            << "@@||example.com^$document" << "@@||cdn.com/Path/$document,match-case" << "@@/Banner/$elemhide,match-case"
+            << "@@|https://other.org/$elemhide" << "@@/ads/*/page$document" << "@@.html?Id=$elemhide,match-case"
+            << "@@/\\/Case[0-9]+\\//$document,match-case" << "@@/banner/$elemhide" << "||example.com^";
+
+    QVector<AdBlockRule*> rules;
+    AdBlockTokenIndex index(&AdBlockRule::urlMatch);
+
+    foreach (const QString &filter, filters) {
+        AdBlockRule* rule = new AdBlockRule(filter);
+        rules.append(rule);
+        index.add(rule);
+    }
+
+    const QStringList hosts = QStringList() << "example.com" << "sub.example.com" << "cdn.com" << "other.org";
+
+    const QStringList paths = QStringList()
+            << "/" << "/Path/x" << "/path/x" << "/Banner/1" << "/banner/1" << "/BANNER/1" << "/ads/x/page"
+            << "/a.html?Id=1" << "/a.html?id=1" << "/Case12/" << "/case12/";
+
+    // Index must return the same rule as checking all rules in order
+    foreach (const QString &scheme, QStringList() << "http" << "https") {
+        foreach (const QString &host, hosts) {
+            foreach (const QString &path, paths) {
+                const QUrl url(QSL("%1://%2%3").arg(scheme, host, path));
+                const AdBlockRequestContext context(url, url, QWebEngineUrlRequestInfo::ResourceTypeMainFrame);
+
+                const AdBlockRule* expected = 0;
+                foreach (const AdBlockRule* rule, rules) {
+                    if (rule->urlMatch(context)) {
+                        expected = rule;
+                        break;
+                    }
+                }
+
+                const AdBlockRule* rule = index.find(context);
+                if (rule != expected) {
+                    QFAIL(qPrintable(QSL("%1: expected %2, found %3").arg(url.toString(),
+                                     expected ? expected->filter() : QSL("none"), rule ? rule->filter() : QSL("none"))));
+                }
+            }
+        }
+    }
+
+    // Case-sensitive rules are matched against url with its original case
+    const AdBlockRequestContext upperContext(QUrl("http://cdn.com/Path/x"), QUrl("http://cdn.com/Path/x"), QWebEngineUrlRequestInfo::ResourceTypeMainFrame);
+    const AdBlockRequestContext lowerContext(QUrl("http://cdn.com/path/x"), QUrl("http://cdn.com/path/x"), QWebEngineUrlRequestInfo::ResourceTypeMainFrame);
+    QCOMPARE(index.find(upperContext), static_cast<const AdBlockRule*>(rules.at(1)));
+    QVERIFY(!index.find(lowerContext));
+
+    qDeleteAll(rules);
+}
+
+void AdBlockTest::elementHidingRulesForDomainTest_data()
+{
+    QTest::addColumn<QString>("domain");
+    QTest::addColumn<QStringList>("result");
+
+    QTest::newRow("domain") << "example.com"
+                            << (QStringList() << ".ad1" << ".ad2" << ".generic");
+    QTest::newRow("excludedSubdomain") << "sub.example.com"
+                            << (QStringList() << ".ad1" << ".generic");
+    QTest::newRow("subdomain") << "a.b.example.co.uk"
+                            << (QStringList() << ".ad3" << ".ad4" << ".generic");
+    QTest::newRow("exception") << "other.com"
+                            << (QStringList() << ".ad3");
+    QTest::newRow("notSubdomain") << "anotherexample.com"
+                            << (QStringList() << ".ad3" << ".generic");
+}
+
+void AdBlockTest::elementHidingRulesForDomainTest()
+{
+    QVector<AdBlockRule*> rules;
+    rules.append(new AdBlockRule(QSL("example.com##.ad1")));
+    rules.append(new AdBlockRule(QSL("~sub.example.com,example.com##.ad2")));
+    rules.append(new AdBlockRule(QSL("~example.com##.ad3")));
+    rules.append(new AdBlockRule(QSL("example.co.uk##.ad4")));
+    rules.append(new AdBlockRule(QSL("##.generic")));
+    rules.append(new AdBlockRule(QSL("other.com#@#.generic")));
+
+    AdBlockMatcher* matcher = new AdBlockMatcher;
+    matcher->update(rules);
+
+    QFETCH(QString, domain);
+    QFETCH(QStringList, result);
+
+    QString css = matcher->elementHidingRulesForDomain(domain);
+    css.remove(QSL("{display:none !important;}\n"));
+
+    QStringList selectors = css.split(QL1C(','), QString::SkipEmptyParts);
+    selectors.sort();
+
+    QCOMPARE(selectors, result);
+
+    delete matcher;
+    qDeleteAll(rules);
+}
+
+void AdBlockTest::incrementalUpdateTest()
+{
+    QVector<AdBlockRule*> rules;
+    rules.append(new AdBlockRule(QSL("||ads.example.com^")));
+    rules.append(new AdBlockRule(QSL("##.ad1")));
+
+    AdBlockMatcher* matcher = new AdBlockMatcher;
+    matcher->update(rules);
+
+    const AdBlockRequestContext blocked(QUrl(QSL("http://ads.example.com/ad.js")), QUrl(QSL("http://example.com")), QWebEngineUrlRequestInfo::ResourceTypeScript);
+    const AdBlockRequestContext added(QUrl(QSL("http://tracker.com/t.gif")), QUrl(QSL("http://example.com")), QWebEngineUrlRequestInfo::ResourceTypeImage);
+
+    AdBlockRule* blockRule = new AdBlockRule(QSL("||tracker.com^"));
+    AdBlockRule* exceptionRule = new AdBlockRule(QSL("@@||ads.example.com/ad.js"));
+    AdBlockRule* cssRule = new AdBlockRule(QSL("##.ad2"));
+
+    AdBlockMatcher* clone = matcher->clone();
+    clone->addRule(blockRule);
+    clone->addRule(cssRule);
+
+    QVERIFY(clone->match(added) == blockRule);
+    QVERIFY(clone->match(blocked) == rules.at(0));
+    QCOMPARE(clone->elementHidingRules().contains(QSL(".ad2")), true);
+
+    // Original matcher is not changed
+    QVERIFY(!matcher->match(added));
+    QCOMPARE(matcher->elementHidingRules().contains(QSL(".ad2")), false);
+
+    clone->addRule(exceptionRule);
+    QVERIFY(!clone->match(blocked));
+
+    rules.at(1)->setEnabled(false);
+    clone->updateRule(rules.at(1));
+    QCOMPARE(clone->elementHidingRules().contains(QSL(".ad1")), false);
+
+    clone->removeRule(cssRule);
+    blockRule->setEnabled(false);
+    clone->removeRule(blockRule);
+    QVERIFY(!clone->match(added));
+    QVERIFY(clone->elementHidingRules().isEmpty());
+
+    delete clone;
+    delete matcher;
+    delete blockRule;
+    delete exceptionRule;
+    delete cssRule;
+    qDeleteAll(rules);
+}
+
+void AdBlockTest::cacheTest()
+{
+    // 16 shards with one entry each
+    AdBlockCache<int, int> cache(16);
+
+    int value = 0;
+    QVERIFY(!cache.find(1, value));
+
+    cache.insert(1, 10);
+    QVERIFY(cache.find(1, value));
+    QCOMPARE(value, 10);
+
+    // Keys 1 and 17 are in the same shard, older entry is evicted
+    cache.insert(17, 170);
+    QVERIFY(!cache.find(1, value));
+    QVERIFY(cache.find(17, value));
+    QCOMPARE(value, 170);
+
+    QCOMPARE(cache.hits(), 2);
+    QCOMPARE(cache.misses(), 2);
+
+    // Copy doesn't share any entries
+    AdBlockCache<int, int> copy(cache);
+    QVERIFY(!copy.find(17, value));
+}
+
+void AdBlockTest::profilerTest()
+{
+    AdBlockProfiler::reset();
+    AdBlockProfiler::setEnabled(true);
+
+    AdBlockRule* rule = new AdBlockRule(QSL("||ads.example.com^"));
+    AdBlockRule* other = new AdBlockRule(QSL("||tracker.com^"));
+
+    const AdBlockRequestContext blocked(QUrl(QSL("http://ads.example.com/ad.js")), QUrl(QSL("http://example.com")), QWebEngineUrlRequestInfo::ResourceTypeScript);
+    const AdBlockRequestContext allowed(QUrl(QSL("http://example.com/app.js")), QUrl(QSL("http://example.com")), QWebEngineUrlRequestInfo::ResourceTypeScript);
+
+    QVERIFY(rule->networkMatch(blocked));
+    QVERIFY(!rule->networkMatch(allowed));
+    QVERIFY(!other->networkMatch(blocked));
+
+    // Evaluations from other threads are merged
+    QtConcurrent::run([=]() { rule->networkMatch(blocked); }).waitForFinished();
+
+    QHash<const AdBlockRule*, AdBlockProfiler::RuleStatistics> statistics = AdBlockProfiler::statistics();
+    QCOMPARE(statistics.count(), 2);
+    QCOMPARE(statistics.value(rule).evaluations, quint64(3));
+    QCOMPARE(statistics.value(rule).hits, quint64(2));
+    QCOMPARE(statistics.value(other).evaluations, quint64(1));
+    QCOMPARE(statistics.value(other).hits, quint64(0));
+
+    // First evaluation on each thread is timed
+    QVERIFY(statistics.value(rule).samples >= 1);
+
+    // Statistics of deleted rule are removed
+    delete other;
+    statistics = AdBlockProfiler::statistics();
+    QCOMPARE(statistics.count(), 1);
+    QVERIFY(statistics.contains(rule));
+
+    AdBlockProfiler::reset();
+    QVERIFY(AdBlockProfiler::statistics().isEmpty());
+
+    // Nothing is counted when disabled
+    AdBlockProfiler::setEnabled(false);
+    QVERIFY(rule->networkMatch(blocked));
+    QVERIFY(AdBlockProfiler::statistics().isEmpty());
+
+    delete rule;
+}
+
+void AdBlockTest::rulesSearchTest_data()
+{
+    QTest::addColumn<QString>("string");
+    QTest::addColumn<QVector<int> >("result");
+
+    QTest::newRow("none") << "tracker" << QVector<int>();
+    QTest::newRow("one") << "banner" << (QVector<int>() << 1);
+    QTest::newRow("many") << "ads" << (QVector<int>() << 0 << 2 << 3);
+    QTest::newRow("twiceInRule") << "ad" << (QVector<int>() << 0 << 2 << 3);
+    QTest::newRow("caseInsensitive") << "example" << (QVector<int>() << 2);
+    QTest::newRow("lastRule") << "#.ad" << (QVector<int>() << 3);
+}
+
+void AdBlockTest::rulesSearchTest()
+{
+    QVector<QString> filters;
+    filters << QSL("||ads.com^") << QSL("/banner/") << QSL("@@||Example.com/ads.js") << QSL("##.ads");
+
+    const AdBlockRulesModel::SearchIndex index = AdBlockRulesModel::buildSearchIndex(filters);
+
+    QFETCH(QString, string);
+    QFETCH(QVector<int>, result);
+
+    QCOMPARE(AdBlockRulesModel::search(index, string), result);
+}
+
+void AdBlockTest::downloadTest_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("valid");
+
+    const QByteArray list("[Adblock Plus 2.0]\n! Title: Test\n||ads.example.com^\n##.banner\n");
+
+    QTest::newRow("plain") << list << true;
+    QTest::newRow("byteOrderMark") << QByteArray("\xEF\xBB\xBF") + list << true;
+    QTest::newRow("crlf") << QByteArray(list).replace("\n", "\r\n") << true;
+    QTest::newRow("html") << QByteArray("<html><body>Not found</body></html>\n") << false;
+    QTest::newRow("byteOrderMarkHtml") << QByteArray("\xEF\xBB\xBF<html></html>\n") << false;
+}
+
+void AdBlockTest::downloadTest()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, valid);
+
+    // Local HTTP server serving the fixture for any request
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    connect(&server, &QTcpServer::newConnection, this, [&]() {
+        QTcpSocket* socket = server.nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [=]() {
+            if (!socket->readAll().endsWith("\r\n\r\n")) {
+                return;
+            }
+
+            socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\nContent-Length: ");
+            socket->write(QByteArray::number(data.size()) + "\r\n\r\n");
+            socket->write(data);
+            socket->disconnectFromHost();
+        });
+    });
+
+    QNetworkAccessManager manager;
+    manager.setProxy(QNetworkProxy::NoProxy);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QUrl url(QSL("http://127.0.0.1:%1/list.txt").arg(server.serverPort()));
+
+    AdBlockSubscription subscription(QSL("Test"));
+    subscription.setFilePath(dir.path() + QSL("/list.txt"));
+    subscription.setUrl(url);
+    subscription.setNetworkAccessManager(&manager);
+
+    QSignalSpy updatedSpy(&subscription, SIGNAL(subscriptionUpdated()));
+    QSignalSpy errorSpy(&subscription, SIGNAL(subscriptionError(QString)));
+
+    subscription.updateSubscription();
+
+    QTRY_COMPARE(updatedSpy.count() + errorSpy.count(), 1);
+    QCOMPARE(updatedSpy.count(), valid ? 1 : 0);
+
+    if (!valid) {
+        QVERIFY(!QFile::exists(subscription.filePath()));
+        return;
+    }
+
+    QCOMPARE(subscription.allRules().count(), 3);
+
+    // Subscription header is followed by the downloaded list without byte order mark
+    QFile file(subscription.filePath());
+    QVERIFY(file.open(QFile::ReadOnly));
+
+    const QByteArray contents = file.readAll();
+    QVERIFY(contents.startsWith(QSL("Title: Test\nUrl: %1\n[Adblock Plus 2.0]").arg(url.toString()).toUtf8()));
+    QVERIFY(!contents.contains("\xEF\xBB\xBF"));
+
+    // Saved file can be loaded again
+    QVector<AdBlockRule*> rules;
+    QVERIFY(subscription.readRules(rules));
+    QCOMPARE(rules.count(), 3);
+    qDeleteAll(rules);
+}
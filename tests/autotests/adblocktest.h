@@ -25,12 +25,40 @@ class AdBlockTest : public QObject
     Q_OBJECT
 
 private slots:
+    void initTestCase();
+
     void isMatchingCookieTest_data();
     void isMatchingCookieTest();
 
     void parseRegExpFilterTest_data();
     void parseRegExpFilterTest();
 
+    void prefilterTest_data();
+    void prefilterTest();
+
+    void networkMatchTest_data();
+    void networkMatchTest();
+
+    void searchTreeTest_data();
+    void searchTreeTest();
+    void searchTreeDuplicateLiteralTest();
+
+    void tokenIndexTest();
+    void urlTokenIndexTest();
+
+    void elementHidingRulesForDomainTest_data();
+    void elementHidingRulesForDomainTest();
+
+    void incrementalUpdateTest();
+
+    void cacheTest();
+    void profilerTest();
+
+    void rulesSearchTest_data();
+    void rulesSearchTest();
+
+    void downloadTest_data();
+    void downloadTest();
 };
 
 #endif // ADBLOCKTEST_H
@@ -1,6 +1,6 @@
 include($$PWD/../../src/defines.pri)
 
-QT += webenginewidgets network widgets printsupport sql script dbus testlib
+QT += webenginewidgets network widgets printsupport sql script dbus testlib concurrent
 
 TARGET = autotests
 
@@ -56,6 +56,10 @@ HEADERS += \
     adblocktest.h \
     updatertest.h \
     passwordbackendtest.h \
+    databasemigrationtest.h \
+    sqldatabasetest.h \
+    locationcompleterindextest.h \
+    iconprovidertest.h \
 
 SOURCES += \
     qztoolstest.cpp \
@@ -64,3 +68,7 @@ SOURCES += \
     adblocktest.cpp \
     updatertest.cpp \
     passwordbackendtest.cpp \
+    databasemigrationtest.cpp \
+    sqldatabasetest.cpp \
+    locationcompleterindextest.cpp \
+    iconprovidertest.cpp \
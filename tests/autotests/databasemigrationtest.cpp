@@ -0,0 +1,103 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "databasemigrationtest.h"
+#include "profilemanager.h"
+
+#include <QtTest/QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+static const char* connectionName = "DatabaseMigrationTest";
+
+void DatabaseMigrationTest::init()
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase(QSL("QSQLITE"), QL1S(connectionName));
+    db.setDatabaseName(QSL(":memory:"));
+    QVERIFY(db.open());
+
+    // Schema of data/browsedata.db
+    QSqlQuery query(db);
+    QVERIFY(query.exec(QSL("CREATE TABLE history (title VARCHAR(200), count NUMERIC, id INTEGER PRIMARY KEY, date NUMERIC, url VARCHAR(256))")));
+    QVERIFY(query.exec(QSL("CREATE UNIQUE INDEX historyUrl ON history(url ASC)")));
+    QVERIFY(query.exec(QSL("CREATE INDEX historyTitle ON history(title ASC)")));
+    QVERIFY(query.exec(QSL("CREATE TABLE icons (icon TEXT, id INTEGER PRIMARY KEY, url TEXT)")));
+    QVERIFY(query.exec(QSL("CREATE UNIQUE INDEX iconsUrl ON icons(url ASC)")));
+}
+
+void DatabaseMigrationTest::cleanup()
+{
+    QSqlDatabase::database(QL1S(connectionName)).close();
+    QSqlDatabase::removeDatabase(QL1S(connectionName));
+}
+
+void DatabaseMigrationTest::migrateTest()
+{
+    QSqlDatabase db = QSqlDatabase::database(QL1S(connectionName));
+
+    QVERIFY(ProfileManager::migrateDatabase(db));
+
+    QSqlQuery query(db);
+    QVERIFY(query.exec(QSL("PRAGMA user_version")));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), ProfileManager::databaseVersion());
+
+    // Migrating up-to-date database does nothing
+    QVERIFY(ProfileManager::migrateDatabase(db));
+}
+
+void DatabaseMigrationTest::queryPlanTest_data()
+{
+    QTest::addColumn<QString>("query");
+
+    QTest::newRow("HistoryModel::init min") << QString("SELECT MIN(date) FROM history");
+    QTest::newRow("HistoryModel::init") << QString("SELECT id FROM history WHERE date BETWEEN ? AND ? LIMIT 1");
+    QTest::newRow("HistoryModel::fetchMore") << QString("SELECT id, count, title, url, date FROM history WHERE date BETWEEN ? AND ? ORDER BY date DESC");
+    QTest::newRow("History::indexesFromTimeRange") << QString("SELECT id FROM history WHERE date BETWEEN ? AND ?");
+    QTest::newRow("History::mostVisited") << QString("SELECT count, date, id, title, url FROM history ORDER BY count DESC LIMIT 10");
+    QTest::newRow("HistoryMenu") << QString("SELECT title, url FROM history ORDER BY date DESC LIMIT 10");
+    QTest::newRow("completeMostVisited") << QString("SELECT id, url, title FROM history ORDER BY count DESC LIMIT 15");
+    QTest::newRow("IconProvider") << QString("DELETE FROM icons WHERE url IN (SELECT url FROM history WHERE date < ?)");
+}
+
+void DatabaseMigrationTest::queryPlanTest()
+{
+    QSqlDatabase db = QSqlDatabase::database(QL1S(connectionName));
+    QVERIFY(ProfileManager::migrateDatabase(db));
+
+    QFETCH(QString, query);
+
+    QSqlQuery plan(db);
+    plan.prepare(QSL("EXPLAIN QUERY PLAN ") + query);
+    for (int i = 0; i < query.count(QL1C('?')); ++i) {
+        plan.addBindValue(0);
+    }
+    QVERIFY(plan.exec());
+
+    bool hasRows = false;
+
+    while (plan.next()) {
+        const QString detail = plan.value(3).toString();
+        hasRows = true;
+
+        // Neither full table scan nor sorting of all rows
+        QVERIFY2(!detail.contains(QL1S("SCAN")) || detail.contains(QL1S("USING")), qPrintable(detail));
+        QVERIFY2(!detail.contains(QL1S("TEMP B-TREE")), qPrintable(detail));
+    }
+
+    QVERIFY(hasRows);
+}
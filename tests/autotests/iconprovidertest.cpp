@@ -0,0 +1,94 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "iconprovidertest.h"
+#include "iconprovider.h"
+#include "sqldatabase.h"
+
+#include <QtTest/QtTest>
+#include <QBuffer>
+
+void IconProviderTest::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    QSqlDatabase db = QSqlDatabase::addDatabase(QSL("QSQLITE"), QSL("IconProviderTest"));
+    db.setDatabaseName(m_dir.filePath(QSL("test.db")));
+    QVERIFY(db.open());
+
+    QSqlQuery query(db);
+    QVERIFY(query.exec(QSL("CREATE TABLE icons (icon TEXT, id INTEGER PRIMARY KEY, url TEXT)")));
+    QVERIFY(query.exec(QSL("CREATE UNIQUE INDEX iconsUrl ON icons(url)")));
+
+    m_image = QImage(16, 16, QImage::Format_ARGB32);
+    m_image.fill(Qt::red);
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    m_image.save(&buffer, "PNG");
+
+    // Icon urls are saved both as text and as blob
+    query.prepare(QSL("INSERT INTO icons (icon, url) VALUES (?,?)"));
+    query.addBindValue(data);
+    query.addBindValue(QSL("https://text.org/page"));
+    QVERIFY(query.exec());
+
+    query.prepare(QSL("INSERT INTO icons (icon, url) VALUES (?,?)"));
+    query.addBindValue(data);
+    query.addBindValue(QByteArray("https://blob.org/page"));
+    QVERIFY(query.exec());
+
+    SqlDatabase::instance()->setDatabase(db);
+}
+
+void IconProviderTest::imagesForUrlsTest()
+{
+    const QUrl textUrl(QSL("https://text.org/page/#fragment"));
+    const QUrl blobUrl(QSL("https://blob.org/page"));
+    const QUrl missingUrl(QSL("https://missing.org/page"));
+
+    const QHash<QUrl, QImage> images = IconProvider::imagesForUrls({textUrl, blobUrl, missingUrl, QUrl()});
+
+    QCOMPARE(images.count(), 2);
+    QCOMPARE(images.value(textUrl).size(), QSize(16, 16));
+    QCOMPARE(images.value(blobUrl).pixel(0, 0), m_image.pixel(0, 0));
+    QVERIFY(!images.contains(missingUrl));
+}
+
+void IconProviderTest::cachedImageForUrlTest()
+{
+    const QUrl url(QSL("https://text.org/page"));
+    const QUrl missingUrl(QSL("https://missing.org/other"));
+
+    IconProvider* provider = IconProvider::instance();
+    QSignalSpy spy(provider, SIGNAL(imageLoaded(QUrl,QImage)));
+
+    // Not loaded yet, requested urls are loaded together
+    QVERIFY(provider->cachedImageForUrl(url).isNull());
+    QVERIFY(provider->cachedImageForUrl(url).isNull());
+    QVERIFY(provider->cachedImageForUrl(missingUrl).isNull());
+
+    QTRY_COMPARE(spy.count(), 2);
+    QCOMPARE(spy.at(0).at(0).toUrl(), url);
+    QCOMPARE(spy.at(0).at(1).value<QImage>().pixel(0, 0), m_image.pixel(0, 0));
+
+    // Loaded images are cached, url without icon has empty web image
+    QCOMPARE(provider->cachedImageForUrl(url).pixel(0, 0), m_image.pixel(0, 0));
+    QCOMPARE(provider->cachedImageForUrl(missingUrl), IconProvider::emptyWebImage());
+    QCOMPARE(spy.count(), 2);
+}
@@ -0,0 +1,202 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "locationcompleterindextest.h"
+#include "completer/locationcompleterindex.h"
+#include "bookmarkitem.h"
+
+#include <QtTest/QtTest>
+
+void LocationCompleterIndexTest::init()
+{
+    m_index = new LocationCompleterIndex;
+}
+
+void LocationCompleterIndexTest::cleanup()
+{
+    delete m_index;
+}
+
+void LocationCompleterIndexTest::addHistoryEntry(int id, const QString &url, const QString &title, int count, int daysAgo)
+{
+    HistoryEntry entry;
+    entry.id = id;
+    entry.url = QUrl(url);
+    entry.urlString = url;
+    entry.title = title;
+    entry.count = count;
+    entry.date = QDateTime::currentDateTime().addDays(-daysAgo);
+
+    m_index->addHistoryEntry(entry);
+}
+
+QStringList LocationCompleterIndexTest::completeUrls(const QString &searchString, int sources)
+{
+    QStringList urls;
+
+    foreach (const LocationCompleterIndex::Entry &entry, m_index->complete(searchString, 10, sources)) {
+        urls.append(entry.url.toString());
+    }
+
+    return urls;
+}
+
+void LocationCompleterIndexTest::tokenizeTest()
+{
+    QCOMPARE(LocationCompleterIndex::tokenize(QSL("https://www.Example.com/Path/to?q=1")),
+             QStringList() << QSL("https") << QSL("www") << QSL("example") << QSL("com")
+             << QSL("path") << QSL("to") << QSL("q") << QSL("1"));
+    QCOMPARE(LocationCompleterIndex::tokenize(QSL("  Qt - Wiki  ")), QStringList() << QSL("qt") << QSL("wiki"));
+    QCOMPARE(LocationCompleterIndex::tokenize(QSL("/ - ?")), QStringList());
+}
+
+void LocationCompleterIndexTest::completeTest()
+{
+    addHistoryEntry(1, QSL("https://github.com/QupZilla/qupzilla"), QSL("QupZilla browser"), 5, 1);
+    addHistoryEntry(2, QSL("https://www.qt.io/download"), QSL("Download Qt"), 5, 1);
+    addHistoryEntry(3, QSL("https://wiki.qt.io/Main"), QSL("Qt Wiki"), 5, 1);
+
+    // Prefixes of words in host, path and title
+    QCOMPARE(completeUrls(QSL("git")), QStringList() << QSL("https://github.com/QupZilla/qupzilla"));
+    QCOMPARE(completeUrls(QSL("brow")), QStringList() << QSL("https://github.com/QupZilla/qupzilla"));
+    QCOMPARE(completeUrls(QSL("DOWN")), QStringList() << QSL("https://www.qt.io/download"));
+    QCOMPARE(completeUrls(QSL("qt.io/main")), QStringList() << QSL("https://wiki.qt.io/Main"));
+
+    // All words must match
+    QCOMPARE(completeUrls(QSL("qt wiki")), QStringList() << QSL("https://wiki.qt.io/Main"));
+    QCOMPARE(completeUrls(QSL("qt github")), QStringList());
+
+    // Only beginnings of words are matched
+    QCOMPARE(completeUrls(QSL("hub")), QStringList());
+    QCOMPARE(completeUrls(QString()), QStringList());
+
+    QCOMPARE(completeUrls(QSL("qt")).count(), 2);
+    QCOMPARE(completeUrls(QSL("qt"), LocationCompleterIndex::SearchBookmarks), QStringList());
+
+    // Scheme and www are not matched as words, alone they match every url
+    QCOMPARE(completeUrls(QSL("w")), QStringList() << QSL("https://wiki.qt.io/Main"));
+    QCOMPARE(completeUrls(QSL("https://git")), QStringList() << QSL("https://github.com/QupZilla/qupzilla"));
+    QCOMPARE(completeUrls(QSL("www.qt.io/down")), QStringList() << QSL("https://www.qt.io/download"));
+    QCOMPARE(completeUrls(QSL("https://www")).count(), 3);
+}
+
+void LocationCompleterIndexTest::frecencyTest()
+{
+    addHistoryEntry(1, QSL("https://example.com/old"), QSL("Example"), 10, 200);
+    addHistoryEntry(2, QSL("https://example.com/recent"), QSL("Example"), 3, 1);
+    addHistoryEntry(3, QSL("https://example.com/often"), QSL("Example"), 50, 20);
+
+    QCOMPARE(completeUrls(QSL("example")), QStringList() << QSL("https://example.com/often")
+             << QSL("https://example.com/recent") << QSL("https://example.com/old"));
+
+    // Typed url gets bonus
+    m_index->addTypedUrl(QUrl(QSL("https://example.com/old")));
+    addHistoryEntry(1, QSL("https://example.com/old"), QSL("Example"), 5, 1);
+
+    QCOMPARE(completeUrls(QSL("example")), QStringList() << QSL("https://example.com/often")
+             << QSL("https://example.com/old") << QSL("https://example.com/recent"));
+
+    QCOMPARE(m_index->mostFrecent(1).first().url, QUrl(QSL("https://example.com/often")));
+
+    LocationCompleterIndex::Entry entry;
+    entry.count = 2;
+    entry.lastVisit = 1000;
+    entry.typed = false;
+    entry.bookmark = 0;
+
+    QVERIFY(LocationCompleterIndex::frecency(entry, 2000) > LocationCompleterIndex::frecency(entry, 1000LL * 60 * 60 * 24 * 100));
+}
+
+void LocationCompleterIndexTest::bookmarksTest()
+{
+    addHistoryEntry(1, QSL("https://example.com/"), QSL("Example"), 1, 1);
+
+    BookmarkItem* folder = new BookmarkItem(BookmarkItem::Folder);
+    BookmarkItem* bookmark = new BookmarkItem(BookmarkItem::Url, folder);
+    bookmark->setUrl(QUrl(QSL("https://example.com/")));
+    bookmark->setTitle(QSL("My bookmark"));
+
+    BookmarkItem* bookmark2 = new BookmarkItem(BookmarkItem::Url, folder);
+    bookmark2->setUrl(QUrl(QSL("https://bookmark.org/")));
+    bookmark2->setTitle(QSL("Only bookmark"));
+
+    m_index->addBookmark(folder);
+
+    // Bookmark and history entry with the same url are one entry
+    QVector<LocationCompleterIndex::Entry> entries = m_index->complete(QSL("my"), 10);
+    QCOMPARE(entries.count(), 1);
+    QCOMPARE(entries.at(0).id, 1);
+    QCOMPARE(entries.at(0).title, QSL("My bookmark"));
+    QCOMPARE(entries.at(0).bookmark, bookmark);
+
+    QCOMPARE(completeUrls(QSL("only")), QStringList() << QSL("https://bookmark.org/"));
+    QCOMPARE(completeUrls(QSL("only"), LocationCompleterIndex::SearchHistory), QStringList());
+
+    // Changed bookmark
+    bookmark2->setTitle(QSL("Renamed"));
+    m_index->addBookmark(bookmark2);
+    QCOMPARE(completeUrls(QSL("only")), QStringList());
+    QCOMPARE(completeUrls(QSL("renamed")), QStringList() << QSL("https://bookmark.org/"));
+
+    m_index->removeBookmark(folder);
+    QCOMPARE(completeUrls(QSL("my")), QStringList());
+    QCOMPARE(completeUrls(QSL("renamed")), QStringList());
+    QCOMPARE(completeUrls(QSL("example")), QStringList() << QSL("https://example.com/"));
+
+    delete folder;
+}
+
+void LocationCompleterIndexTest::removeTest()
+{
+    addHistoryEntry(1, QSL("https://example.com/a"), QSL("First"), 1, 1);
+    addHistoryEntry(2, QSL("https://example.com/b"), QSL("Second"), 1, 1);
+
+    HistoryEntry entry;
+    entry.url = QUrl(QSL("https://example.com/a"));
+    m_index->removeHistoryEntry(entry);
+
+    QCOMPARE(completeUrls(QSL("first")), QStringList());
+    QCOMPARE(completeUrls(QSL("example")), QStringList() << QSL("https://example.com/b"));
+
+    // Changed title
+    addHistoryEntry(2, QSL("https://example.com/b"), QSL("Changed"), 2, 1);
+    QCOMPARE(completeUrls(QSL("second")), QStringList());
+    QCOMPARE(completeUrls(QSL("changed")), QStringList() << QSL("https://example.com/b"));
+
+    // Removed words are pruned from the tree, new words reuse their nodes
+    addHistoryEntry(3, QSL("https://example.com/c"), QSL("Secret"), 1, 1);
+    QCOMPARE(completeUrls(QSL("sec")), QStringList() << QSL("https://example.com/c"));
+    QCOMPARE(completeUrls(QSL("seco")), QStringList());
+
+    m_index->clearHistory();
+    QCOMPARE(completeUrls(QSL("example")), QStringList());
+    QCOMPARE(m_index->mostFrecent(10).count(), 0);
+}
+
+void LocationCompleterIndexTest::completeDomainTest()
+{
+    addHistoryEntry(1, QSL("https://www.qupzilla.com/download"), QString(), 1, 1);
+    addHistoryEntry(2, QSL("http://wikipedia.org/"), QString(), 1, 1);
+    addHistoryEntry(3, QSL("ftp://qt.io/"), QString(), 1, 1);
+
+    QCOMPARE(m_index->completeDomain(QSL("qup")), QSL("www.qupzilla.com"));
+    QCOMPARE(m_index->completeDomain(QSL("www.qup")), QSL("www.qupzilla.com"));
+    QCOMPARE(m_index->completeDomain(QSL("wiki")), QSL("wikipedia.org"));
+    QCOMPARE(m_index->completeDomain(QSL("w")), QSL("wikipedia.org"));
+    QCOMPARE(m_index->completeDomain(QSL("qt")), QString());
+    QCOMPARE(m_index->completeDomain(QSL("qupzilla.com/down")), QString());
+}
@@ -20,6 +20,10 @@
 #include "adblocktest.h"
 #include "updatertest.h"
 #include "passwordbackendtest.h"
+#include "databasemigrationtest.h"
+#include "sqldatabasetest.h"
+#include "locationcompleterindextest.h"
+#include "iconprovidertest.h"
 
 #include <QtTest/QtTest>
 
@@ -39,6 +43,10 @@ int main(int argc, char *argv[])
 //    RUN_TEST(CookiesTest)
     RUN_TEST(AdBlockTest)
     RUN_TEST(UpdaterTest)
+    RUN_TEST(DatabaseMigrationTest)
+    RUN_TEST(SqlDatabaseTest)
+    RUN_TEST(LocationCompleterIndexTest)
+    RUN_TEST(IconProviderTest)
 
     RUN_TEST(DatabasePasswordBackendTest)
     RUN_TEST(DatabaseEncryptedPasswordBackendTest)
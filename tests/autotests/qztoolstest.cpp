@@ -161,6 +161,26 @@ void QzToolsTest::escapeSqlGlobString()
     QCOMPARE(QzTools::escapeSqlGlobString(input), result);
 }
 
+void QzToolsTest::escapeSqlLikeString_data()
+{
+    QTest::addColumn<QString>("input");
+    QTest::addColumn<QString>("result");
+
+    QTest::newRow("NothingToEscape") << "http://test" << "http://test";
+    QTest::newRow("Escape %") << "100%" << "100\\%";
+    QTest::newRow("Escape _") << "a_b_c" << "a\\_b\\_c";
+    QTest::newRow("Escape \\") << "a\\b" << "a\\\\b";
+    QTest::newRow("Escape \\%") << "\\%_" << "\\\\\\%\\_";
+}
+
+void QzToolsTest::escapeSqlLikeString()
+{
+    QFETCH(QString, input);
+    QFETCH(QString, result);
+
+    QCOMPARE(QzTools::escapeSqlLikeString(input), result);
+}
+
 class TempFile
 {
     QString name;
@@ -39,6 +39,8 @@ private slots:
 
     void escapeSqlGlobString_data();
     void escapeSqlGlobString();
+    void escapeSqlLikeString_data();
+    void escapeSqlLikeString();
 
     void ensureUniqueFilename();
 
@@ -0,0 +1,207 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "sqldatabasetest.h"
+#include "sqldatabase.h"
+
+#include <QtTest/QtTest>
+#include <QSqlError>
+#include <QtConcurrent/QtConcurrentRun>
+
+// Queries are only prepared to be passed to SqlDatabase
+static QSqlQuery createQuery(const QString &query)
+{
+    QSqlQuery sqlQuery(QSqlDatabase::database(QSL("SqlDatabaseTest")));
+    sqlQuery.prepare(query);
+    return sqlQuery;
+}
+
+void SqlDatabaseTest::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    QSqlDatabase db = QSqlDatabase::addDatabase(QSL("QSQLITE"), QSL("SqlDatabaseTest"));
+    db.setDatabaseName(m_dir.filePath(QSL("test.db")));
+    QVERIFY(db.open());
+
+    QSqlQuery query(db);
+    QVERIFY(query.exec(QSL("CREATE TABLE test (id INTEGER PRIMARY KEY, value TEXT)")));
+
+    SqlDatabase::instance()->setDatabase(db);
+}
+
+void SqlDatabaseTest::writeAndReadTest()
+{
+    for (int i = 0; i < 500; ++i) {
+        QSqlQuery query = createQuery(QSL("INSERT INTO test (value) VALUES (?)"));
+        query.addBindValue(QString::number(i));
+        SqlDatabase::instance()->execAsync(query);
+    }
+
+    SqlDatabase::instance()->waitForWrites();
+
+    QSqlQuery query = createQuery(QSL("SELECT COUNT(*) FROM test WHERE value LIKE ?"));
+    query.addBindValue(QSL("1%"));
+    SqlDatabase::instance()->exec(query);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 111);
+
+    // Readers on other threads see committed writes
+    QFuture<int> future = QtConcurrent::run([]() {
+        QSqlQuery query(SqlDatabase::instance()->readDatabase());
+        query.exec(QSL("SELECT COUNT(*) FROM test"));
+        return query.next() ? query.value(0).toInt() : -1;
+    });
+    QCOMPARE(future.result(), 500);
+
+    // Reader connection can't write
+    QSqlQuery readQuery(SqlDatabase::instance()->readDatabase());
+    QVERIFY(!readQuery.exec(QSL("DELETE FROM test")));
+}
+
+void SqlDatabaseTest::runOnWriterTest()
+{
+    QFuture<int> future = SqlDatabase::instance()->runOnWriter<int>([](QSqlDatabase &db) {
+        QSqlQuery query(db);
+        query.exec(QSL("DELETE FROM test WHERE id > 100"));
+        return query.numRowsAffected();
+    });
+
+    QCOMPARE(future.result(), 400);
+    QVERIFY(future.isFinished());
+
+    QSqlQuery query = createQuery(QSL("SELECT COUNT(*) FROM test"));
+    SqlDatabase::instance()->exec(query);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 100);
+}
+
+void SqlDatabaseTest::writeResultTest()
+{
+    QSqlQuery insertQuery = createQuery(QSL("INSERT INTO test (value) VALUES ('result')"));
+    SqlDatabase::instance()->exec(insertQuery);
+    QVERIFY(insertQuery.isActive());
+    const int id = insertQuery.lastInsertId().toInt();
+    QVERIFY(id > 0);
+
+    // Queries using the same cached statement don't share results
+    QSqlQuery secondQuery = createQuery(QSL("INSERT INTO test (value) VALUES ('result')"));
+    SqlDatabase::instance()->exec(secondQuery);
+    QCOMPARE(secondQuery.lastInsertId().toInt(), id + 1);
+    QCOMPARE(insertQuery.lastInsertId().toInt(), id);
+
+    QSqlQuery updateQuery = createQuery(QSL("UPDATE test SET value='updated' WHERE value='result'"));
+    SqlDatabase::instance()->exec(updateQuery);
+    QCOMPARE(updateQuery.numRowsAffected(), 2);
+
+    // Failed write doesn't roll back other writes committed in the same transaction
+    QSqlQuery failedQuery = createQuery(QSL("INSERT INTO test (id, value) VALUES (?, 'batch')"));
+    failedQuery.addBindValue(id);
+
+    SqlDatabase::instance()->execAsync(createQuery(QSL("INSERT INTO test (value) VALUES ('batch')")));
+    QFuture<QSqlQuery> failed = SqlDatabase::instance()->execAsync(failedQuery);
+    SqlDatabase::instance()->execAsync(createQuery(QSL("INSERT INTO test (value) VALUES ('batch')")));
+    SqlDatabase::instance()->waitForWrites();
+
+    QVERIFY(!failed.result().isActive());
+    QVERIFY(failed.result().lastError().isValid());
+
+    QSqlQuery query = createQuery(QSL("SELECT COUNT(*) FROM test WHERE value='batch'"));
+    SqlDatabase::instance()->exec(query);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 2);
+
+    QSqlQuery deleteQuery = createQuery(QSL("DELETE FROM test WHERE value IN ('updated', 'batch')"));
+    SqlDatabase::instance()->exec(deleteQuery);
+}
+
+void SqlDatabaseTest::checkpointTest()
+{
+    QSqlQuery countQuery = createQuery(QSL("SELECT COUNT(*) FROM test"));
+    SqlDatabase::instance()->exec(countQuery);
+    QVERIFY(countQuery.next());
+    const int count = countQuery.value(0).toInt();
+
+    // Only first row is read before the log is checkpointed
+    QSqlQuery query = createQuery(QSL("SELECT value FROM test ORDER BY id"));
+    SqlDatabase::instance()->exec(query);
+    QVERIFY(query.next());
+
+    SqlDatabase::instance()->execAsync(createQuery(QSL("INSERT INTO test (value) VALUES ('checkpoint')")));
+    SqlDatabase::instance()->waitForWrites();
+
+    QSqlQuery checkpointQuery(QSqlDatabase::database(QSL("SqlDatabaseTest")));
+    QVERIFY(checkpointQuery.exec(QSL("PRAGMA wal_checkpoint(PASSIVE)")));
+    QVERIFY(checkpointQuery.next());
+    QCOMPARE(checkpointQuery.value(0).toInt(), 0);
+    QCOMPARE(checkpointQuery.value(2).toInt(), checkpointQuery.value(1).toInt());
+
+    // Rest of the rows is still available
+    int rows = 1;
+    while (query.next()) {
+        ++rows;
+    }
+    QCOMPARE(rows, count);
+}
+
+void SqlDatabaseTest::optimizeTest()
+{
+    SqlDatabase::instance()->runOnWriter<bool>([](QSqlDatabase &db) {
+        QSqlQuery query(db);
+        query.prepare(QSL("INSERT INTO test (value) VALUES (?)"));
+
+        for (int i = 0; i < 5000; ++i) {
+            query.addBindValue(QString(200, QL1C('x')));
+            query.exec();
+        }
+        return true;
+    });
+
+    // Deleted rows leave free pages in the database
+    SqlDatabase::instance()->execAsync(createQuery(QSL("DELETE FROM test WHERE id > 100")));
+
+    // Database is not rebuilt unless requested
+    SqlDatabase::instance()->optimize();
+    SqlDatabase::instance()->waitForWrites();
+
+    QSqlQuery query(SqlDatabase::instance()->readDatabase());
+
+    QVERIFY(query.exec(QSL("PRAGMA auto_vacuum")));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 0);
+    query.finish();
+
+    SqlDatabase::instance()->optimize(true);
+    SqlDatabase::instance()->waitForWrites();
+
+    QVERIFY(query.exec(QSL("PRAGMA journal_mode")));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toString(), QSL("wal"));
+
+    QVERIFY(query.exec(QSL("PRAGMA auto_vacuum")));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 2);
+
+    QVERIFY(query.exec(QSL("PRAGMA freelist_count")));
+    QVERIFY(query.next());
+    QVERIFY(query.value(0).toInt() < 256);
+
+    query = createQuery(QSL("SELECT COUNT(*) FROM test"));
+    SqlDatabase::instance()->exec(query);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 100);
+}
@@ -16,11 +16,27 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 * ============================================================ */
 #include "adblockrule.h"
+#include "adblockmatcher.h"
 #include "adblocksubscription.h"
+#include "adblockrequestcontext.h"
+#include "allocationcounter.h"
 
 #include <QtTest/QtTest>
-#include <QNetworkRequest>
 
+#include <algorithm>
+#include <random>
+
+// Benchmark of AdBlockMatcher with a corpus of requests.
+//
+// Corpus is read from ../files/requests.txt if it exists, one request per line:
+//   <resource type number> <first-party url> <url>
+// Otherwise a deterministic corpus is generated from EasyList rules and random hosts and paths
+// (2000 first-party sites, 5000 third-party hosts, different path depths and queries).
+//
+// Results can be used as a regression gate with environment variables:
+//   ADBLOCK_BENCHMARK_MAX_P99_US     - fail when p99 latency of match is higher
+//   ADBLOCK_BENCHMARK_MAX_ALLOCS     - fail when average allocations per match are higher
+//   ADBLOCK_BENCHMARK_BLOCKED        - fail when number of blocked requests differs
 class AdBlockMatchRule : public QObject
 {
     Q_OBJECT
@@ -30,9 +46,29 @@ private slots:
     void cleanupTestCase();
 
     void networkMatch();
+    void networkMatchLatency();
+
+    void elementHidingRulesForDomain();
+    void elementHidingRulesForDomainLatency();
 
 private:
+    struct Request {
+        QUrl url;
+        QUrl firstPartyUrl;
+        QWebEngineUrlRequestInfo::ResourceType resourceType;
+    };
+
+    bool loadCorpus(const QString &fileName);
+    void generateCorpus(int count);
+
+    static qint64 percentile(QVector<qint64> values, double p);
+    static qint64 envLimit(const char* name);
+
     AdBlockSubscription* m_subscription;
+    AdBlockMatcher* m_matcher;
+
+    QVector<Request> m_requests;
+    QStringList m_hosts;
 };
 
 
@@ -40,34 +76,319 @@ void AdBlockMatchRule::initTestCase()
 {
     m_subscription = new AdBlockSubscription("EasyList", this);
     m_subscription->setFilePath("../files/easylist.txt");
-    m_subscription->loadSubscription(QStringList());
+    m_subscription->loadSubscription(QSet<QString>());
+
+    QVERIFY(!m_subscription->allRules().isEmpty());
+
+    m_matcher = new AdBlockMatcher;
+    m_matcher->update(m_subscription->allRules());
+
+    if (!loadCorpus("../files/requests.txt")) {
+        generateCorpus(50000);
+    }
+
+    QSet<QString> hosts;
+    foreach (const Request &request, m_requests) {
+        hosts.insert(request.firstPartyUrl.host());
+    }
+    m_hosts = hosts.toList();
+
+    qDebug() << "Corpus:" << m_requests.count() << "requests," << m_hosts.count() << "first-party hosts";
 }
 
 void AdBlockMatchRule::cleanupTestCase()
 {
+    delete m_matcher;
     delete m_subscription;
 }
 
 void AdBlockMatchRule::networkMatch()
 {
-    QList<QUrl> urls;
-    urls << QUrl("http://www.qupzilla.com");
-    urls << QUrl("https://developers.google.com/feed/v1/reference?csw=1");
-    urls << QUrl("http://pagead2.googlesyndication.com/pagead/show_ads.js");
-    urls << QUrl("https://qt.gitorious.org/qt-labs/qwebchannel/source/d48ca4efa70624c3178c0b97441ff7499aa2be36:src/webchannel/qwebchannel.cpp");
-    urls << QUrl("https://www.google.com/search?q=qmake+add+-Werror&ie=utf-8&oe=utf-8&aq=t&rls=org.mozilla:en-US:unofficial&client=iceweasel-a&channel=fflb#channel=fflb&q=gcc+-Werror&rls=org.mozilla:en-US:unofficial&start=10");
-    urls << QUrl("https://googleads.g.doubleclick.net/pagead/viewthroughconversion/977354488/?random=1397378259090&cv=7&fst=1397378259090&num=1&fmt=1&guid=ON&u_h=1080&u_w=1920&u_ah=1080&u_aw=1862&u_cd=24&u_his=3&u_tz=120&u_java=true&u_nplug=3&u_nmime=70&frm=2&url=https%3A//2507573.fls.doubleclick.net/activityi%3Bsrc%3D2507573%3Btype%3Dother026%3Bcat%3Dgoogl875%3Bord%3D8821468765381.725%3F&ref=https%3A//developers.google.com/feed/v1/reference%3Fcsw%3D1");
-    urls << QUrl("http://www.google-analytics.com/__utm.gif?utmwv=1.4&utmn=52554097&utmcs=ISO-8859-1&utmsr=1920x1080&utmsc=24-bit&utmul=cs-cz&utmje=1&utmfl=11.2 r202&utmdt=HTTP Authentication example&utmhn=www.pagetutor.com&utmhid=423185901&utmr=-&utmp=/keeper/http_authentication/index.html&utmac=UA-1399726-1&utmcc=__utma%3D30852926.644467994.1395073137.1395611798.1397378358.18%3B%2B__utmz%3D30852926.1395073137.1.1.utmccn%3D(direct)%7Cutmcsr%3D(direct)%7Cutmcmd%3D(none)%3B%2B");
+    QBENCHMARK {
+        foreach (const Request &request, m_requests) {
+            AdBlockRequestContext context(request.url, request.firstPartyUrl, request.resourceType);
+            m_matcher->match(context);
+        }
+    }
+}
+
+void AdBlockMatchRule::networkMatchLatency()
+{
+    QVector<qint64> times;
+    times.reserve(m_requests.count());
+
+    qint64 contextAllocations = 0;
+    qint64 matchAllocations = 0;
+    int blocked = 0;
+
+    QElapsedTimer total;
+    total.start();
+
+    QElapsedTimer timer;
+
+    foreach (const Request &request, m_requests) {
+        const qint64 before = AllocationCounter::count();
+        timer.start();
+
+        AdBlockRequestContext context(request.url, request.firstPartyUrl, request.resourceType);
+        const qint64 normalized = AllocationCounter::count();
+
+        if (m_matcher->match(context)) {
+            ++blocked;
+        }
+
+        times.append(timer.nsecsElapsed());
+
+        const qint64 matched = AllocationCounter::count();
+        contextAllocations += normalized - before;
+        matchAllocations += matched - normalized;
+    }
+
+    const qint64 elapsed = total.nsecsElapsed();
+    const int count = m_requests.count();
+
+    qDebug() << "Blocked:" << blocked << "of" << count;
+    qDebug() << "Latency: p50" << percentile(times, 0.5) / 1000.0 << "us, p99" << percentile(times, 0.99) / 1000.0 << "us";
+    qDebug() << "Throughput:" << qRound64(count / (elapsed / 1e9)) << "requests/s";
+
+    if (AllocationCounter::isSupported()) {
+        qDebug() << "Allocations per request: context" << double(contextAllocations) / count
+                 << ", match" << double(matchAllocations) / count;
+    }
+
+    const qint64 maxP99 = envLimit("ADBLOCK_BENCHMARK_MAX_P99_US");
+    if (maxP99 >= 0) {
+        QVERIFY2(percentile(times, 0.99) <= maxP99 * 1000, "p99 latency regressed");
+    }
 
+    const qint64 maxAllocations = envLimit("ADBLOCK_BENCHMARK_MAX_ALLOCS");
+    if (maxAllocations >= 0 && AllocationCounter::isSupported()) {
+        QVERIFY2(double(contextAllocations + matchAllocations) / count <= maxAllocations, "Allocations regressed");
+    }
+
+    const qint64 expectedBlocked = envLimit("ADBLOCK_BENCHMARK_BLOCKED");
+    if (expectedBlocked >= 0) {
+        QCOMPARE(qint64(blocked), expectedBlocked);
+    }
+}
+
+void AdBlockMatchRule::elementHidingRulesForDomain()
+{
     QBENCHMARK {
-        foreach (const QUrl &url, urls) {
-            QNetworkRequest req(url);
-            const AdBlockRule* rule = m_subscription->match(req, url.host(), url.toEncoded());
-            if (rule)
-                rule = 0;
+        foreach (const QString &host, m_hosts) {
+            m_matcher->elementHidingRulesForDomain(host);
         }
     }
 }
 
+void AdBlockMatchRule::elementHidingRulesForDomainLatency()
+{
+    QVector<qint64> times;
+    times.reserve(m_hosts.count());
+
+    const qint64 allocations = AllocationCounter::count();
+
+    QElapsedTimer timer;
+
+    foreach (const QString &host, m_hosts) {
+        timer.start();
+        m_matcher->elementHidingRulesForDomain(host);
+        times.append(timer.nsecsElapsed());
+    }
+
+    qDebug() << "Latency: p50" << percentile(times, 0.5) / 1000.0 << "us, p99" << percentile(times, 0.99) / 1000.0 << "us";
+
+    if (AllocationCounter::isSupported()) {
+        qDebug() << "Allocations per host:" << double(AllocationCounter::count() - allocations) / m_hosts.count();
+    }
+}
+
+bool AdBlockMatchRule::loadCorpus(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    while (!file.atEnd()) {
+        const QList<QByteArray> parts = file.readLine().trimmed().split(' ');
+        if (parts.size() != 3) {
+            continue;
+        }
+
+        Request request;
+        request.resourceType = static_cast<QWebEngineUrlRequestInfo::ResourceType>(parts.at(0).toInt());
+        request.firstPartyUrl = QUrl::fromEncoded(parts.at(1));
+        request.url = QUrl::fromEncoded(parts.at(2));
+        m_requests.append(request);
+    }
+
+    return !m_requests.isEmpty();
+}
+
+// Random lowercase word made of syllables, so generated hosts and paths look like real ones
+static QString randomWord(std::mt19937 &random, int minSyllables, int maxSyllables)
+{
+    static const char* const syllables[] = {
+        "ad", "an", "ba", "co", "da", "de", "el", "fo", "ga", "in", "ka", "lo", "ma", "me", "net",
+        "no", "on", "pa", "pro", "ra", "re", "sa", "so", "ta", "ti", "to", "un", "ve", "web", "zo"
+    };
+    const int syllablesCount = sizeof(syllables) / sizeof(syllables[0]);
+
+    QString word;
+    const int length = minSyllables + random() % (maxSyllables - minSyllables + 1);
+    for (int i = 0; i < length; ++i) {
+        word.append(QL1S(syllables[random() % syllablesCount]));
+    }
+    return word;
+}
+
+static QString randomHost(std::mt19937 &random)
+{
+    static const char* const subdomains[] = {
+        "www", "cdn", "static", "img", "api", "m", "media", "assets", "js", "news"
+    };
+    static const char* const tlds[] = {
+        "com", "net", "org", "de", "co.uk", "cz", "io", "fr", "ru", "com.br", "info", "jp"
+    };
+
+    QString host;
+    const int depth = random() % 3;
+    for (int i = 0; i < depth; ++i) {
+        host.append(QL1S(subdomains[random() % (sizeof(subdomains) / sizeof(subdomains[0]))]) + QL1C('.'));
+    }
+    const QString domain = randomWord(random, 1, 4);
+    return host + domain + QL1C('.') + QL1S(tlds[random() % (sizeof(tlds) / sizeof(tlds[0]))]);
+}
+
+static QString randomPath(std::mt19937 &random, QWebEngineUrlRequestInfo::ResourceType type)
+{
+    QString path;
+    const int depth = random() % 5;
+    for (int i = 0; i < depth; ++i) {
+        path.append(QL1C('/') + randomWord(random, 1, 3));
+        if (random() % 4 == 0) {
+            path.append(QL1C('-') + QString::number(random() % 10000));
+        }
+    }
+
+    const QString name = QL1C('/') + randomWord(random, 1, 3);
+    switch (type) {
+    case QWebEngineUrlRequestInfo::ResourceTypeScript:
+        path.append(name + (random() % 2 ? QL1S(".min.js") : QL1S(".js")));
+        break;
+    case QWebEngineUrlRequestInfo::ResourceTypeStylesheet:
+        path.append(name + QL1S(".css"));
+        break;
+    case QWebEngineUrlRequestInfo::ResourceTypeImage: {
+        static const char* const extensions[] = { ".png", ".jpg", ".gif", ".webp", ".svg" };
+        path.append(name + QString::number(random() % 2000));
+        path.append(QL1S(extensions[random() % 5]));
+        break;
+    }
+    default:
+        path.append(random() % 3 ? name : QString(QL1C('/')));
+        break;
+    }
+
+    // Query with random keys and values
+    const int queryItems = random() % 4 == 0 ? 1 + random() % 4 : 0;
+    for (int i = 0; i < queryItems; ++i) {
+        const QString key = randomWord(random, 1, 2);
+        path.append((i == 0 ? QL1C('?') : QL1C('&')) + key + QL1C('=') + QString::number(random(), 36));
+    }
+
+    return path;
+}
+
+void AdBlockMatchRule::generateCorpus(int count)
+{
+    // Fixed seed and raw generator output, so the corpus is the same on all platforms
+    std::mt19937 random(2018);
+
+    const QWebEngineUrlRequestInfo::ResourceType types[] = {
+        QWebEngineUrlRequestInfo::ResourceTypeScript, QWebEngineUrlRequestInfo::ResourceTypeImage,
+        QWebEngineUrlRequestInfo::ResourceTypeStylesheet, QWebEngineUrlRequestInfo::ResourceTypeXhr,
+        QWebEngineUrlRequestInfo::ResourceTypeSubFrame, QWebEngineUrlRequestInfo::ResourceTypeImage,
+        QWebEngineUrlRequestInfo::ResourceTypeFontResource, QWebEngineUrlRequestInfo::ResourceTypeMedia
+    };
+    const int typesCount = sizeof(types) / sizeof(types[0]);
+
+    // Pages are spread over many sites and every site loads resources from its own set of hosts
+    QStringList sites;
+    for (int i = 0; i < 2000; ++i) {
+        sites.append(randomHost(random));
+    }
+
+    QStringList thirdPartyHosts;
+    for (int i = 0; i < 5000; ++i) {
+        thirdPartyHosts.append(randomHost(random));
+    }
+
+    // Urls that should be blocked are made from plain patterns of block rules
+    QStringList patterns;
+    foreach (const AdBlockRule* rule, m_subscription->allRules()) {
+        QString filter = rule->filter();
+        if (rule->isCssRule() || rule->isComment() || rule->isException() || (filter.startsWith(QL1C('/')) && filter.endsWith(QL1C('/')))) {
+            continue;
+        }
+
+        filter = filter.left(filter.indexOf(QL1C('$')));
+        filter.remove(QL1C('|'));
+        filter.replace(QL1C('^'), QL1C('/'));
+        filter.replace(QL1C('*'), QL1S("x"));
+
+        if (!filter.isEmpty()) {
+            patterns.append(filter);
+        }
+    }
+
+    m_requests.reserve(count);
+
+    for (int i = 0; i < count; ++i) {
+        Request request;
+        request.resourceType = types[random() % typesCount];
+
+        const QString site = sites.at(random() % sites.size());
+        request.firstPartyUrl = QUrl(QL1S("https://") + site + randomPath(random, QWebEngineUrlRequestInfo::ResourceTypeMainFrame));
+
+        // About 30% of requests are ads, ad patterns are put into random urls
+        if (!patterns.isEmpty() && random() % 10 < 3) {
+            const QString &pattern = patterns.at(random() % patterns.size());
+            if (pattern.contains(QL1C('.')) && !pattern.startsWith(QL1C('/'))) {
+                request.url = QUrl(QL1S("http://") + pattern);
+            }
+            else {
+                const QString &host = thirdPartyHosts.at(random() % thirdPartyHosts.size());
+                request.url = QUrl(QL1S("https://") + host + QL1C('/') + randomWord(random, 1, 2) + pattern);
+            }
+        }
+        else {
+            // Half of other requests are first-party
+            const QString host = random() % 2 ? site : thirdPartyHosts.at(random() % thirdPartyHosts.size());
+            request.url = QUrl(QL1S("https://") + host + randomPath(random, request.resourceType));
+        }
+
+        m_requests.append(request);
+    }
+}
+
+qint64 AdBlockMatchRule::percentile(QVector<qint64> values, double p)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+
+    std::sort(values.begin(), values.end());
+    return values.at(qMin(values.size() - 1, int(values.size() * p)));
+}
+
+qint64 AdBlockMatchRule::envLimit(const char* name)
+{
+    bool ok;
+    const qint64 value = qgetenv(name).toLongLong(&ok);
+    return ok ? value : -1;
+}
+
 QTEST_MAIN(AdBlockMatchRule)
 #include "adblockmatchrule.moc"
@@ -1,4 +1,4 @@
 include(../benchmarks.pri)
 
 TARGET = adblockmatchrule
-SOURCES = adblockmatchrule.cpp
+SOURCES += adblockmatchrule.cpp
@@ -16,27 +16,107 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 * ============================================================ */
 #include "adblockrule.h"
-#include "adblocksubscription.h"
 
 #include <QtTest/QtTest>
 
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
 class AdBlockParseRule : public QObject
 {
     Q_OBJECT
 
 private slots:
+    void initTestCase();
+
     void parseEasyList();
+    void easyListMemory();
+
+private:
+    QStringList m_lines;
 };
 
+// Resident memory of the process in kB, only available on Linux
+static qint64 residentMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/statm");
+    if (!file.open(QFile::ReadOnly)) {
+        return -1;
+    }
+
+    const QList<QByteArray> values = file.readAll().split(' ');
+    if (values.size() < 2) {
+        return -1;
+    }
+
+    return values.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return -1;
+#endif
+}
+
+// Rules are parsed directly from lines, same as AdBlockSubscription does when
+// there is no rule cache, so neither benchmark depends on a cache file
+static QVector<AdBlockRule*> parseRules(const QStringList &lines)
+{
+    QVector<AdBlockRule*> rules;
+    rules.reserve(lines.count());
+
+    foreach (const QString &line, lines) {
+        rules.append(new AdBlockRule(line));
+    }
+
+    QSet<QString> domainsPool;
+    foreach (AdBlockRule* rule, rules) {
+        rule->internDomains(domainsPool);
+    }
+
+    return rules;
+}
+
+void AdBlockParseRule::initTestCase()
+{
+    QFile file("../files/easylist.txt");
+    QVERIFY(file.open(QFile::ReadOnly));
+
+    QTextStream textStream(&file);
+    textStream.setCodec("UTF-8");
+
+    // Skip header
+    textStream.readLine(1024);
+    textStream.readLine(1024);
+    textStream.readLine(1024);
+
+    while (!textStream.atEnd()) {
+        m_lines.append(textStream.readLine());
+    }
+}
 
 void AdBlockParseRule::parseEasyList()
 {
     QBENCHMARK {
-        AdBlockSubscription* subscription = new AdBlockSubscription("EasyList", this);
-        subscription->setFilePath("../files/easylist.txt");
-        subscription->loadSubscription(QStringList());
+        qDeleteAll(parseRules(m_lines));
     }
 }
 
+void AdBlockParseRule::easyListMemory()
+{
+    const qint64 before = residentMemory();
+    if (before < 0) {
+        QSKIP("Resident memory cannot be read on this platform");
+    }
+
+    const QVector<AdBlockRule*> rules = parseRules(m_lines);
+
+    const qint64 after = residentMemory();
+
+    qDebug() << "Rules:" << rules.count();
+    qDebug() << "Resident memory before:" << before << "kB, after:" << after << "kB, rules:" << (after - before) << "kB";
+
+    qDeleteAll(rules);
+}
+
 QTEST_MAIN(AdBlockParseRule)
 #include "adblockparserule.moc"
@@ -1,4 +1,4 @@
 include(../benchmarks.pri)
 
 TARGET = adblockparserule
-SOURCES = adblockparserule.cpp
+SOURCES += adblockparserule.cpp
@@ -1,11 +1,6 @@
 include($$PWD/../../src/defines.pri)
 
-isEqual(QT_MAJOR_VERSION, 5) {
-    QT += webkitwidgets network widgets printsupport sql script gui-private testlib
-} else {
-    QT += core gui webkit sql network script
-    CONFIG += qtestlib
-}
+QT += webenginewidgets network widgets printsupport sql testlib
 
 !unix|mac: LIBS += -L$$PWD/../../bin -lQupZilla
 !mac:unix: LIBS += $$PWD/../../bin/libQupZilla.so
@@ -18,6 +13,11 @@ MOC_DIR = build
 RCC_DIR = build
 UI_DIR = build
 
+HEADERS += $$PWD/allocationcounter.h
+SOURCES += $$PWD/allocationcounter.cpp
+
+INCLUDEPATH += $$PWD
+
 INCLUDEPATH += $$PWD/../../src/lib/3rdparty \
                $$PWD/../../src/lib/adblock \
                $$PWD/../../src/lib/app \
@@ -34,10 +34,9 @@ INCLUDEPATH += $$PWD/../../src/lib/3rdparty \
                $$PWD/../../src/lib/plugins \
                $$PWD/../../src/lib/popupwindow \
                $$PWD/../../src/lib/preferences \
-               $$PWD/../../src/lib/rss \
                $$PWD/../../src/lib/session \
                $$PWD/../../src/lib/sidebar \
                $$PWD/../../src/lib/tabwidget \
                $$PWD/../../src/lib/tools \
-               $$PWD/../../src/lib/webkit \
+               $$PWD/../../src/lib/webengine \
                $$PWD/../../src/lib/webtab \
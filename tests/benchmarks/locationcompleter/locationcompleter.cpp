@@ -0,0 +1,285 @@
+/* ============================================================
+* QupZilla - Qt web browser
+* Copyright (C) 2018 David Rosca <nowrep@gmail.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* ============================================================ */
+#include "completer/locationcompleterindex.h"
+#include "allocationcounter.h"
+
+#include <QtTest/QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include <algorithm>
+#include <climits>
+#include <random>
+
+// Benchmark of location bar completion while typing.
+//
+// History is read from ../files/browsedata.db if it exists (copy of a profile database),
+// otherwise a deterministic history is generated. Typing is simulated by completing every
+// prefix of one or two words of entry titles, as the completer does for each keystroke.
+// Measured is the time from keystroke to completion results, both when each keystroke
+// is searched from scratch and when results of previous keystroke are narrowed.
+//
+// Results can be used as a regression gate with environment variables:
+//   COMPLETER_BENCHMARK_MAX_P99_US  - fail when p99 latency of narrowed completion is higher
+class LocationCompleterBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void completeFromScratch();
+    void completeNarrowed();
+    void keystrokeLatency();
+
+private:
+    bool loadDatabase(const QString &fileName);
+    void generateHistory(int count);
+    void generateTyping(int count);
+
+    QVector<LocationCompleterIndex::Entry> complete(const QString &text, LocationCompleterIndex::Candidates* candidates);
+
+    static qint64 percentile(QVector<qint64> values, double p);
+    static qint64 envLimit(const char* name);
+
+    LocationCompleterIndex* m_index;
+
+    // Typed strings, each sequence is one completion session
+    QVector<QStringList> m_typing;
+};
+
+void LocationCompleterBenchmark::initTestCase()
+{
+    m_index = new LocationCompleterIndex;
+
+    if (!loadDatabase("../files/browsedata.db")) {
+        generateHistory(50000);
+    }
+
+    generateTyping(500);
+
+    int keystrokes = 0;
+    foreach (const QStringList &sequence, m_typing) {
+        keystrokes += sequence.count();
+    }
+
+    qDebug() << "Corpus:" << m_index->mostFrecent(INT_MAX).count() << "entries," << keystrokes << "keystrokes";
+}
+
+void LocationCompleterBenchmark::cleanupTestCase()
+{
+    delete m_index;
+}
+
+void LocationCompleterBenchmark::completeFromScratch()
+{
+    QBENCHMARK {
+        foreach (const QStringList &sequence, m_typing) {
+            foreach (const QString &text, sequence) {
+                complete(text, 0);
+            }
+        }
+    }
+}
+
+void LocationCompleterBenchmark::completeNarrowed()
+{
+    QBENCHMARK {
+        foreach (const QStringList &sequence, m_typing) {
+            LocationCompleterIndex::Candidates candidates;
+
+            foreach (const QString &text, sequence) {
+                complete(text, &candidates);
+            }
+        }
+    }
+}
+
+void LocationCompleterBenchmark::keystrokeLatency()
+{
+    QVector<qint64> scratchTimes;
+    QVector<qint64> narrowedTimes;
+
+    qint64 allocations = 0;
+    int keystrokes = 0;
+
+    QElapsedTimer timer;
+
+    foreach (const QStringList &sequence, m_typing) {
+        LocationCompleterIndex::Candidates candidates;
+
+        foreach (const QString &text, sequence) {
+            timer.start();
+            const QVector<LocationCompleterIndex::Entry> scratch = complete(text, 0);
+            scratchTimes.append(timer.nsecsElapsed());
+
+            const qint64 before = AllocationCounter::count();
+            timer.start();
+            const QVector<LocationCompleterIndex::Entry> narrowed = complete(text, &candidates);
+            narrowedTimes.append(timer.nsecsElapsed());
+            allocations += AllocationCounter::count() - before;
+            ++keystrokes;
+
+            // Narrowing must not change results
+            QCOMPARE(narrowed.count(), scratch.count());
+            for (int i = 0; i < scratch.count(); ++i) {
+                QCOMPARE(narrowed.at(i).url, scratch.at(i).url);
+            }
+        }
+    }
+
+    qDebug() << "From scratch: p50" << percentile(scratchTimes, 0.5) / 1000.0 << "us, p99" << percentile(scratchTimes, 0.99) / 1000.0 << "us";
+    qDebug() << "Narrowed: p50" << percentile(narrowedTimes, 0.5) / 1000.0 << "us, p99" << percentile(narrowedTimes, 0.99) / 1000.0 << "us";
+
+    if (AllocationCounter::isSupported()) {
+        qDebug() << "Allocations per narrowed keystroke:" << double(allocations) / keystrokes;
+    }
+
+    const qint64 maxP99 = envLimit("COMPLETER_BENCHMARK_MAX_P99_US");
+    if (maxP99 >= 0) {
+        QVERIFY2(percentile(narrowedTimes, 0.99) <= maxP99 * 1000, "p99 latency regressed");
+    }
+}
+
+bool LocationCompleterBenchmark::loadDatabase(const QString &fileName)
+{
+    if (!QFile::exists(fileName)) {
+        return false;
+    }
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QSL("QSQLITE"), QSL("LocationCompleterBenchmark"));
+        db.setDatabaseName(fileName);
+        db.setConnectOptions(QSL("QSQLITE_OPEN_READONLY"));
+
+        if (db.open()) {
+            QSqlQuery query(db);
+            query.exec(QSL("SELECT id, count, date, url, title FROM history"));
+
+            while (query.next()) {
+                HistoryEntry entry;
+                entry.id = query.value(0).toInt();
+                entry.count = query.value(1).toInt();
+                entry.date = QDateTime::fromMSecsSinceEpoch(query.value(2).toLongLong());
+                entry.url = query.value(3).toUrl();
+                entry.urlString = query.value(3).toString();
+                entry.title = query.value(4).toString();
+                m_index->addHistoryEntry(entry);
+            }
+        }
+    }
+
+    QSqlDatabase::removeDatabase(QSL("LocationCompleterBenchmark"));
+
+    return !m_index->mostFrecent(1).isEmpty();
+}
+
+void LocationCompleterBenchmark::generateHistory(int count)
+{
+    // Fixed seed and raw generator output, so the history is the same on all platforms
+    std::mt19937 random(2018);
+
+    const QStringList sites = QStringList()
+            << "www.example.com" << "news.example.co.uk" << "www.google.com" << "en.wikipedia.org"
+            << "www.youtube.com" << "www.reddit.com" << "github.com" << "www.bbc.co.uk"
+            << "edition.cnn.com" << "www.amazon.de" << "stackoverflow.com" << "www.idnes.cz";
+
+    const QStringList words = QStringList()
+            << "browser" << "qt" << "webengine" << "release" << "download" << "news" << "weather"
+            << "music" << "video" << "search" << "github" << "issue" << "documentation" << "tutorial"
+            << "sqlite" << "database" << "performance" << "benchmark" << "review" << "football"
+            << "politics" << "science" << "travel" << "recipe" << "history" << "bookmark" << "linux";
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    for (int i = 0; i < count; ++i) {
+        const QString site = sites.at(random() % sites.size());
+        const QString word1 = words.at(random() % words.size());
+        const QString word2 = words.at(random() % words.size());
+
+        HistoryEntry entry;
+        entry.id = i + 1;
+        entry.urlString = QSL("https://%1/%2/%3-%4").arg(site, word1, word2, QString::number(i));
+        entry.url = QUrl(entry.urlString);
+        entry.title = QSL("%1 %2 %3 - %4").arg(word1, word2, QString::number(i), site);
+        entry.count = 1 + random() % 50;
+        entry.date = QDateTime::fromMSecsSinceEpoch(now - qint64(random() % 365) * 24 * 60 * 60 * 1000);
+        m_index->addHistoryEntry(entry);
+    }
+}
+
+void LocationCompleterBenchmark::generateTyping(int count)
+{
+    std::mt19937 random(2018);
+
+    const QVector<LocationCompleterIndex::Entry> entries = m_index->mostFrecent(INT_MAX);
+    if (entries.isEmpty()) {
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const QStringList words = LocationCompleterIndex::tokenize(entries.at(random() % entries.size()).title);
+        if (words.isEmpty()) {
+            continue;
+        }
+
+        QStringList sequence;
+        QString typed;
+
+        // One or two words are typed character by character
+        for (int w = 0; w < qMin(2, words.count()); ++w) {
+            if (w > 0) {
+                typed.append(QL1C(' '));
+            }
+
+            foreach (const QChar &c, words.at(w)) {
+                typed.append(c);
+                sequence.append(typed);
+            }
+        }
+
+        m_typing.append(sequence);
+    }
+}
+
+QVector<LocationCompleterIndex::Entry> LocationCompleterBenchmark::complete(const QString &text, LocationCompleterIndex::Candidates* candidates)
+{
+    // Same limit as in completer
+    return m_index->complete(text, 30, LocationCompleterIndex::SearchAll, candidates);
+}
+
+qint64 LocationCompleterBenchmark::percentile(QVector<qint64> values, double p)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+
+    std::sort(values.begin(), values.end());
+    return values.at(qMin(values.size() - 1, int(values.size() * p)));
+}
+
+qint64 LocationCompleterBenchmark::envLimit(const char* name)
+{
+    bool ok;
+    const qint64 value = qgetenv(name).toLongLong(&ok);
+    return ok ? value : -1;
+}
+
+QTEST_MAIN(LocationCompleterBenchmark)
+#include "locationcompleter.moc"
@@ -0,0 +1,4 @@
+include(../benchmarks.pri)
+
+TARGET = locationcompleter
+SOURCES += locationcompleter.cpp